@@ -0,0 +1,60 @@
+#!/bin/sh
+
+#  Benchmark driver for dump_oas and dump_gds2
+#
+#  Generates a set of benchmark files with bench_gen and measures the
+#  dump throughput per mode. Run through "make bench".
+#
+#  Environment:
+#    BENCH_DIR     directory for the generated files (default: bench_data)
+#    BENCH_CELLS   number of cells (default: 50)
+#    BENCH_SHAPES  number of shapes per cell (default: 20000)
+#    BENCH_OPTS    additional options for dump_oas and dump_gds2 (i.e. "-s")
+
+dir=${BENCH_DIR:-bench_data}
+cells=${BENCH_CELLS:-50}
+shapes=${BENCH_SHAPES:-20000}
+
+mkdir -p $dir || exit 1
+
+#  mode name and bench_gen options
+modes="
+plain:
+cblock:-z 100
+rep:-r 50
+poly:-p 100
+prop:-a 50
+mixed:-z 50 -r 20 -p 30 -t 012345 -a 10
+"
+
+now () {
+  date +%s%N
+}
+
+#  run <dumper> <file> <records> <label>
+run () {
+  bytes=$(wc -c < $2)
+  t0=$(now)
+  ./$1 $BENCH_OPTS -o /dev/null $2 || exit 1
+  t1=$(now)
+  awk -v label="$4" -v b=$bytes -v r=$3 -v ns=$(($t1 - $t0)) 'BEGIN {
+    s = ns / 1e9;
+    if (s <= 0) { s = 1e-9; }
+    printf "%-16s %12d bytes %10d records %8.3f s %10.2f MB/s %12.0f records/s\n", label, b, r, s, b / s / 1e6, r / s;
+  }'
+}
+
+echo "$modes" | while IFS=: read mode opts; do
+
+  if [ "$mode" = "" ]; then
+    continue
+  fi
+
+  gen=$(./bench_gen -c $cells -e $shapes $opts $dir/$mode.oas $dir/$mode.gds) || exit 1
+  oas_records=$(echo "$gen" | awk '/\.oas:/ { print $4 }')
+  gds_records=$(echo "$gen" | awk '/\.gds:/ { print $4 }')
+
+  run dump_oas $dir/$mode.oas $oas_records "oas/$mode"
+  run dump_gds2 $dir/$mode.gds $gds_records "gds/$mode"
+
+done
@@ -0,0 +1,767 @@
+/*
+
+  KLayout Layout Viewer
+  Copyright (C) 2013-2018 Matthias Koefferlein
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+
+
+/**
+ *  @brief A generator for the benchmark files
+ *
+ *  This tool produces an OASIS file and an equivalent GDS2 file from the same
+ *  pseudo-random sequence of shapes. The files are reproducible for a given seed.
+ */
+
+#include "tlStream.h"
+#include "tlDeflate.h"
+#include "tlException.h"
+#include "tlString.h"
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <stdint.h>
+
+const char *version = "0.1";
+
+/**
+ *  @brief Print usage
+ */
+void syntax ()
+{
+  std::cout << 
+    "bench_gen - A generator for OASIS and GDS2 benchmark files" << std::endl <<
+    std::endl <<
+    "Usage: bench_gen [options] <OASIS file> <GDS2 file>" << std::endl <<
+    std::endl <<
+    "Options:" << std::endl <<
+    "  -c <cells>     number of cells (default: 100)" << std::endl <<
+    "  -e <shapes>    number of shapes per cell (default: 1000)" << std::endl <<
+    "  -z <percent>   percentage of cells put into CBLOCKs (OASIS only, default: 0)" << std::endl <<
+    "  -r <percent>   percentage of rectangles with repetitions (default: 0)" << std::endl <<
+    "  -p <percent>   percentage of polygons instead of rectangles (default: 0)" << std::endl <<
+    "  -t <types>     point list types used for polygons, i.e. \"0235\" (default: 012345)" << std::endl <<
+    "  -a <percent>   percentage of shapes with a property (default: 0)" << std::endl <<
+    "  -x <seed>      seed of the random sequence (default: 1)" << std::endl <<
+    std::endl <<
+    "Version " << version << std::endl <<
+    std::endl <<
+    "Distributed under GPL V2 or later" << std::endl;
+}
+
+namespace
+{
+
+/**
+ *  @brief The generator parameters
+ */
+struct BenchSpec
+{
+  BenchSpec ()
+    : cells (100), shapes (1000), cblock_percent (0), rep_percent (0), poly_percent (0), prop_percent (0), 
+      pointlist_types ("012345"), seed (1)
+  { }
+
+  int cells, shapes;
+  int cblock_percent, rep_percent, poly_percent, prop_percent;
+  std::string pointlist_types;
+  unsigned int seed;
+};
+
+/**
+ *  @brief A simple, portable random number generator (64 bit LCG)
+ */
+class Random
+{
+public:
+  Random (unsigned int seed)
+    : m_state (seed * 2862933555777941757ull + 3037000493ull)
+  { }
+
+  /**
+   *  @brief Delivers a number between 0 and n-1
+   */
+  unsigned int next (unsigned int n)
+  {
+    m_state = m_state * 6364136223846793005ull + 1442695040888963407ull;
+    return (unsigned int) ((m_state >> 33) % n);
+  }
+
+  /**
+   *  @brief Delivers true with the given percentage
+   */
+  bool chance (int percent)
+  {
+    return int (next (100)) < percent;
+  }
+
+private:
+  uint64_t m_state;
+};
+
+/**
+ *  @brief A shape as produced by the generator
+ *
+ *  Rectangles are given by x, y, w and h. Polygons are given by x, y and the 
+ *  staircase steps: the polygon goes "steps[0]" in x, "steps[1]" in y and so
+ *  forth, then back to x and finally to y. For point list type 1, the roles of 
+ *  x and y in the steps are swapped. 
+ */
+struct BenchShape
+{
+  bool polygon;
+  unsigned int layer, datatype;
+  int32_t x, y, w, h;
+  std::vector<int32_t> steps;
+  unsigned int pointlist_type;
+  unsigned int nx, ny;
+  int32_t dx, dy;
+  bool has_prop;
+  unsigned int prop_value;
+
+  /**
+   *  @brief Gets the polygon's points relative to x, y (without the closing point)
+   */
+  std::vector<std::pair<int32_t, int32_t> > points () const
+  {
+    std::vector<std::pair<int32_t, int32_t> > pts;
+
+    int32_t px = 0, py = 0;
+    pts.push_back (std::make_pair (px, py));
+    for (size_t i = 0; i < steps.size (); ++i) {
+      if ((i % 2 == 0) == (pointlist_type != 1)) {
+        px += steps [i];
+      } else {
+        py += steps [i];
+      }
+      pts.push_back (std::make_pair (px, py));
+    }
+
+    if (pointlist_type != 1) {
+      pts.push_back (std::make_pair (0, py));
+    } else {
+      pts.push_back (std::make_pair (px, 0));
+    }
+
+    return pts;
+  }
+};
+
+/**
+ *  @brief The cell as produced by the generator
+ */
+struct BenchCell
+{
+  std::string name;
+  std::vector<BenchShape> shapes;
+  bool has_child;
+  std::string child;
+  int32_t child_x, child_y;
+  bool cblock;
+};
+
+static void
+make_cell (Random &rnd, const BenchSpec &spec, int index, BenchCell &cell)
+{
+  cell.name = "CELL" + tl::to_string (index);
+  cell.cblock = rnd.chance (spec.cblock_percent);
+
+  cell.has_child = (index > 0);
+  if (cell.has_child) {
+    cell.child = "CELL" + tl::to_string (index - 1);
+    cell.child_x = int32_t (rnd.next (200001)) - 100000;
+    cell.child_y = int32_t (rnd.next (200001)) - 100000;
+  }
+
+  cell.shapes.clear ();
+  cell.shapes.reserve (spec.shapes);
+
+  for (int i = 0; i < spec.shapes; ++i) {
+
+    BenchShape s;
+    s.polygon = rnd.chance (spec.poly_percent);
+    s.layer = rnd.next (64);
+    s.datatype = rnd.next (4);
+    s.x = int32_t (rnd.next (2000001)) - 1000000;
+    s.y = int32_t (rnd.next (2000001)) - 1000000;
+    s.w = int32_t (rnd.next (1000)) + 1;
+    s.h = int32_t (rnd.next (1000)) + 1;
+    s.pointlist_type = 0;
+    s.nx = s.ny = 1;
+    s.dx = s.dy = 0;
+
+    if (s.polygon) {
+      unsigned int nsteps = rnd.next (8) + 1;
+      for (unsigned int j = 0; j < nsteps * 2; ++j) {
+        s.steps.push_back (int32_t (rnd.next (500)) + 1);
+      }
+      s.pointlist_type = (unsigned int) (spec.pointlist_types [rnd.next ((unsigned int) spec.pointlist_types.size ())] - '0');
+    } else if (rnd.chance (spec.rep_percent)) {
+      s.nx = rnd.next (4) + 2;
+      s.ny = rnd.next (4) + 2;
+      s.dx = s.w + int32_t (rnd.next (1000)) + 1;
+      s.dy = s.h + int32_t (rnd.next (1000)) + 1;
+    }
+
+    s.has_prop = rnd.chance (spec.prop_percent);
+    s.prop_value = rnd.next (100000);
+
+    cell.shapes.push_back (s);
+
+  }
+}
+
+// ---------------------------------------------------------------
+//  OASIS writer
+
+/**
+ *  @brief Writes the OASIS records
+ */
+class OASISBenchWriter
+{
+public:
+  OASISBenchWriter (tl::OutputStream &os)
+    : mp_os (&os), m_records (0)
+  { }
+
+  size_t records () const
+  {
+    return m_records;
+  }
+
+  void write_file (Random &rnd, const BenchSpec &spec)
+  {
+    static const char magic_bytes[] = { "%SEMI-OASIS\015\012" };
+    mp_os->put (magic_bytes, sizeof (magic_bytes) - 1);
+
+    //  START: version, resolution 1000 (type 0 real), table offsets at end
+    record (1);
+    write_str ("1.0");
+    write_uint (0);
+    write_uint (1000);
+    write_uint (1);
+
+    //  PROPNAME table: BENCH_PROP is ID 0, S_CELL_OFFSET is ID 1
+    uint64_t tables [12] = { 0 };
+    tables [4] = 1;
+    tables [5] = mp_os->pos ();
+
+    record (7);
+    write_str ("BENCH_PROP");
+    record (7);
+    write_str ("S_CELL_OFFSET");
+
+    std::vector<std::pair<std::string, uint64_t> > cell_offsets;
+
+    BenchCell cell;
+    for (int i = 0; i < spec.cells; ++i) {
+      make_cell (rnd, spec, i, cell);
+      cell_offsets.push_back (std::make_pair (cell.name, uint64_t (mp_os->pos ())));
+      write_cell (cell);
+    }
+
+    //  CELLNAME table with S_CELL_OFFSET properties for random access
+    tables [0] = 1;
+    tables [1] = mp_os->pos ();
+
+    for (std::vector<std::pair<std::string, uint64_t> >::const_iterator c = cell_offsets.begin (); c != cell_offsets.end (); ++c) {
+      record (3);
+      write_str (c->first);
+      record (28);
+      write_byte (0x16);  //  one value, name by reference
+      write_uint (1);
+      write_byte (8);
+      write_uint (c->second);
+    }
+
+    //  END: 12 table offsets, padding string to make 256 bytes, no validation
+    size_t table_bytes = 0;
+    record (2);
+    for (unsigned int i = 0; i < 12; ++i) {
+      table_bytes += write_uint (tables [i]);
+    }
+    write_str (std::string (256 - 1 - table_bytes - 2 - 1, '\0'));
+    write_uint (0);
+  }
+
+private:
+  tl::OutputStream *mp_os;
+  size_t m_records;
+
+  void record (unsigned char r)
+  {
+    ++m_records;
+    *mp_os << r;
+  }
+
+  void write_byte (unsigned char b)
+  {
+    *mp_os << b;
+  }
+
+  size_t write_uint (uint64_t v)
+  {
+    char b [16];
+    size_t n = 0;
+    do {
+      unsigned char c = (unsigned char) (v & 0x7f);
+      v >>= 7;
+      if (v != 0) {
+        c |= 0x80;
+      }
+      b [n++] = char (c);
+    } while (v != 0);
+    mp_os->put (b, n);
+    return n;
+  }
+
+  void write_int (int64_t v)
+  {
+    if (v < 0) {
+      write_uint ((uint64_t (-v) << 1) | 1);
+    } else {
+      write_uint (uint64_t (v) << 1);
+    }
+  }
+
+  void write_str (const std::string &s)
+  {
+    write_uint (s.size ());
+    mp_os->put (s);
+  }
+
+  void write_cell (const BenchCell &cell)
+  {
+    record (14);
+    write_str (cell.name);
+
+    if (! cell.cblock) {
+      write_cell_body (cell);
+      return;
+    }
+
+    //  produce the body in memory first
+    tl::OutputStringStream body_ss;
+    {
+      tl::OutputStream body (body_ss);
+      tl::OutputStream *os = mp_os;
+      mp_os = &body;
+      write_cell_body (cell);
+      mp_os = os;
+    }
+    std::string body_data = body_ss.string ();
+
+    tl::OutputStringStream comp_ss;
+    std::pair<size_t, size_t> counts;
+    {
+      tl::OutputStream comp (comp_ss);
+      comp.begin_deflate ();
+      comp.put (body_data);
+      counts = comp.end_deflate ();
+    }
+
+    record (34);
+    write_uint (0);
+    write_uint (counts.first);
+    write_uint (counts.second);
+    mp_os->put (comp_ss.string ());
+  }
+
+  void write_cell_body (const BenchCell &cell)
+  {
+    if (cell.has_child) {
+      record (17);
+      write_byte (0xb0);  //  explicit cell by name, x, y
+      write_str (cell.child);
+      write_int (cell.child_x);
+      write_int (cell.child_y);
+    }
+
+    for (std::vector<BenchShape>::const_iterator s = cell.shapes.begin (); s != cell.shapes.end (); ++s) {
+
+      if (s->polygon) {
+        write_polygon (*s);
+      } else {
+        write_rectangle (*s);
+      }
+
+      if (s->has_prop) {
+        record (28);
+        write_byte (0x16);  //  one value, name by reference
+        write_uint (0);
+        write_byte (8);
+        write_uint (s->prop_value);
+      }
+
+    }
+  }
+
+  void write_rectangle (const BenchShape &s)
+  {
+    bool rep = (s.nx > 1 || s.ny > 1);
+
+    record (20);
+    write_byte (0x7b | (rep ? 0x04 : 0));
+    write_uint (s.layer);
+    write_uint (s.datatype);
+    write_uint (s.w);
+    write_uint (s.h);
+    write_int (s.x);
+    write_int (s.y);
+
+    if (rep) {
+      write_uint (1);
+      write_uint (s.nx - 2);
+      write_uint (s.ny - 2);
+      write_uint (s.dx);
+      write_uint (s.dy);
+    }
+  }
+
+  void write_polygon (const BenchShape &s)
+  {
+    std::vector<std::pair<int32_t, int32_t> > pts = s.points ();
+
+    record (21);
+    write_byte (0x3b);
+    write_uint (s.layer);
+    write_uint (s.datatype);
+
+    write_uint (s.pointlist_type);
+
+    if (s.pointlist_type <= 1) {
+
+      //  1-deltas, alternating: the last point is implied
+      write_uint (pts.size () - 2);
+      for (size_t i = 1; i + 1 < pts.size (); ++i) {
+        int32_t d = (pts [i].first != pts [i - 1].first ? pts [i].first - pts [i - 1].first : pts [i].second - pts [i - 1].second);
+        write_int (d);
+      }
+
+    } else {
+
+      write_uint (pts.size () - 1);
+
+      int32_t ldx = 0, ldy = 0;
+      for (size_t i = 1; i < pts.size (); ++i) {
+
+        int32_t dx = pts [i].first - pts [i - 1].first;
+        int32_t dy = pts [i].second - pts [i - 1].second;
+
+        if (s.pointlist_type == 5) {
+          //  double deltas: general form
+          int32_t ddx = dx - ldx, ddy = dy - ldy;
+          ldx = dx;
+          ldy = dy;
+          write_uint ((uint64_t (ddx < 0 ? -ddx : ddx) << 2) | (ddx < 0 ? 2 : 0) | 1);
+          write_int (ddy);
+          continue;
+        }
+
+        //  Manhattan directions: east, north, west, south
+        unsigned int dir = (dx > 0 ? 0 : (dy > 0 ? 1 : (dx < 0 ? 2 : 3)));
+        uint64_t mag = uint64_t (dx != 0 ? (dx < 0 ? -dx : dx) : (dy < 0 ? -dy : dy));
+
+        if (s.pointlist_type == 2) {
+          write_uint ((mag << 2) | dir);
+        } else if (s.pointlist_type == 3) {
+          write_uint ((mag << 3) | dir);
+        } else {
+          write_uint ((mag << 4) | (dir << 1));
+        }
+
+      }
+
+    }
+
+    write_int (s.x);
+    write_int (s.y);
+  }
+};
+
+// ---------------------------------------------------------------
+//  GDS2 writer
+
+/**
+ *  @brief Writes the GDS2 records
+ *
+ *  Repetitions are expanded into single shapes since GDS2 does not support
+ *  shape arrays.
+ */
+class GDS2BenchWriter
+{
+public:
+  GDS2BenchWriter (tl::OutputStream &os)
+    : mp_os (&os), m_records (0)
+  { }
+
+  size_t records () const
+  {
+    return m_records;
+  }
+
+  void write_file (Random &rnd, const BenchSpec &spec)
+  {
+    record (0x00, 0x02, 2);
+    write_int16 (600);
+
+    record (0x01, 0x02, 24);
+    write_timestamp ();
+
+    write_str_record (0x02, "BENCH");
+
+    record (0x03, 0x05, 16);
+    write_double (0.001);
+    write_double (1e-9);
+
+    BenchCell cell;
+    for (int i = 0; i < spec.cells; ++i) {
+      make_cell (rnd, spec, i, cell);
+      write_cell (cell);
+    }
+
+    record (0x04, 0x00, 0);
+  }
+
+private:
+  tl::OutputStream *mp_os;
+  size_t m_records;
+
+  void record (unsigned char type, unsigned char datatype, size_t len)
+  {
+    ++m_records;
+    write_int16 (int16_t (len + 4));
+    *mp_os << type;
+    *mp_os << datatype;
+  }
+
+  void write_int16 (int16_t v)
+  {
+    char b [2] = { char (v >> 8), char (v) };
+    mp_os->put (b, 2);
+  }
+
+  void write_int32 (int32_t v)
+  {
+    char b [4] = { char (v >> 24), char (v >> 16), char (v >> 8), char (v) };
+    mp_os->put (b, 4);
+  }
+
+  void write_double (double d)
+  {
+    //  GDS2 excess-64 format
+    char b [8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    if (d != 0.0) {
+      if (d < 0) {
+        b [0] = char (0x80);
+        d = -d;
+      }
+      int e = 0;
+      while (d >= 1.0) {
+        d /= 16.0;
+        ++e;
+      }
+      while (d < 1.0 / 16.0) {
+        d *= 16.0;
+        --e;
+      }
+      b [0] |= char (e + 64);
+      uint64_t m = uint64_t (d * 72057594037927936.0 /*2^56*/ + 0.5);
+      for (int i = 7; i > 0; --i) {
+        b [i] = char (m & 0xff);
+        m >>= 8;
+      }
+    }
+    mp_os->put (b, 8);
+  }
+
+  void write_timestamp ()
+  {
+    static const int16_t ts[] = { 2018, 1, 1, 0, 0, 0 };
+    for (unsigned int i = 0; i < 12; ++i) {
+      write_int16 (ts [i % 6]);
+    }
+  }
+
+  void write_str_record (unsigned char type, const std::string &s)
+  {
+    size_t len = (s.size () + 1) & ~size_t (1);
+    record (type, 0x06, len);
+    mp_os->put (s);
+    if (len > s.size ()) {
+      *mp_os << char (0);
+    }
+  }
+
+  void write_cell (const BenchCell &cell)
+  {
+    record (0x05, 0x02, 24);
+    write_timestamp ();
+    write_str_record (0x06, cell.name);
+
+    if (cell.has_child) {
+      record (0x0a, 0x00, 0);
+      write_str_record (0x12, cell.child);
+      record (0x10, 0x03, 8);
+      write_int32 (cell.child_x);
+      write_int32 (cell.child_y);
+      record (0x11, 0x00, 0);
+    }
+
+    for (std::vector<BenchShape>::const_iterator s = cell.shapes.begin (); s != cell.shapes.end (); ++s) {
+
+      std::vector<std::pair<int32_t, int32_t> > pts;
+      if (s->polygon) {
+        pts = s->points ();
+      } else {
+        pts.push_back (std::make_pair (0, 0));
+        pts.push_back (std::make_pair (s->w, 0));
+        pts.push_back (std::make_pair (s->w, s->h));
+        pts.push_back (std::make_pair (0, s->h));
+      }
+
+      for (unsigned int ix = 0; ix < s->nx; ++ix) {
+        for (unsigned int iy = 0; iy < s->ny; ++iy) {
+
+          int32_t x = s->x + int32_t (ix) * s->dx;
+          int32_t y = s->y + int32_t (iy) * s->dy;
+
+          record (0x08, 0x00, 0);
+          record (0x0d, 0x02, 2);
+          write_int16 (int16_t (s->layer));
+          record (0x0e, 0x02, 2);
+          write_int16 (int16_t (s->datatype));
+
+          record (0x10, 0x03, (pts.size () + 1) * 8);
+          for (size_t i = 0; i <= pts.size (); ++i) {
+            const std::pair<int32_t, int32_t> &p = pts [i % pts.size ()];
+            write_int32 (x + p.first);
+            write_int32 (y + p.second);
+          }
+
+          if (s->has_prop) {
+            record (0x2b, 0x02, 2);
+            write_int16 (1);
+            write_str_record (0x2c, tl::to_string (s->prop_value));
+          }
+
+          record (0x11, 0x00, 0);
+
+        }
+      }
+
+    }
+
+    record (0x07, 0x00, 0);
+  }
+};
+
+void
+parse_percent (const char *arg, int &v, const char *opt)
+{
+  tl::from_string (arg, v);
+  if (v < 0 || v > 100) {
+    throw tl::Exception (tl::translate ("Invalid percentage for %s command line option"), opt);
+  }
+}
+
+}
+
+/**
+ *  @brief The main function
+ */
+int main (int argc, const char *argv[])
+{
+  try {
+
+    BenchSpec spec;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; ++i) {
+      std::string a = argv [i];
+      if (a == "-h" || a == "--help") {
+        syntax ();
+        return 1;
+      } else if (a == "-c" && i < argc - 1) {
+        tl::from_string (argv [++i], spec.cells);
+        if (spec.cells < 1) {
+          throw tl::Exception (tl::translate ("Invalid cell count for -c command line option"));
+        }
+      } else if (a == "-e" && i < argc - 1) {
+        tl::from_string (argv [++i], spec.shapes);
+        if (spec.shapes < 0) {
+          throw tl::Exception (tl::translate ("Invalid shape count for -e command line option"));
+        }
+      } else if (a == "-z" && i < argc - 1) {
+        parse_percent (argv [++i], spec.cblock_percent, "-z");
+      } else if (a == "-r" && i < argc - 1) {
+        parse_percent (argv [++i], spec.rep_percent, "-r");
+      } else if (a == "-p" && i < argc - 1) {
+        parse_percent (argv [++i], spec.poly_percent, "-p");
+      } else if (a == "-a" && i < argc - 1) {
+        parse_percent (argv [++i], spec.prop_percent, "-a");
+      } else if (a == "-t" && i < argc - 1) {
+        spec.pointlist_types = argv [++i];
+        if (spec.pointlist_types.empty () || spec.pointlist_types.find_first_not_of ("012345") != std::string::npos) {
+          throw tl::Exception (tl::translate ("Invalid point list types for -t command line option"));
+        }
+      } else if (a == "-x" && i < argc - 1) {
+        tl::from_string (argv [++i], spec.seed);
+      } else if (a [0] == '-') {
+        throw tl::Exception (tl::translate ("Unknown option ") + a);
+      } else {
+        files.push_back (a);
+      }
+    }
+
+    if (files.size () != 2) {
+      throw tl::Exception (tl::translate ("Two output files (OASIS and GDS2) required"));
+    }
+
+    {
+      tl::OutputFile file (files [0]);
+      tl::OutputBuffer buffer (file);
+      tl::OutputStream os (buffer);
+      Random rnd (spec.seed);
+      OASISBenchWriter writer (os);
+      writer.write_file (rnd, spec);
+      os.flush ();
+      std::cout << files [0] << ": " << os.pos () << " bytes, " << writer.records () << " records" << std::endl;
+    }
+
+    {
+      tl::OutputFile file (files [1]);
+      tl::OutputBuffer buffer (file);
+      tl::OutputStream os (buffer);
+      Random rnd (spec.seed);
+      GDS2BenchWriter writer (os);
+      writer.write_file (rnd, spec);
+      os.flush ();
+      std::cout << files [1] << ": " << os.pos () << " bytes, " << writer.records () << " records" << std::endl;
+    }
+
+  } catch (tl::Exception &ex) {
+    std::cerr << "*** ERROR: " << ex.msg () << std::endl;
+    return 2;
+  }
+
+  return 0;
+}
+
@@ -0,0 +1,376 @@
+/*
+
+  KLayout Layout Viewer
+  Copyright (C) 2013-2018 Matthias Koefferlein
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+
+
+#include "dbCellIndex.h"
+
+#include "tlString.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace db
+{
+
+// ---------------------------------------------------------------
+//  Utilities
+
+static const char cell_index_magic[] = "CELLIDX1";
+
+static const size_t header_size = 32;
+static const size_t entry_size = 40;
+
+static const uint32_t flag_has_id = 1;
+static const uint32_t flag_in_cblock = 2;
+
+static void
+put_u64 (std::string &s, uint64_t v)
+{
+  for (unsigned int i = 0; i < 8; ++i) {
+    s += char (v & 0xff);
+    v >>= 8;
+  }
+}
+
+static void
+put_u32 (std::string &s, uint32_t v)
+{
+  for (unsigned int i = 0; i < 4; ++i) {
+    s += char (v & 0xff);
+    v >>= 8;
+  }
+}
+
+static uint64_t
+get_u64 (const unsigned char *p)
+{
+  uint64_t v = 0;
+  for (unsigned int i = 8; i > 0; ) {
+    v = (v << 8) | uint64_t (p [--i]);
+  }
+  return v;
+}
+
+static uint32_t
+get_u32 (const unsigned char *p)
+{
+  uint32_t v = 0;
+  for (unsigned int i = 4; i > 0; ) {
+    v = (v << 8) | uint32_t (p [--i]);
+  }
+  return v;
+}
+
+struct CompareEntryByName
+{
+  bool operator() (const CellIndexEntry *a, const CellIndexEntry *b) const
+  {
+    return a->name < b->name;
+  }
+};
+
+struct CompareEntryById
+{
+  CompareEntryById (const std::vector<const CellIndexEntry *> &entries)
+    : mp_entries (&entries)
+  { }
+
+  bool operator() (uint64_t a, uint64_t b) const
+  {
+    return (*mp_entries) [a]->id < (*mp_entries) [b]->id;
+  }
+
+private:
+  const std::vector<const CellIndexEntry *> *mp_entries;
+};
+
+// ---------------------------------------------------------------
+//  CellIndex implementation
+
+CellIndex::CellIndex ()
+  : mp_file (0), mp_data (0), m_count (0), m_id_count (0)
+{
+  //  .. nothing yet ..
+}
+
+CellIndex::~CellIndex ()
+{
+  release ();
+}
+
+void
+CellIndex::release ()
+{
+  delete mp_file;
+  mp_file = 0;
+  mp_data = 0;
+  m_count = m_id_count = 0;
+}
+
+std::string
+CellIndex::sidecar_path (const std::string &path)
+{
+  return path + ".cellidx";
+}
+
+size_t
+CellIndex::size () const
+{
+  return mp_data ? size_t (m_count) : m_entries.size ();
+}
+
+void
+CellIndex::write (const std::string &path)
+{
+  uint64_t file_size = 0, file_mtime = 0;
+  if (! tl::file_stamp (path, file_size, file_mtime)) {
+    throw tl::Exception (tl::sprintf (tl::translate ("Unable to get size and modification time of %s"), path));
+  }
+
+  std::vector<const CellIndexEntry *> entries;
+  entries.reserve (m_entries.size ());
+  for (std::vector<CellIndexEntry>::const_iterator e = m_entries.begin (); e != m_entries.end (); ++e) {
+    entries.push_back (&*e);
+  }
+  std::stable_sort (entries.begin (), entries.end (), CompareEntryByName ());
+
+  std::vector<uint64_t> ids;
+  for (size_t i = 0; i < entries.size (); ++i) {
+    if (entries [i]->has_id) {
+      ids.push_back (i);
+    }
+  }
+  std::stable_sort (ids.begin (), ids.end (), CompareEntryById (entries));
+
+  std::string data;
+  data.reserve (header_size + entries.size () * (entry_size + 8 + 16));
+
+  data += std::string (cell_index_magic, sizeof (cell_index_magic) - 1);
+  put_u64 (data, file_size);
+  put_u64 (data, file_mtime);
+  put_u64 (data, entries.size ());
+
+  uint64_t name_offset = header_size + entries.size () * entry_size + ids.size () * 8;
+  for (std::vector<const CellIndexEntry *>::const_iterator e = entries.begin (); e != entries.end (); ++e) {
+    put_u64 (data, name_offset);
+    put_u32 (data, uint32_t ((*e)->name.size ()));
+    put_u32 (data, ((*e)->has_id ? flag_has_id : 0) | ((*e)->in_cblock ? flag_in_cblock : 0));
+    put_u64 (data, (*e)->id);
+    put_u64 (data, (*e)->offset);
+    put_u64 (data, (*e)->inner_offset);
+    name_offset += (*e)->name.size ();
+  }
+
+  for (std::vector<uint64_t>::const_iterator i = ids.begin (); i != ids.end (); ++i) {
+    put_u64 (data, *i);
+  }
+
+  for (std::vector<const CellIndexEntry *>::const_iterator e = entries.begin (); e != entries.end (); ++e) {
+    data += (*e)->name;
+  }
+
+  tl::OutputFile file (sidecar_path (path));
+  tl::OutputStream os (file);
+  os.put (data.c_str (), data.size ());
+  os.flush ();
+}
+
+bool
+CellIndex::load (const std::string &path)
+{
+  release ();
+
+  uint64_t file_size = 0, file_mtime = 0;
+  if (! tl::file_stamp (path, file_size, file_mtime)) {
+    return false;
+  }
+
+  std::string index_path = sidecar_path (path);
+  if (! tl::InputMappedFile::is_mappable (index_path)) {
+    return false;
+  }
+
+  try {
+    mp_file = new tl::InputMappedFile (index_path);
+  } catch (tl::Exception &) {
+    release ();
+    return false;
+  }
+
+  const unsigned char *d = (const unsigned char *) mp_file->mapped_data ();
+  size_t n = mp_file->mapped_size ();
+
+  //  check the header and whether the index was made for this file
+  if (! d || n < header_size || memcmp (d, cell_index_magic, sizeof (cell_index_magic) - 1) != 0
+      || get_u64 (d + 8) != file_size || get_u64 (d + 16) != file_mtime) {
+    release ();
+    return false;
+  }
+
+  uint64_t count = get_u64 (d + 24);
+  if (count > (n - header_size) / entry_size) {
+    release ();
+    return false;
+  }
+
+  //  the ID table extends up to the first name
+  uint64_t names_start = header_size + count * entry_size;
+  if (count > 0) {
+    names_start = get_u64 (d + header_size);
+  }
+  if (names_start > n || names_start < header_size + count * entry_size || (names_start - header_size - count * entry_size) % 8 != 0) {
+    release ();
+    return false;
+  }
+
+  //  all names must be inside the file
+  for (uint64_t i = 0; i < count; ++i) {
+    const unsigned char *e = d + header_size + i * entry_size;
+    uint64_t no = get_u64 (e);
+    if (no < names_start || no > n || get_u32 (e + 8) > n - no) {
+      release ();
+      return false;
+    }
+  }
+
+  mp_data = d;
+  m_count = count;
+  m_id_count = (names_start - header_size - count * entry_size) / 8;
+
+  for (uint64_t i = 0; i < m_id_count; ++i) {
+    if (get_u64 (d + header_size + count * entry_size + i * 8) >= count) {
+      release ();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void
+CellIndex::get_entry (uint64_t index, CellIndexEntry &entry) const
+{
+  const unsigned char *e = mp_data + header_size + index * entry_size;
+
+  uint32_t flags = get_u32 (e + 12);
+
+  entry.name = std::string ((const char *) mp_data + get_u64 (e), size_t (get_u32 (e + 8)));
+  entry.has_id = (flags & flag_has_id) != 0;
+  entry.id = (unsigned long) get_u64 (e + 16);
+  entry.offset = get_u64 (e + 24);
+  entry.in_cblock = (flags & flag_in_cblock) != 0;
+  entry.inner_offset = get_u64 (e + 32);
+}
+
+bool
+CellIndex::find (const std::string &name, CellIndexEntry &entry) const
+{
+  if (! mp_data) {
+    return false;
+  }
+
+  //  binary search on the entries sorted by name
+  uint64_t lo = 0, hi = m_count;
+  while (lo < hi) {
+
+    uint64_t mid = lo + (hi - lo) / 2;
+    const unsigned char *e = mp_data + header_size + mid * entry_size;
+
+    const char *n = (const char *) mp_data + get_u64 (e);
+    size_t l = size_t (get_u32 (e + 8));
+
+    int c = memcmp (n, name.c_str (), std::min (l, name.size ()));
+    if (c == 0) {
+      c = (l < name.size () ? -1 : (l > name.size () ? 1 : 0));
+    }
+
+    if (c == 0) {
+      get_entry (mid, entry);
+      return true;
+    } else if (c < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+
+  }
+
+  return false;
+}
+
+bool
+CellIndex::find_id (unsigned long id, CellIndexEntry &entry) const
+{
+  if (! mp_data) {
+    return false;
+  }
+
+  const unsigned char *ids = mp_data + header_size + m_count * entry_size;
+
+  //  binary search on the ID table
+  uint64_t lo = 0, hi = m_id_count;
+  while (lo < hi) {
+
+    uint64_t mid = lo + (hi - lo) / 2;
+    uint64_t index = get_u64 (ids + mid * 8);
+    unsigned long eid = (unsigned long) get_u64 (mp_data + header_size + index * entry_size + 16);
+
+    if (eid == id) {
+      get_entry (index, entry);
+      return true;
+    } else if (eid < id) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+
+  }
+
+  return false;
+}
+
+bool
+CellIndex::find_before (uint64_t offset, CellIndexEntry &entry) const
+{
+  if (! mp_data) {
+    return false;
+  }
+
+  //  the entries are not sorted by offset, but a linear scan is cheap compared to parsing
+  bool found = false;
+  uint64_t best = 0, best_offset = 0;
+  for (uint64_t i = 0; i < m_count; ++i) {
+    uint64_t o = get_u64 (mp_data + header_size + i * entry_size + 24);
+    if (o <= offset && (! found || o > best_offset)) {
+      found = true;
+      best = i;
+      best_offset = o;
+    }
+  }
+
+  if (found) {
+    get_entry (best, entry);
+  }
+  return found;
+}
+
+}
@@ -0,0 +1,149 @@
+/*
+
+  KLayout Layout Viewer
+  Copyright (C) 2013-2018 Matthias Koefferlein
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+
+
+#ifndef HDR_dbCellIndex
+#define HDR_dbCellIndex
+
+#include "tlException.h"
+#include "tlStream.h"
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace db
+{
+
+/**
+ *  @brief An entry of the cell index
+ *
+ *  "offset" is the position of the record which starts the cell (the CELL record
+ *  for OASIS, BGNSTR for GDS2). For OASIS cells inside a CBLOCK, "offset" is the
+ *  position of the CBLOCK record and "inner_offset" is the position of the CELL
+ *  record inside the uncompressed CBLOCK data.
+ */
+struct KLAYOUT_DLL CellIndexEntry
+{
+  CellIndexEntry ()
+    : has_id (false), id (0), offset (0), in_cblock (false), inner_offset (0)
+  { }
+
+  std::string name;
+  bool has_id;
+  unsigned long id;
+  uint64_t offset;
+  bool in_cblock;
+  uint64_t inner_offset;
+};
+
+/**
+ *  @brief A persistent index of cell positions
+ *
+ *  The index is kept in a sidecar file next to the layout file (see "sidecar_path").
+ *  The sidecar file carries the size and modification time of the layout file and
+ *  is only used if both still match. It is memory-mapped and looked up in place:
+ *
+ *    header:    "CELLIDX1", file size, file mtime, entry count (64 bit each)
+ *    entries:   sorted by name, 40 bytes each: name offset (64 bit), name length (32 bit),
+ *               flags (32 bit, 1: has ID, 2: in CBLOCK), ID, offset, inner offset (64 bit each)
+ *    ID table:  entry indexes sorted by ID (64 bit each, entries with ID only)
+ *    names:     the name strings
+ *
+ *  All numbers are stored little-endian.
+ */
+class KLAYOUT_DLL CellIndex
+{
+public:
+  /**
+   *  @brief Creates an empty index
+   */
+  CellIndex ();
+
+  /**
+   *  @brief Destructor
+   */
+  ~CellIndex ();
+
+  /**
+   *  @brief Gets the path of the sidecar file for the given layout file
+   */
+  static std::string sidecar_path (const std::string &path);
+
+  /**
+   *  @brief Adds an entry while building an index
+   */
+  void add (const CellIndexEntry &entry)
+  {
+    m_entries.push_back (entry);
+  }
+
+  /**
+   *  @brief Gets the number of entries
+   */
+  size_t size () const;
+
+  /**
+   *  @brief Writes the entries added into the sidecar file of the given layout file
+   */
+  void write (const std::string &path);
+
+  /**
+   *  @brief Loads the sidecar file of the given layout file
+   *
+   *  Returns false if there is no sidecar file or if it does not match the
+   *  layout file any longer.
+   */
+  bool load (const std::string &path);
+
+  /**
+   *  @brief Looks up a cell by name
+   */
+  bool find (const std::string &name, CellIndexEntry &entry) const;
+
+  /**
+   *  @brief Looks up a cell by OASIS CELLNAME ID
+   */
+  bool find_id (unsigned long id, CellIndexEntry &entry) const;
+
+  /**
+   *  @brief Finds the cell starting last at or before the given file offset
+   */
+  bool find_before (uint64_t offset, CellIndexEntry &entry) const;
+
+private:
+  std::vector<CellIndexEntry> m_entries;
+  tl::InputMappedFile *mp_file;
+  const unsigned char *mp_data;
+  uint64_t m_count, m_id_count;
+
+  CellIndex (const CellIndex &);
+  CellIndex &operator= (const CellIndex &);
+
+  void get_entry (uint64_t index, CellIndexEntry &entry) const;
+  void release ();
+};
+
+}
+
+#endif
+
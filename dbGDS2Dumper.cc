@@ -22,12 +22,21 @@
 
 
 #include "dbGDS2Dumper.h"
+#include "dbHierarchyGraph.h"
 
 #include "tlException.h"
 #include "tlString.h"
+#include "tlThreads.h"
 
 #include <limits>
 #include <iostream>
+#include <memory>
+#include <algorithm>
+#include <string.h>
+
+#if defined(__SSSE3__)
+#  include <tmmintrin.h>
+#endif
 
 namespace db
 {
@@ -66,11 +75,58 @@ inline void gds2h (int32_t &i)
 #endif
 }
 
+/**
+ *  @brief Converts a block of n big-endian 32 bit integers into host order
+ *
+ *  With SSSE3, four values are swapped per byte shuffle. Otherwise, the plain
+ *  loop is simple enough to be vectorized by the compiler.
+ */
+static void gds2h_block (int32_t *dst, const char *src, size_t n)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_BIG_ENDIAN__
+  memcpy (dst, src, n * sizeof (int32_t));
+#else
+  size_t i = 0;
+#if defined(__SSSE3__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+  const __m128i swap = _mm_set_epi8 (12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  for ( ; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128 ((const __m128i *) (src + i * 4));
+    _mm_storeu_si128 ((__m128i *) (dst + i), _mm_shuffle_epi8 (v, swap));
+  }
+#endif
+  const unsigned char *b = (const unsigned char *) src;
+  for ( ; i < n; ++i) {
+    dst [i] = int32_t ((uint32_t (b [i * 4]) << 24) | (uint32_t (b [i * 4 + 1]) << 16) | (uint32_t (b [i * 4 + 2]) << 8) | uint32_t (b [i * 4 + 3]));
+  }
+#endif
+}
+
+/**
+ *  @brief Appends the decimal representation of an integer to a string
+ */
+static void append_int (std::string &s, int32_t v)
+{
+  char digits [12];
+  char *d = digits + sizeof (digits);
+
+  uint32_t u = v < 0 ? uint32_t (0) - uint32_t (v) : uint32_t (v);
+  do {
+    *--d = char ('0' + u % 10);
+    u /= 10;
+  } while (u > 0);
+  if (v < 0) {
+    *--d = '-';
+  }
+
+  s.append (d, digits + sizeof (digits) - d);
+}
+
 // ---------------------------------------------------------------
 //  GDS2Dumper
 
 GDS2Dumper::GDS2Dumper (tl::InputStreamBase &s)
-  : m_stream (s), m_last_emit (0), m_width (8), m_short_mode (false)
+  : mp_source (&s), m_stream (s), m_last_emit (0), mp_output (0), m_select (false), mp_index (0), m_hold (false),
+    m_range (false), m_range_from (0), m_range_to (0), m_threads (1), m_quiet (false)
 {
   m_stream.start_recording ();
 }
@@ -90,6 +146,9 @@ uint32_t
 GDS2Dumper::get_uint32 ()
 {
   unsigned char *b = (unsigned char *) m_stream.get (4);
+  if (! b) {
+    error (tl::translate ("Unexpected end of file"));
+  }
   return (uint32_t (b[0]) << 24) | (uint32_t (b[1]) << 16) | (uint32_t (b[2]) << 8) | uint32_t (b[3]);
 }
 
@@ -172,10 +231,17 @@ GDS2Dumper::error (const std::string &msg)
 }
 
 void 
-GDS2Dumper::warn (const std::string &msg) 
+GDS2Dumper::warn (const std::string &msg, size_t pos) 
 {
+  //  write the pending output first, so the warning shows up at the right place
+  if (mp_output) {
+    mp_output->flush ();
+  } else {
+    std::cout.flush ();
+  }
+
   std::cerr << msg 
-           << tl::translate (" (position=") << m_stream.pos ()
+           << tl::translate (" (position=") << pos
            << ")"
            << std::endl;
 }
@@ -186,45 +252,24 @@ GDS2Dumper::emit (const std::string &msg)
   size_t last_pos = m_last_emit;
   m_last_emit = m_stream.pos ();
 
-  const char *r = m_stream.recorded ();
-  std::cout << tl::sprintf ("%09d   ", last_pos);
-  for (size_t i = 0; i < m_width; ++i) {
-    if (last_pos + i < m_last_emit) {
-      char c = *r++;
-      std::cout << tl::sprintf ("%02x ", int ((unsigned char) c));
-    } else {
-      std::cout << "   ";
-    }
-  }
+  m_formatter.clear ();
+  m_formatter.format (last_pos, m_stream.recorded (), m_last_emit - last_pos, msg);
 
   m_stream.reset_recording ();
 
-  std::cout << " " << msg << std::endl;
-
-  last_pos += m_width;
-  while (last_pos < m_last_emit) {
-
-    std::cout << tl::sprintf ("%09d + ", last_pos);
-    if (m_short_mode) {
-
-      std::cout << "..." << std::endl;
-      break;
-
-    } else {
-
-      for (size_t i = 0; i < m_width; ++i) {
-        if (last_pos + i < m_last_emit) {
-          char c = *r++;
-          std::cout << tl::sprintf ("%02x ", int ((unsigned char) c));
-        } else {
-          break;
-        }
-      }
-
-      last_pos += m_width;
-      std::cout << std::endl;
+  write (m_formatter.data (), m_formatter.size ());
+}
 
-    }
+void
+GDS2Dumper::write (const char *data, size_t n)
+{
+  if (m_hold) {
+    //  output is held back until it is clear whether it is needed
+    m_pending.append (data, n);
+  } else if (mp_output) {
+    mp_output->put (data, n);
+  } else {
+    std::cout.write (data, n);
   }
 }
 
@@ -293,10 +338,157 @@ static RecordDefinition s_record_defs[] = {
   { 0x3a, 0x06, "SRFNAME", &GDS2Dumper::generic }
 };
 
+/**
+ *  @brief A lookup table for the record definitions by record type
+ */
+struct RecordDefinitionTable
+{
+  RecordDefinitionTable ()
+  {
+    for (size_t i = 0; i < sizeof (defs) / sizeof (defs[0]); ++i) {
+      defs [i] = 0;
+    }
+    for (size_t i = 0; i < sizeof (s_record_defs) / sizeof (s_record_defs[0]); ++i) {
+      defs [s_record_defs [i].type] = s_record_defs + i;
+    }
+  }
+
+  const RecordDefinition *defs [256];
+};
+
+static const RecordDefinition *find_record_def (uint8_t type)
+{
+  static const RecordDefinitionTable table;
+  return table.defs [type];
+}
+
 static const std::string s_indent = "  ";
 
+/**
+ *  @brief The size of a structure for the statistics
+ */
+struct StructureStatistics
+{
+  StructureStatistics () : bytes (0), records (0) { }
+
+  std::string name;
+  size_t bytes;
+  size_t records;
+};
+
+static bool larger_structure (const StructureStatistics *a, const StructureStatistics *b)
+{
+  return a->bytes > b->bytes;
+}
+
+/**
+ *  @brief The element record types counted by the structure scan
+ */
+static const uint8_t s_element_types [] = { 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x2d, 0x15 };
+static const char *s_element_names [] = { "boundary", "path", "sref", "aref", "text", "box", "node" };
+static const size_t s_num_element_types = sizeof (s_element_types) / sizeof (s_element_types [0]);
+
+/**
+ *  @brief The summary of one structure for the structure scan
+ */
+struct StructureScan
+{
+  StructureScan () : offset (0), bytes (0), records (0)
+  {
+    for (size_t i = 0; i < s_num_element_types; ++i) {
+      elements [i] = 0;
+    }
+  }
+
+  std::string name;
+  size_t offset;
+  size_t bytes;
+  size_t records;
+  size_t elements [s_num_element_types];
+  std::set<std::string> children;
+};
+
+/**
+ *  @brief A bit for the given record type in a record set
+ *
+ *  All record types are less than 64, so a record set is a 64 bit mask.
+ */
+inline uint64_t record_bit (uint8_t type)
+{
+  return uint64_t (1) << type;
+}
+
+/**
+ *  @brief The grammar rules for an element type
+ *
+ *  "allowed" are the records which may appear once in the element body, "required"
+ *  the records which must be present. The XY record must have between "min_points"
+ *  and "max_points" points and must be closed if "closed" is true.
+ */
+struct ElementRule
+{
+  uint8_t type;
+  uint64_t allowed;
+  uint64_t required;
+  unsigned int min_points, max_points;
+  bool closed;
+};
+
+static const uint64_t s_common_bits = record_bit (0x26 /*ELFLAGS*/) | record_bit (0x2f /*PLEX*/);
+static const uint64_t s_strans_bits = record_bit (0x1a /*STRANS*/) | record_bit (0x1b /*MAG*/) | record_bit (0x1c /*ANGLE*/);
+
+static const ElementRule s_element_rules [] = {
+  { 0x08 /*BOUNDARY*/,
+    s_common_bits | record_bit (0x0d) | record_bit (0x0e) | record_bit (0x10),
+    record_bit (0x0d /*LAYER*/) | record_bit (0x0e /*DATATYPE*/) | record_bit (0x10 /*XY*/),
+    4, 8191, true },
+  { 0x09 /*PATH*/,
+    s_common_bits | record_bit (0x0d) | record_bit (0x0e) | record_bit (0x21 /*PATHTYPE*/) | record_bit (0x0f /*WIDTH*/) | record_bit (0x30 /*BGNEXTN*/) | record_bit (0x31 /*ENDEXTN*/) | record_bit (0x10),
+    record_bit (0x0d /*LAYER*/) | record_bit (0x0e /*DATATYPE*/) | record_bit (0x10 /*XY*/),
+    2, 8191, false },
+  { 0x0a /*SREF*/,
+    s_common_bits | record_bit (0x12) | s_strans_bits | record_bit (0x10),
+    record_bit (0x12 /*SNAME*/) | record_bit (0x10 /*XY*/),
+    1, 1, false },
+  { 0x0b /*AREF*/,
+    s_common_bits | record_bit (0x12) | s_strans_bits | record_bit (0x13) | record_bit (0x10),
+    record_bit (0x12 /*SNAME*/) | record_bit (0x13 /*COLROW*/) | record_bit (0x10 /*XY*/),
+    3, 3, false },
+  { 0x0c /*TEXT*/,
+    s_common_bits | record_bit (0x0d) | record_bit (0x16) | record_bit (0x17 /*PRESENTATION*/) | record_bit (0x21 /*PATHTYPE*/) | record_bit (0x0f /*WIDTH*/) | s_strans_bits | record_bit (0x10) | record_bit (0x19),
+    record_bit (0x0d /*LAYER*/) | record_bit (0x16 /*TEXTTYPE*/) | record_bit (0x10 /*XY*/) | record_bit (0x19 /*STRING*/),
+    1, 1, false },
+  { 0x15 /*NODE*/,
+    s_common_bits | record_bit (0x0d) | record_bit (0x2a) | record_bit (0x10),
+    record_bit (0x0d /*LAYER*/) | record_bit (0x2a /*NODETYPE*/) | record_bit (0x10 /*XY*/),
+    1, 50, false },
+  { 0x2d /*BOX*/,
+    s_common_bits | record_bit (0x0d) | record_bit (0x2e) | record_bit (0x10),
+    record_bit (0x0d /*LAYER*/) | record_bit (0x2e /*BOXTYPE*/) | record_bit (0x10 /*XY*/),
+    5, 5, true }
+};
+
+static const ElementRule *find_element_rule (uint8_t type)
+{
+  for (size_t i = 0; i < sizeof (s_element_rules) / sizeof (s_element_rules [0]); ++i) {
+    if (s_element_rules [i].type == type) {
+      return s_element_rules + i;
+    }
+  }
+  return 0;
+}
+
+/**
+ *  @brief The records allowed between BGNLIB and UNITS
+ */
+static const uint64_t s_library_header_bits =
+  record_bit (0x39 /*LIBDIRSIZE*/) | record_bit (0x3a /*SRFNAME*/) | record_bit (0x02 /*LIBNAME*/) |
+  record_bit (0x1f /*REFLIBS*/) | record_bit (0x20 /*FONTS*/) | record_bit (0x23 /*ATTRTABLE*/) |
+  record_bit (0x22 /*GENERATIONS*/) | record_bit (0x36 /*FORMAT*/) | record_bit (0x37 /*MASK*/) |
+  record_bit (0x38 /*ENDMASKS*/) | record_bit (0x03 /*UNITS*/);
+
 void
-GDS2Dumper::header (const RecordDefinition *record_def, uint16_t len)
+GDS2Dumper::header (const RecordDefinition * /*record_def*/, uint16_t len)
 {
   while (len > 0) {
     emit (s_indent + tl::sprintf ("%d", get_int16 ()));
@@ -305,7 +497,7 @@ GDS2Dumper::header (const RecordDefinition *record_def, uint16_t len)
 }
 
 void
-GDS2Dumper::layer (const RecordDefinition *record_def, uint16_t len)
+GDS2Dumper::layer (const RecordDefinition * /*record_def*/, uint16_t len)
 {
   if (len != 2) {
     error (tl::translate ("There must be one layer number only"));
@@ -319,7 +511,7 @@ GDS2Dumper::layer (const RecordDefinition *record_def, uint16_t len)
 }
 
 void
-GDS2Dumper::datatype (const RecordDefinition *record_def, uint16_t len)
+GDS2Dumper::datatype (const RecordDefinition * /*record_def*/, uint16_t len)
 {
   if (len != 2) {
     error (tl::translate ("There must be one datatype number only"));
@@ -351,14 +543,60 @@ GDS2Dumper::timestamp (const RecordDefinition *record_def, uint16_t len)
 }
 
 void
-GDS2Dumper::xy (const RecordDefinition *record_def, uint16_t len)
+GDS2Dumper::xy (const RecordDefinition * /*record_def*/, uint16_t len)
 {
-  while (len > 0) {
-    int32_t x = get_int32 ();
-    int32_t y = get_int32 ();
-    emit (s_indent + tl::sprintf ("%d,%d", x, y));
-    len -= 8;
+  if ((len % 8) != 0) {
+    error (tl::translate ("Invalid XY record length (not a multiple of 8)"));
+  }
+  if (len == 0) {
+    return;
+  }
+
+  //  the payload is taken in one piece and converted as a whole
+  size_t n = len / 8;
+  const char *data = m_stream.get (len);
+  if (! data) {
+    error (tl::translate ("Unexpected end of file"));
+  }
+
+  m_xy.resize (n * 2);
+  gds2h_block (&m_xy.front (), data, n * 2);
+
+  if (m_formatter.short_mode () && n > 1) {
+
+    //  in short mode, long point lists are summarized
+    int32_t xmin = m_xy [0], ymin = m_xy [1], xmax = m_xy [0], ymax = m_xy [1];
+    for (size_t i = 1; i < n; ++i) {
+      int32_t x = m_xy [i * 2], y = m_xy [i * 2 + 1];
+      xmin = std::min (xmin, x);
+      xmax = std::max (xmax, x);
+      ymin = std::min (ymin, y);
+      ymax = std::max (ymax, y);
+    }
+
+    bool closed = (m_xy [0] == m_xy [n * 2 - 2] && m_xy [1] == m_xy [n * 2 - 1]);
+    emit (s_indent + tl::sprintf ("%lu points, bbox=(%d,%d;%d,%d), %s", n, xmin, ymin, xmax, ymax, closed ? "closed" : "open"));
+    return;
+
+  }
+
+  //  one line per point, formatted into one buffer
+  size_t pos = m_last_emit;
+  m_last_emit = m_stream.pos ();
+  m_stream.reset_recording ();
+
+  m_formatter.clear ();
+
+  std::string msg;
+  for (size_t i = 0; i < n; ++i) {
+    msg = s_indent;
+    append_int (msg, m_xy [i * 2]);
+    msg += ',';
+    append_int (msg, m_xy [i * 2 + 1]);
+    m_formatter.format (pos + i * 8, data + i * 8, 8, msg);
   }
+
+  write (m_formatter.data (), m_formatter.size ());
 }
 
 void
@@ -433,47 +671,998 @@ GDS2Dumper::generic (const RecordDefinition *record_def, uint16_t len)
   }
 }
 
+const RecordDefinition *
+GDS2Dumper::read_record (uint16_t &len)
+{
+  if (! m_stream.get (2)) {
+    return 0;
+  }
+
+  m_stream.unget (2);
+
+  len = get_uint16 ();
+  if (len >= 0x8000) {
+    warn (tl::translate ("Record length treated as unsigned int"));
+  }
+  if (len < 4) {
+    error (tl::translate ("Invalid record length less than 4"));
+  }
+  if ((len % 2) == 1) {
+    error (tl::translate ("Invalid odd record length"));
+  }
+
+  uint8_t type = get_uint8 ();
+  uint8_t datatype = get_uint8 ();
+
+  const RecordDefinition *record_def = find_record_def (type);
+  if (! record_def) {
+    error (tl::sprintf (tl::translate ("Invalid record type 0x%02x"), type));
+  }
+  if (record_def->datatype != datatype) {
+    error (tl::sprintf (tl::translate ("Invalid type code 0x%02x for record 0x%02x"), datatype, type));
+  }
+
+  return record_def;
+}
+
+void
+GDS2Dumper::skip (uint16_t len)
+{
+  if (len > 4 && ! m_stream.get (len - 4)) {
+    error (tl::translate ("Unexpected end of file"));
+  }
+}
+
 void 
 GDS2Dumper::dump ()
 {
+  if (m_select) {
+
+    //  jump to the structure if the index knows it
+    CellIndexEntry entry;
+    if (mp_index && m_stream.supports_seek () && mp_index->find (m_select_name, entry)) {
+      m_stream.seek (size_t (entry.offset));
+      if (dump_selected_cell (true)) {
+        return;
+      }
+      m_stream.seek (0);
+    }
+
+    if (! dump_selected_cell (false)) {
+      error (tl::sprintf (tl::translate ("Structure not found: %s"), m_select_name));
+    }
+
+    return;
+
+  }
+
+  if (m_range) {
+    dump_byte_range ();
+    return;
+  }
+
+  if (m_threads > 1 && mp_source->mapped_data ()) {
+    dump_parallel ();
+    return;
+  }
+
   //  read next record
-  while (m_stream.get (2)) {
+  uint16_t len = 0;
+  const RecordDefinition *record_def;
+  while ((record_def = read_record (len)) != 0) {
+    emit (record_def->record_name);
+    (this->*(record_def->dump)) (record_def, len - 4);
+  }
+}
+
+void
+GDS2Dumper::dump_range (size_t from, size_t to)
+{
+  m_stream.seek (from);
+  m_last_emit = from;
+  m_stream.reset_recording ();
+
+  dump_records (to);
+}
+
+void
+GDS2Dumper::dump_records (size_t to)
+{
+  uint16_t len = 0;
+  const RecordDefinition *record_def;
+  while (m_stream.pos () < to && (record_def = read_record (len)) != 0) {
+    emit (record_def->record_name);
+    (this->*(record_def->dump)) (record_def, len - 4);
+  }
+}
+
+/**
+ *  @brief Finds the end of a chunk of records for the parallel dump
+ *
+ *  Starting from the record at "pos", the record headers are followed up to the first
+ *  record at or after "pos + min_size". If an invalid record length is found, the chunk
+ *  extends to the end of the data, so the error is reported by the dumper.
+ */
+static size_t next_chunk_end (const char *data, size_t size, size_t pos, size_t min_size)
+{
+  size_t end = (size - pos > min_size) ? pos + min_size : size;
+
+  while (pos < end) {
+    if (size - pos < 4) {
+      return size;
+    }
+    size_t len = (size_t ((unsigned char) data [pos]) << 8) | size_t ((unsigned char) data [pos + 1]);
+    if (len < 4 || (len % 2) == 1) {
+      return size;
+    }
+    pos += len;
+  }
+
+  return std::min (pos, size);
+}
+
+/**
+ *  @brief An output delegate collecting the output in a string
+ */
+class GDS2DumpBuffer
+  : public tl::OutputStreamBase
+{
+public:
+  virtual void write (const char *b, size_t n)
+  {
+    m_data.append (b, n);
+  }
+
+  const std::string &data () const
+  {
+    return m_data;
+  }
+
+private:
+  std::string m_data;
+};
+
+/**
+ *  @brief A warning issued while dumping a chunk of the file
+ *
+ *  "output_pos" is the output position where the warning is reported.
+ */
+struct GDS2DumpWarning
+{
+  size_t output_pos;
+  std::string msg;
+  size_t pos;
+};
+
+/**
+ *  @brief A dumper formatting a chunk of the file into a buffer
+ *
+ *  Warnings are collected, so they can be reported at the same place as in
+ *  the serial dump.
+ */
+class GDS2PartDumper
+  : public GDS2Dumper
+{
+public:
+  GDS2PartDumper (tl::InputStreamBase &s)
+    : GDS2Dumper (s), m_out (m_buffer)
+  {
+    set_output (&m_out);
+  }
+
+  virtual void warn (const std::string &msg, size_t pos)
+  {
+    m_warnings.push_back (GDS2DumpWarning ());
+    m_warnings.back ().output_pos = m_out.pos ();
+    m_warnings.back ().msg = msg;
+    m_warnings.back ().pos = pos;
+  }
+
+  const std::string &data () const
+  {
+    return m_buffer.data ();
+  }
+
+  const std::vector<GDS2DumpWarning> &warnings () const
+  {
+    return m_warnings;
+  }
+
+private:
+  GDS2DumpBuffer m_buffer;
+  tl::OutputStream m_out;
+  std::vector<GDS2DumpWarning> m_warnings;
+};
+
+/**
+ *  @brief A job dumping a chunk of records
+ */
+class GDS2DumpJob
+  : public tl::Job
+{
+public:
+  GDS2DumpJob (const char *data, size_t size, size_t from, size_t to, const tl::HexDumpFormatter &formatter)
+    : m_mem (data, size), m_dumper (m_mem), m_from (from), m_to (to)
+  {
+    m_dumper.short_mode (formatter.short_mode ());
+    m_dumper.set_width (formatter.width ());
+  }
+
+  virtual void run ()
+  {
+    m_dumper.dump_range (m_from, m_to);
+  }
+
+  const GDS2PartDumper &dumper () const
+  {
+    return m_dumper;
+  }
+
+private:
+  tl::InputMemoryStream m_mem;
+  GDS2PartDumper m_dumper;
+  size_t m_from, m_to;
+};
+
+void
+GDS2Dumper::dump_parallel ()
+{
+  const char *data = mp_source->mapped_data ();
+  size_t size = mp_source->mapped_size ();
+
+  //  the chunks are cut while the jobs are submitted
+  const size_t min_chunk_size = 1024 * 1024;
+
+  tl::ThreadPool pool (m_threads);
+
+  size_t max_pending = 2 * size_t (m_threads);
+  size_t pos = 0;
+
+  while (pos < size || pool.pending () > 0) {
+
+    //  keep the pool busy, but limit the memory for the pending output
+    if (pos < size && pool.pending () < max_pending) {
+      size_t end = next_chunk_end (data, size, pos, min_chunk_size);
+      pool.submit (new GDS2DumpJob (data, size, pos, end, m_formatter));
+      pos = end;
+      continue;
+    }
+
+    std::unique_ptr<GDS2DumpJob> job (dynamic_cast<GDS2DumpJob *> (pool.wait_next ()));
+    if (! job.get ()) {
+      break;
+    }
+
+    const std::string &out = job->dumper ().data ();
+    const std::vector<GDS2DumpWarning> &warnings = job->dumper ().warnings ();
+
+    size_t written = 0;
+    for (std::vector<GDS2DumpWarning>::const_iterator w = warnings.begin (); w != warnings.end (); ++w) {
+      write (out.c_str () + written, w->output_pos - written);
+      written = w->output_pos;
+      GDS2Dumper::warn (w->msg, w->pos);
+    }
+    write (out.c_str () + written, out.size () - written);
+
+    if (job->failed ()) {
+      throw tl::Exception (job->error ());
+    }
+
+  }
+}
+
+void
+GDS2Dumper::dump_byte_range ()
+{
+  uint16_t len = 0;
+  const RecordDefinition *record_def;
+
+  if (m_range_from > 0 && m_stream.supports_seek ()) {
+    m_stream.seek (find_resync_position ());
+  }
+
+  //  read over the records in front of "from" - these are not dumped, so they don't produce warnings
+  m_quiet = true;
+  while (m_stream.pos () < m_range_from && (record_def = read_record (len)) != 0) {
+    skip (len);
+  }
+  m_quiet = false;
 
-    m_stream.unget (2);
+  m_last_emit = m_stream.pos ();
+  m_stream.reset_recording ();
+
+  dump_records (m_range_to);
+}
+
+size_t
+GDS2Dumper::find_resync_position ()
+{
+  //  the cell index provides a safe position
+  CellIndexEntry entry;
+  if (mp_index && mp_index->find_before (m_range_from, entry)) {
+    return size_t (entry.offset);
+  }
+
+  //  A record is less than 64k bytes long, so the record covering "from" and the
+  //  one in front of it start within the 128k bytes in front of "from".
+  //  Records always start at even positions. The candidates are tried from "from"
+  //  downwards. A false start inside a payload may chain up to some position behind
+  //  "from", but not to the same record boundary as a real one. Hence a candidate is
+  //  accepted when its chain lands on the same boundary as the chain of a candidate
+  //  closer to "from". The beginning of the file is always a record boundary.
+  size_t lo = m_range_from > 0x20000 ? m_range_from - 0x20000 : 0;
+
+  std::vector<size_t> landings;
+
+  for (size_t p = m_range_from & ~size_t (1); p >= lo; p -= 2) {
+
+    size_t landing = 0;
+    if (probe_records (p, landing)) {
+      if (p == 0 || std::find (landings.begin (), landings.end (), landing) != landings.end ()) {
+        return landing;
+      }
+      landings.push_back (landing);
+    }
+
+    if (p < 2) {
+      break;
+    }
+
+  }
+
+  error (tl::translate ("Unable to find a valid record sequence near the start position"));
+  return 0;
+}
+
+bool
+GDS2Dumper::probe_records (size_t pos, size_t &landing)
+{
+  //  the number of records confirmed behind the landing position
+  const unsigned int min_records = 16;
+
+  m_stream.seek (pos);
 
-    uint16_t len = get_uint16 ();
-    if (len >= 0x8000) {
-      warn (tl::translate ("Record length treated as unsigned int"));
+  bool landed = false;
+  unsigned int n = 0;
+
+  while (! landed || n < min_records) {
+
+    if (! landed && m_stream.pos () >= m_range_from) {
+      landing = m_stream.pos ();
+      landed = true;
     }
-    if (len < 4) {
-      error (tl::translate ("Invalid record length less than 4"));
+
+    const unsigned char *h = (const unsigned char *) m_stream.get (4);
+    if (! h) {
+      //  a valid sequence may end with the file
+      return landed;
     }
-    if ((len % 2) == 1) {
-      error (tl::translate ("Invalid odd record length"));
+
+    //  the same conditions as in read_record - lengths of 32k and more are valid
+    uint16_t len = (uint16_t (h [0]) << 8) | uint16_t (h [1]);
+    const RecordDefinition *record_def = find_record_def (h [2]);
+    if (len < 4 || (len % 2) == 1 || ! record_def || record_def->datatype != h [3]) {
+      return false;
     }
 
-    uint8_t type = get_uint8 ();
-    uint8_t datatype = get_uint8 ();
+    if (len > 4 && ! m_stream.get (len - 4)) {
+      return false;
+    }
+
+    if (landed) {
+      ++n;
+    }
 
-    const RecordDefinition *record_def = 0;
-    for (size_t i = 0; i < sizeof (s_record_defs) / sizeof (s_record_defs[0]) && !record_def; ++i) {
-      if (s_record_defs[i].type == type) {
-        record_def = s_record_defs + i;
+    if (record_def->type == 0x04 /*ENDLIB*/) {
+      //  the records after ENDLIB are padding
+      if (! landed) {
+        landing = m_stream.pos ();
       }
+      return true;
     }
 
+  }
+
+  return true;
+}
+
+bool
+GDS2Dumper::dump_selected_cell (bool first_only)
+{
+  uint16_t len = 0;
+
+  while (true) {
+
+    size_t start = m_stream.pos ();
+    m_stream.reset_recording ();
+
+    const RecordDefinition *record_def = read_record (len);
     if (! record_def) {
-      error (tl::sprintf (tl::translate ("Invalid record type 0x%02x"), type));
+      return false;
     }
-    if (record_def->datatype != datatype) {
-      error (tl::sprintf (tl::translate ("Invalid type code 0x%02x for record 0x%02x"), datatype, type));
+
+    if (record_def->type != 0x05 /*BGNSTR*/) {
+      if (first_only) {
+        return false;
+      }
+      skip (len);
+      continue;
     }
 
+    //  BGNSTR and STRNAME are held back until the name is known
+    m_last_emit = start;
+    m_hold = true;
+    m_pending.clear ();
+
     emit (record_def->record_name);
     (this->*(record_def->dump)) (record_def, len - 4);
 
+    bool found = false;
+
+    record_def = read_record (len);
+    if (record_def && record_def->type == 0x06 /*STRNAME*/) {
+
+      found = (get_str (len - 4) == m_select_name);
+      if (len > 4) {
+        m_stream.unget (len - 4);
+      }
+
+      emit (record_def->record_name);
+      (this->*(record_def->dump)) (record_def, len - 4);
+
+    } else if (record_def) {
+      skip (len);
+    }
+
+    m_hold = false;
+
+    if (found) {
+
+      write (m_pending.c_str (), m_pending.size ());
+      m_pending.clear ();
+
+      while ((record_def = read_record (len)) != 0) {
+        emit (record_def->record_name);
+        (this->*(record_def->dump)) (record_def, len - 4);
+        if (record_def->type == 0x07 /*ENDSTR*/) {
+          break;
+        }
+      }
+
+      return true;
+
+    }
+
+    m_pending.clear ();
+
+    if (first_only || ! record_def) {
+      return false;
+    }
+
   }
 }
 
+void
+GDS2Dumper::build_index (CellIndex &index)
+{
+  m_stream.stop_recording ();
+
+  uint16_t len = 0;
+  size_t bgnstr_pos = 0;
+  bool after_bgnstr = false;
+
+  while (true) {
+
+    size_t start = m_stream.pos ();
+
+    const RecordDefinition *record_def = read_record (len);
+    if (! record_def) {
+      break;
+    }
+
+    if (record_def->type == 0x06 /*STRNAME*/ && after_bgnstr) {
+      CellIndexEntry entry;
+      entry.name = get_str (len - 4);
+      entry.offset = bgnstr_pos;
+      index.add (entry);
+    } else {
+      skip (len);
+    }
+
+    after_bgnstr = (record_def->type == 0x05 /*BGNSTR*/);
+    if (after_bgnstr) {
+      bgnstr_pos = start;
+    }
+
+  }
 }
 
+void
+GDS2Dumper::dump_statistics ()
+{
+  m_stream.stop_recording ();
+
+  const size_t num_record_defs = sizeof (s_record_defs) / sizeof (s_record_defs[0]);
+  std::vector<size_t> counts (num_record_defs, 0), bytes (num_record_defs, 0);
+
+  std::vector<StructureStatistics> structures;
+  bool in_structure = false;
+  bool after_bgnstr = false;
+
+  uint16_t len = 0;
+
+  while (true) {
+
+    const RecordDefinition *record_def = read_record (len);
+    if (! record_def) {
+      break;
+    }
+
+    size_t i = record_def - s_record_defs;
+    counts [i] += 1;
+    bytes [i] += len;
+
+    if (record_def->type == 0x05 /*BGNSTR*/) {
+      in_structure = true;
+      structures.push_back (StructureStatistics ());
+    }
+
+    if (in_structure) {
+      structures.back ().bytes += len;
+      structures.back ().records += 1;
+    }
+
+    if (record_def->type == 0x06 /*STRNAME*/ && after_bgnstr) {
+      structures.back ().name = get_str (len - 4);
+    } else {
+      skip (len);
+    }
+
+    after_bgnstr = (record_def->type == 0x05 /*BGNSTR*/);
+    if (record_def->type == 0x07 /*ENDSTR*/) {
+      in_structure = false;
+    }
+
+  }
+
+  std::string out;
+
+  size_t total_count = 0, total_bytes = 0;
+
+  out += tl::sprintf ("%-4s %-12s %12s %14s\n", "type", "record", "count", "bytes");
+  for (size_t i = 0; i < num_record_defs; ++i) {
+    if (counts [i] > 0) {
+      out += tl::sprintf ("0x%02x %-12s %12lu %14lu\n", s_record_defs [i].type, s_record_defs [i].record_name, counts [i], bytes [i]);
+      total_count += counts [i];
+      total_bytes += bytes [i];
+    }
+  }
+  out += tl::sprintf ("%-17s %12lu %14lu\n", "total", total_count, total_bytes);
+  out += "\n";
+
+  out += tl::sprintf ("file size: %lu\n", m_stream.pos ());
+  out += "\n";
+
+  //  largest structures first
+  std::vector<const StructureStatistics *> sorted;
+  sorted.reserve (structures.size ());
+  for (std::vector<StructureStatistics>::const_iterator s = structures.begin (); s != structures.end (); ++s) {
+    sorted.push_back (&*s);
+  }
+  std::stable_sort (sorted.begin (), sorted.end (), &larger_structure);
+
+  out += tl::sprintf ("%14s %12s  %s\n", "bytes", "records", "structure");
+  for (std::vector<const StructureStatistics *>::const_iterator s = sorted.begin (); s != sorted.end (); ++s) {
+    out += tl::sprintf ("%14lu %12lu  %s\n", (*s)->bytes, (*s)->records, (*s)->name);
+  }
+
+  write (out.c_str (), out.size ());
+}
+
+void
+GDS2Dumper::scan_structures ()
+{
+  m_stream.stop_recording ();
+
+  //  maps a record type to the element column
+  int element_column [256];
+  for (size_t i = 0; i < sizeof (element_column) / sizeof (element_column [0]); ++i) {
+    element_column [i] = -1;
+  }
+  for (size_t i = 0; i < s_num_element_types; ++i) {
+    element_column [s_element_types [i]] = int (i);
+  }
+
+  std::string out;
+
+  out += tl::sprintf ("%14s %14s %12s", "offset", "bytes", "records");
+  for (size_t i = 0; i < s_num_element_types; ++i) {
+    out += tl::sprintf (" %10s", s_element_names [i]);
+  }
+  out += tl::sprintf (" %10s  %s\n", "children", "structure");
+  write (out.c_str (), out.size ());
+
+  StructureScan total;
+  size_t structures = 0;
+
+  StructureScan current;
+  bool in_structure = false;
+  bool after_bgnstr = false;
+
+  uint16_t len = 0;
+
+  while (true) {
+
+    size_t start = m_stream.pos ();
+
+    const RecordDefinition *record_def = read_record (len);
+    if (! record_def) {
+      break;
+    }
+
+    uint8_t type = record_def->type;
+
+    if (type == 0x05 /*BGNSTR*/) {
+      current = StructureScan ();
+      current.offset = start;
+      in_structure = true;
+    }
+
+    if (! in_structure) {
+      skip (len);
+      continue;
+    }
+
+    current.bytes += len;
+    current.records += 1;
+
+    int column = element_column [type];
+    if (column >= 0) {
+      current.elements [column] += 1;
+    }
+
+    //  only the names are decoded - everything else is skipped over
+    if (type == 0x06 /*STRNAME*/ && after_bgnstr) {
+      current.name = get_str (len - 4);
+    } else if (type == 0x12 /*SNAME*/) {
+      current.children.insert (get_str (len - 4));
+    } else {
+      skip (len);
+    }
+
+    after_bgnstr = (type == 0x05 /*BGNSTR*/);
+
+    if (type == 0x07 /*ENDSTR*/) {
+
+      in_structure = false;
+
+      out = tl::sprintf ("%14lu %14lu %12lu", current.offset, current.bytes, current.records);
+      for (size_t i = 0; i < s_num_element_types; ++i) {
+        out += tl::sprintf (" %10lu", current.elements [i]);
+        total.elements [i] += current.elements [i];
+      }
+      out += tl::sprintf (" %10lu  %s\n", current.children.size (), current.name);
+      write (out.c_str (), out.size ());
+
+      ++structures;
+      total.bytes += current.bytes;
+      total.records += current.records;
+
+    }
+
+  }
+
+  out = tl::sprintf ("%14s %14lu %12lu", "total", total.bytes, total.records);
+  for (size_t i = 0; i < s_num_element_types; ++i) {
+    out += tl::sprintf (" %10lu", total.elements [i]);
+  }
+  out += tl::sprintf (" %10s  %lu structures\n", "", structures);
+  out += "\n";
+  out += tl::sprintf ("file size: %lu\n", m_stream.pos ());
+  write (out.c_str (), out.size ());
+}
+
+void
+GDS2Dumper::check_error (const std::string &msg, size_t pos, const std::string &structure)
+{
+  throw GDS2DumperException (msg, pos, structure.empty () ? std::string ("UNKNOWN_CELL") : structure);
+}
+
+void
+GDS2Dumper::check ()
+{
+  m_stream.stop_recording ();
+
+  enum State {
+    ExpectHeader,     //  at the beginning
+    ExpectBgnlib,     //  after HEADER
+    LibraryHeader,    //  after BGNLIB, up to UNITS
+    Library,          //  between structures
+    ExpectStrname,    //  after BGNSTR
+    Structure,        //  inside a structure, between elements
+    Element,          //  inside an element
+    Done              //  after ENDLIB
+  };
+
+  State state = ExpectHeader;
+
+  std::string structure;
+  bool after_strname = false;
+  const ElementRule *element = 0;
+  uint64_t seen = 0;
+  bool pending_propattr = false;
+
+  uint16_t len = 0;
+
+  while (state != Done) {
+
+    size_t start = m_stream.pos ();
+
+    const RecordDefinition *record_def = read_record (len);
+    if (! record_def) {
+      check_error (tl::translate ("Unexpected end of file (ENDLIB missing)"), start, structure);
+    }
+
+    uint8_t type = record_def->type;
+    const char *name = record_def->record_name;
+
+    switch (state) {
+
+    case ExpectHeader:
+      if (type != 0x00 /*HEADER*/) {
+        check_error (tl::sprintf (tl::translate ("HEADER record expected, got %s"), name), start, structure);
+      }
+      state = ExpectBgnlib;
+      break;
+
+    case ExpectBgnlib:
+      if (type != 0x01 /*BGNLIB*/) {
+        check_error (tl::sprintf (tl::translate ("BGNLIB record expected, got %s"), name), start, structure);
+      }
+      state = LibraryHeader;
+      seen = 0;
+      break;
+
+    case LibraryHeader:
+      if ((s_library_header_bits & record_bit (type)) == 0) {
+        check_error (tl::sprintf (tl::translate ("%s record not allowed in the library header"), name), start, structure);
+      }
+      if (type != 0x37 /*MASK*/ && (seen & record_bit (type)) != 0) {
+        check_error (tl::sprintf (tl::translate ("Duplicate %s record in the library header"), name), start, structure);
+      }
+      if (type == 0x37 /*MASK*/ && (seen & record_bit (0x36 /*FORMAT*/)) == 0) {
+        check_error (tl::translate ("MASK record without FORMAT"), start, structure);
+      }
+      if (type == 0x38 /*ENDMASKS*/ && (seen & record_bit (0x37 /*MASK*/)) == 0) {
+        check_error (tl::translate ("ENDMASKS record without MASK"), start, structure);
+      }
+      if (type == 0x03 /*UNITS*/) {
+        if ((seen & record_bit (0x02 /*LIBNAME*/)) == 0) {
+          check_error (tl::translate ("LIBNAME record missing before UNITS"), start, structure);
+        }
+        state = Library;
+      }
+      seen |= record_bit (type);
+      break;
+
+    case Library:
+      if (type == 0x05 /*BGNSTR*/) {
+        state = ExpectStrname;
+      } else if (type == 0x04 /*ENDLIB*/) {
+        state = Done;
+      } else {
+        check_error (tl::sprintf (tl::translate ("%s record outside a structure"), name), start, structure);
+      }
+      break;
+
+    case ExpectStrname:
+      if (type != 0x06 /*STRNAME*/) {
+        check_error (tl::sprintf (tl::translate ("STRNAME record expected, got %s"), name), start, structure);
+      }
+      structure = get_str (len - 4);
+      state = Structure;
+      after_strname = true;
+      len = 4;
+      break;
+
+    case Structure:
+      if (type == 0x07 /*ENDSTR*/) {
+        structure.clear ();
+        state = Library;
+      } else if (type == 0x34 /*STRCLASS*/ && after_strname) {
+        //  STRCLASS may follow STRNAME
+      } else if ((element = find_element_rule (type)) != 0) {
+        state = Element;
+        seen = 0;
+        pending_propattr = false;
+      } else {
+        check_error (tl::sprintf (tl::translate ("%s record outside an element"), name), start, structure);
+      }
+      after_strname = false;
+      break;
+
+    case Element:
+
+      if (type == 0x11 /*ENDEL*/) {
+
+        if ((seen & element->required) != element->required) {
+          uint64_t missing = element->required & ~seen;
+          for (uint8_t t = 0; t < 64; ++t) {
+            if ((missing & record_bit (t)) != 0) {
+              check_error (tl::sprintf (tl::translate ("%s record missing in %s element"), find_record_def (t)->record_name, find_record_def (element->type)->record_name), start, structure);
+            }
+          }
+        }
+        if (pending_propattr) {
+          check_error (tl::translate ("PROPATTR record without PROPVALUE"), start, structure);
+        }
+        state = Structure;
+
+      } else if (type == 0x2b /*PROPATTR*/ || type == 0x2c /*PROPVALUE*/) {
+
+        //  properties follow the element body
+        if ((seen & element->required) != element->required) {
+          check_error (tl::sprintf (tl::translate ("%s record before the end of the element body"), name), start, structure);
+        }
+        if ((type == 0x2c) != pending_propattr) {
+          check_error (tl::translate (pending_propattr ? "PROPVALUE record expected after PROPATTR" : "PROPVALUE record without PROPATTR"), start, structure);
+        }
+        pending_propattr = ! pending_propattr;
+
+      } else if (type == 0x07 /*ENDSTR*/ || type == 0x04 /*ENDLIB*/ || find_element_rule (type) != 0) {
+
+        check_error (tl::sprintf (tl::translate ("ENDEL record missing before %s"), name), start, structure);
+
+      } else {
+
+        if ((element->allowed & record_bit (type)) == 0) {
+          check_error (tl::sprintf (tl::translate ("%s record not allowed in %s element"), name, find_record_def (element->type)->record_name), start, structure);
+        }
+        if ((seen & record_bit (type)) != 0) {
+          check_error (tl::sprintf (tl::translate ("Duplicate %s record in %s element"), name, find_record_def (element->type)->record_name), start, structure);
+        }
+        if ((seen & record_bit (0x10 /*XY*/)) != 0 && type != 0x19 /*STRING*/) {
+          check_error (tl::sprintf (tl::translate ("%s record after XY"), name), start, structure);
+        }
+        if (type == 0x19 /*STRING*/ && (seen & record_bit (0x10 /*XY*/)) == 0) {
+          check_error (tl::translate ("STRING record before XY"), start, structure);
+        }
+        if ((type == 0x1b /*MAG*/ || type == 0x1c /*ANGLE*/) && (seen & record_bit (0x1a /*STRANS*/)) == 0) {
+          check_error (tl::sprintf (tl::translate ("%s record without STRANS"), name), start, structure);
+        }
+
+        if (type == 0x10 /*XY*/) {
+
+          if (((len - 4) % 8) != 0) {
+            check_error (tl::translate ("Invalid XY record length (not a multiple of 8)"), start, structure);
+          }
+
+          size_t n = (len - 4) / 8;
+          if (n < element->min_points || n > element->max_points) {
+            check_error (tl::sprintf (tl::translate ("Invalid number of points (%lu) for %s element"), n, find_record_def (element->type)->record_name), start, structure);
+          }
+
+          if (element->closed && n > 0) {
+            const char *xy = m_stream.get (len - 4);
+            if (! xy) {
+              error (tl::translate ("Unexpected end of file"));
+            }
+            if (memcmp (xy, xy + (n - 1) * 8, 8) != 0) {
+              check_error (tl::sprintf (tl::translate ("%s element is not closed"), find_record_def (element->type)->record_name), start, structure);
+            }
+            len = 4;
+          }
+
+        } else if (type == 0x13 /*COLROW*/ && len != 8) {
+          check_error (tl::translate ("COLROW record must have two values"), start, structure);
+        } else if ((type == 0x0d /*LAYER*/ || type == 0x0e /*DATATYPE*/ || type == 0x16 /*TEXTTYPE*/ || type == 0x2a /*NODETYPE*/ || type == 0x2e /*BOXTYPE*/) && len != 6) {
+          check_error (tl::sprintf (tl::translate ("%s record must have one value"), name), start, structure);
+        }
+
+        seen |= record_bit (type);
+
+      }
+      break;
+
+    case Done:
+      break;
+
+    }
+
+    skip (len);
+
+  }
+}
+
+void
+GDS2Dumper::dump_hierarchy ()
+{
+  m_stream.stop_recording ();
+
+  db::HierarchyGraph graph;
+
+  size_t current = 0;
+  bool in_structure = false;
+  bool after_bgnstr = false;
+
+  //  the reference element being read
+  uint8_t element = 0;
+  std::string sname;
+  uint64_t colrow = 1;
+
+  uint16_t len = 0;
+
+  while (true) {
+
+    const RecordDefinition *record_def = read_record (len);
+    if (! record_def) {
+      break;
+    }
+
+    uint8_t type = record_def->type;
+
+    if (type == 0x06 /*STRNAME*/ && after_bgnstr) {
+
+      std::string name = get_str (len - 4);
+
+      current = graph.node (name);
+      if (graph.defined (current)) {
+        warn (tl::sprintf (tl::translate ("Structure %s is defined more than once"), name));
+      }
+
+      graph.set_defined (current);
+      in_structure = true;
+
+    } else if (type == 0x12 /*SNAME*/ && in_structure) {
+      sname = get_str (len - 4);
+    } else if (type == 0x13 /*COLROW*/ && in_structure && len == 8) {
+      uint64_t cols = get_uint16 ();
+      uint64_t rows = get_uint16 ();
+      colrow = cols * rows;
+    } else {
+      skip (len);
+    }
+
+    if (type == 0x0a /*SREF*/ || type == 0x0b /*AREF*/) {
+      element = type;
+      sname.clear ();
+      colrow = 1;
+    } else if (type == 0x11 /*ENDEL*/) {
+
+      if (element != 0 && in_structure && ! sname.empty ()) {
+        uint64_t count = (element == 0x0b /*AREF*/ ? colrow : 1);
+        graph.add_child (current, graph.node (sname), count);
+      }
+
+      element = 0;
+
+    } else if (type == 0x07 /*ENDSTR*/) {
+      in_structure = false;
+    }
+
+    after_bgnstr = (type == 0x05 /*BGNSTR*/);
+
+  }
+
+  graph.finish ();
+
+  std::string out;
+
+  out += tl::sprintf ("%16s %14s %10s  %s\n", "flat instances", "placements", "children", "structure");
+  for (size_t i = 0; i < graph.size (); ++i) {
+    out += tl::sprintf ("%16lu %14lu %10lu  %s%s\n", graph.instances (i), graph.placements (i), graph.children (i).size (), graph.name (i), graph.defined (i) ? "" : " (undefined)");
+  }
+  out += "\n";
+
+  out += "top structures: " + graph.top_cell_names () + "\n";
+
+  for (size_t i = 0; i < graph.size (); ++i) {
+    if (! graph.defined (i)) {
+      out += "undefined reference: " + graph.name (i) + " (from " + graph.parent_names (i) + ")\n";
+    }
+  }
+
+  write (out.c_str (), out.size ());
+}
+
+}
@@ -26,11 +26,14 @@
 
 #include "tlException.h"
 #include "tlStream.h"
+#include "tlHexDump.h"
 #include "dbTypes.h"
 #include "dbPoint.h"
+#include "dbCellIndex.h"
 
 #include <map>
 #include <set>
+#include <vector>
 #include <stdint.h>
 
 namespace db
@@ -66,14 +69,14 @@ public:
   /**  
    *  @brief Destructor
    */
-  ~GDS2Dumper ();
+  virtual ~GDS2Dumper ();
 
   /**
    *  @brief Set short mode
    */
   void short_mode (bool s)
   {
-    m_short_mode = s;
+    m_formatter.set_short_mode (s);
   }
 
   /**
@@ -81,14 +84,137 @@ public:
    */
   void set_width (size_t w)
   {
-    m_width = w;
+    m_formatter.set_width (w);
+  }
+
+  /**
+   *  @brief Set the number of threads
+   *
+   *  With more than one thread, the records are formatted in parallel (see "dump").
+   */
+  void set_threads (unsigned int n)
+  {
+    m_threads = n;
+  }
+
+  /**
+   *  @brief Set the output stream
+   *
+   *  If no output stream is set, the output goes to std::cout.
+   *  The dumper does not take ownership of the stream.
+   */
+  void set_output (tl::OutputStream *out)
+  {
+    mp_output = out;
+  }
+
+  /**
+   *  @brief Dump only the structure with the given name
+   *
+   *  The structure is dumped from BGNSTR to ENDSTR. If a cell index is given and
+   *  the input supports random access, the dumper jumps to the structure directly.
+   *  Otherwise, it reads over the records in front of the structure.
+   */
+  void select_cell (const std::string &name)
+  {
+    m_select = true;
+    m_select_name = name;
+  }
+
+  /**
+   *  @brief Dump only the records in the given range of file offsets
+   *
+   *  The dump starts with the first record starting at or after "from" and stops
+   *  in front of the first record starting at or after "to". If the input supports
+   *  random access, the dumper jumps close to "from" and resynchronizes by looking
+   *  for chains of valid record headers which meet at the same record boundary.
+   *  A cell index provides a safe starting point for that. Otherwise, the records
+   *  in front of "from" are read over. No warnings are issued for these records.
+   */
+  void set_byte_range (size_t from, size_t to)
+  {
+    m_range = true;
+    m_range_from = from;
+    m_range_to = to;
+  }
+
+  /**
+   *  @brief Set a cell index for locating the selected structure
+   *
+   *  The dumper does not take ownership of the index.
+   */
+  void set_index (const CellIndex *index)
+  {
+    mp_index = index;
   }
 
   /** 
    *  @brief The basic dumper method 
+   *
+   *  With more than one thread and an input which provides the file as a memory
+   *  block, the file is cut into large chunks by walking the record headers. The
+   *  chunks are formatted by a pool of threads into separate buffers. The buffers
+   *  are written in file order, so the output is the same as in the serial case.
    */
   void dump ();
 
+  /**
+   *  @brief Dump the records from position "from" up to position "to"
+   *
+   *  "from" must be the position of a record. The dump stops in front of the
+   *  first record starting at or after "to".
+   */
+  void dump_range (size_t from, size_t to);
+
+  /**
+   *  @brief Collect the positions of the structures into the given index instead of dumping
+   */
+  void build_index (CellIndex &index);
+
+  /**
+   *  @brief Prints statistics instead of the dump
+   *
+   *  The statistics list the number of records and bytes per record type and the
+   *  bytes per structure. Only the record headers and structure names are decoded.
+   */
+  void dump_statistics ();
+
+  /**
+   *  @brief Prints a list of the structures instead of the dump
+   *
+   *  The list gives the offset, size, record count, element counts per element
+   *  type and the number of distinct child structures for every structure in file
+   *  order. Only the record headers and the STRNAME and SNAME records are decoded,
+   *  the other payloads are skipped. The lines are written as the structures are
+   *  read, so the memory used does not depend on the file size.
+   */
+  void scan_structures ();
+
+  /**
+   *  @brief Prints the structure hierarchy instead of the dump
+   *
+   *  The reference graph is built from the STRNAME, SNAME and COLROW records in one
+   *  pass. For every structure, the report lists the number of instances in the
+   *  flattened layout (AREFs count with columns times rows), the number of
+   *  placements and the number of distinct children. The top structures and the
+   *  references to undefined structures are listed too. A recursive hierarchy is
+   *  reported as an error.
+   */
+  void dump_hierarchy ();
+
+  /**
+   *  @brief Validates the file without dumping
+   *
+   *  Besides the record types and data type codes, the record sequence is checked
+   *  against the GDS2 stream syntax: the library header, the nesting of structures
+   *  and elements, the records required and allowed per element type, the order
+   *  of the XY, STRING and property records and the number of points per element.
+   *  Boundaries and boxes must be closed. Only the payloads needed for that are
+   *  read. The first violation is reported as an exception. The records after
+   *  ENDLIB (usually padding) are not read.
+   */
+  void check ();
+
   /**
    *  @brief Issue an error with positional informations
    *
@@ -101,7 +227,17 @@ public:
    *
    *  Reimplements GDS2Diagnostics
    */
-  void warn (const std::string &txt);
+  void warn (const std::string &txt)
+  {
+    if (! m_quiet) {
+      warn (txt, m_stream.pos ());
+    }
+  }
+
+  /**
+   *  @brief Issue a warning for the given position
+   */
+  virtual void warn (const std::string &txt, size_t pos);
 
   //  public dumper targets
   void header (const RecordDefinition *record_def, uint16_t len);
@@ -112,12 +248,33 @@ public:
   void generic (const RecordDefinition *record_def, uint16_t len);
 
 private:
+  tl::InputStreamBase *mp_source;
   tl::InputStream m_stream;
   size_t m_last_emit;
-  size_t m_width;
-  bool m_short_mode;
+  tl::HexDumpFormatter m_formatter;
+  tl::OutputStream *mp_output;
+  bool m_select;
+  std::string m_select_name;
+  const CellIndex *mp_index;
+  bool m_hold;
+  std::string m_pending;
+  bool m_range;
+  size_t m_range_from, m_range_to;
+  unsigned int m_threads;
+  std::vector<int32_t> m_xy;
+  bool m_quiet;
 
   void emit (const std::string &msg);
+  void write (const char *data, size_t n);
+  const RecordDefinition *read_record (uint16_t &len);
+  void skip (uint16_t len);
+  bool dump_selected_cell (bool first_only);
+  void dump_byte_range ();
+  void dump_records (size_t to);
+  void dump_parallel ();
+  void check_error (const std::string &msg, size_t pos, const std::string &structure);
+  size_t find_resync_position ();
+  bool probe_records (size_t pos, size_t &landing);
 
   int32_t get_int32 ();
   uint32_t get_uint32 ();
@@ -0,0 +1,211 @@
+/*
+
+  KLayout Layout Viewer
+  Copyright (C) 2013-2018 Matthias Koefferlein
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+
+
+#include "dbHierarchyGraph.h"
+
+#include "tlString.h"
+
+#include <algorithm>
+
+namespace db
+{
+
+// ---------------------------------------------------------------
+//  HierarchyGraph implementation
+
+HierarchyGraph::HierarchyGraph ()
+{
+  //  .. nothing yet ..
+}
+
+size_t
+HierarchyGraph::node (const std::string &name)
+{
+  size_t n = m_names.size ();
+  n = m_node_by_name.insert (std::make_pair (name, n)).first->second;
+
+  if (n == m_names.size ()) {
+    m_names.push_back (name);
+    m_defined.push_back (false);
+    m_children.push_back (children_type ());
+  }
+
+  return n;
+}
+
+void
+HierarchyGraph::add_child (size_t parent, size_t child, uint64_t count)
+{
+  //  consecutive placements often refer to the same cell
+  children_type &children = m_children [parent];
+  if (! children.empty () && children.back ().first == child) {
+    children.back ().second += count;
+  } else {
+    children.push_back (child_type (child, count));
+  }
+}
+
+uint64_t
+HierarchyGraph::placements (size_t n) const
+{
+  uint64_t count = 0;
+  for (children_type::const_iterator c = m_children [n].begin (); c != m_children [n].end (); ++c) {
+    count += c->second;
+  }
+  return count;
+}
+
+std::string
+HierarchyGraph::parent_names (size_t n) const
+{
+  std::string names;
+  for (std::vector<size_t>::const_iterator p = m_parents [n].begin (); p != m_parents [n].end (); ++p) {
+    if (! names.empty ()) {
+      names += ", ";
+    }
+    names += m_names [*p];
+  }
+  return names;
+}
+
+std::string
+HierarchyGraph::top_cell_names () const
+{
+  std::string names;
+  for (size_t i = 0; i < size (); ++i) {
+    if (is_top (i)) {
+      if (! names.empty ()) {
+        names += ", ";
+      }
+      names += m_names [i];
+    }
+  }
+  return names;
+}
+
+void
+HierarchyGraph::merge (children_type &children)
+{
+  std::sort (children.begin (), children.end ());
+
+  children_type::iterator w = children.begin ();
+  for (children_type::const_iterator c = children.begin (); c != children.end (); ++c) {
+    if (w != children.begin () && (w - 1)->first == c->first) {
+      (w - 1)->second += c->second;
+    } else {
+      *w++ = *c;
+    }
+  }
+
+  children.erase (w, children.end ());
+  children_type (children).swap (children);
+}
+
+void
+HierarchyGraph::finish ()
+{
+  for (std::vector<children_type>::iterator n = m_children.begin (); n != m_children.end (); ++n) {
+    merge (*n);
+  }
+
+  m_parents.clear ();
+  m_parents.resize (size ());
+  for (size_t i = 0; i < size (); ++i) {
+    for (children_type::const_iterator c = m_children [i].begin (); c != m_children [i].end (); ++c) {
+      m_parents [c->first].push_back (i);
+    }
+  }
+
+  sort_bottom_up ();
+
+  //  the counts propagate from the parents to the children
+  m_instances.clear ();
+  m_instances.resize (size (), 0);
+  m_depth.clear ();
+  m_depth.resize (size (), 0);
+
+  for (std::vector<size_t>::const_reverse_iterator i = m_bottom_up.rbegin (); i != m_bottom_up.rend (); ++i) {
+    if (m_parents [*i].empty ()) {
+      m_instances [*i] = 1;
+    }
+    for (children_type::const_iterator c = m_children [*i].begin (); c != m_children [*i].end (); ++c) {
+      m_instances [c->first] += m_instances [*i] * c->second;
+      m_depth [c->first] = std::max (m_depth [c->first], m_depth [*i] + 1);
+    }
+  }
+}
+
+void
+HierarchyGraph::sort_bottom_up ()
+{
+  //  A depth-first search with post-order output. The stack holds the nodes of the
+  //  current path with the index of the next child to visit, so deep hierarchies
+  //  do not exhaust the call stack. "state" is 0 for unvisited nodes, 1 for nodes
+  //  on the current path and 2 for finished ones.
+  std::vector<char> state (size (), 0);
+  std::vector<std::pair<size_t, size_t> > path;
+
+  m_bottom_up.clear ();
+  m_bottom_up.reserve (size ());
+
+  for (size_t i = 0; i < size (); ++i) {
+
+    if (state [i] != 0) {
+      continue;
+    }
+
+    state [i] = 1;
+    path.push_back (std::make_pair (i, size_t (0)));
+
+    while (! path.empty ()) {
+
+      size_t n = path.back ().first;
+      size_t c = path.back ().second;
+
+      if (c < m_children [n].size ()) {
+
+        ++path.back ().second;
+
+        size_t child = m_children [n][c].first;
+        if (state [child] == 1) {
+          throw tl::Exception (tl::sprintf (tl::translate ("Recursive hierarchy: %s is placed inside itself"), m_names [child]));
+        } else if (state [child] == 0) {
+          state [child] = 1;
+          path.push_back (std::make_pair (child, size_t (0)));
+        }
+
+      } else {
+
+        state [n] = 2;
+        m_bottom_up.push_back (n);
+        path.pop_back ();
+
+      }
+
+    }
+
+  }
+}
+
+}
+
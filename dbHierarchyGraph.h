@@ -0,0 +1,203 @@
+/*
+
+  KLayout Layout Viewer
+  Copyright (C) 2013-2018 Matthias Koefferlein
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+
+
+#ifndef HDR_dbHierarchyGraph
+#define HDR_dbHierarchyGraph
+
+#include "tlException.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+namespace db
+{
+
+/**
+ *  @brief The cell placement graph of a layout file
+ *
+ *  Every cell (defined or referenced) is a node, identified by its name. The
+ *  edges lead from a parent to a child cell and carry the number of instances
+ *  (a repetition or an AREF counts with its instance count).
+ *
+ *  The graph is built with "node", "set_defined" and "add_child". "finish" then
+ *  merges the edges, collects the parents and sorts the nodes, so children come
+ *  before their parents. A recursive hierarchy is reported as an exception by
+ *  "finish".
+ */
+class KLAYOUT_DLL HierarchyGraph
+{
+public:
+  typedef std::pair<size_t, uint64_t> child_type;
+  typedef std::vector<child_type> children_type;
+
+  /**
+   *  @brief Creates an empty graph
+   */
+  HierarchyGraph ();
+
+  /**
+   *  @brief Gets the node for the given cell name, creating it if required
+   *
+   *  The nodes are numbered in the order they are created.
+   */
+  size_t node (const std::string &name);
+
+  /**
+   *  @brief Marks the node as a defined cell
+   */
+  void set_defined (size_t n)
+  {
+    m_defined [n] = true;
+  }
+
+  /**
+   *  @brief Adds instances of the child node to the parent node
+   *
+   *  Instances of the same child are merged.
+   */
+  void add_child (size_t parent, size_t child, uint64_t count);
+
+  /**
+   *  @brief Merges the instances of the same child in a list of children
+   *
+   *  After merging, the list is sorted by child node.
+   */
+  static void merge (children_type &children);
+
+  /**
+   *  @brief Finishes the graph after all nodes and edges have been added
+   *
+   *  Throws an exception if the hierarchy is recursive.
+   */
+  void finish ();
+
+  /**
+   *  @brief Gets the number of nodes
+   */
+  size_t size () const
+  {
+    return m_names.size ();
+  }
+
+  /**
+   *  @brief Gets the cell name of the node
+   */
+  const std::string &name (size_t n) const
+  {
+    return m_names [n];
+  }
+
+  /**
+   *  @brief Gets a value indicating whether the node is a defined cell
+   */
+  bool defined (size_t n) const
+  {
+    return m_defined [n];
+  }
+
+  /**
+   *  @brief Gets the child nodes with their instance counts, sorted by node
+   */
+  const children_type &children (size_t n) const
+  {
+    return m_children [n];
+  }
+
+  /**
+   *  @brief Gets the parent nodes, sorted by node (available after "finish")
+   */
+  const std::vector<size_t> &parents (size_t n) const
+  {
+    return m_parents [n];
+  }
+
+  /**
+   *  @brief Gets the names of the parent nodes, separated by commas
+   */
+  std::string parent_names (size_t n) const;
+
+  /**
+   *  @brief Gets the total number of instances placed inside the node
+   */
+  uint64_t placements (size_t n) const;
+
+  /**
+   *  @brief Gets a value indicating whether the node is a top cell
+   *
+   *  A top cell is a defined cell which is not placed anywhere.
+   */
+  bool is_top (size_t n) const
+  {
+    return m_defined [n] && m_parents [n].empty ();
+  }
+
+  /**
+   *  @brief Gets the names of the top cells, separated by commas
+   */
+  std::string top_cell_names () const;
+
+  /**
+   *  @brief Gets the nodes sorted bottom-up: children come before their parents
+   */
+  const std::vector<size_t> &bottom_up () const
+  {
+    return m_bottom_up;
+  }
+
+  /**
+   *  @brief Gets the number of instances of the node in the flattened layout
+   *
+   *  Nodes without parents are instantiated once.
+   */
+  uint64_t instances (size_t n) const
+  {
+    return m_instances [n];
+  }
+
+  /**
+   *  @brief Gets the length of the longest path from a node without parents to this node
+   */
+  unsigned int depth (size_t n) const
+  {
+    return m_depth [n];
+  }
+
+private:
+  std::map<std::string, size_t> m_node_by_name;
+  std::vector<std::string> m_names;
+  std::vector<bool> m_defined;
+  std::vector<children_type> m_children;
+  std::vector<std::vector<size_t> > m_parents;
+  std::vector<size_t> m_bottom_up;
+  std::vector<uint64_t> m_instances;
+  std::vector<unsigned int> m_depth;
+
+  void sort_bottom_up ();
+};
+
+}
+
+#endif
+
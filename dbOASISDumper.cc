@@ -22,1534 +22,961 @@
 
 
 #include "dbOASISDumper.h"
+#include "dbHierarchyGraph.h"
+#include "tlThreads.h"
 
-#include "tlException.h"
-#include "tlString.h"
-
-#include <limits>
 #include <iostream>
+#include <memory>
+#include <map>
+#include <set>
+#include <list>
+#include <deque>
+#include <algorithm>
 
 namespace db
 {
 
 // ---------------------------------------------------------------
-//  OASISDumper
-
-OASISDumper::OASISDumper (tl::InputStreamBase &s)
-  : m_stream (s), m_last_emit (0), m_width (8), m_short_mode (false)
-{
-  m_stream.start_recording ();
-}
-
-OASISDumper::~OASISDumper ()
-{
-  //  .. nothing yet ..
-}
+//  OASISDumpJob definition and implementation
 
-inline long long 
-OASISDumper::get_long_long ()
+/**
+ *  @brief An output delegate collecting the output in a string
+ */
+class OASISDumpBuffer
+  : public tl::OutputStreamBase
 {
-  unsigned long long u = get_ulong_long ();
-  if ((u & 1) != 0) {
-    return -(long long) (u >> 1);
-  } else {
-    return (long long) (u >> 1);
+public:
+  virtual void write (const char *b, size_t n)
+  {
+    m_data.append (b, n);
   }
-}
 
-inline unsigned long long 
-OASISDumper::get_ulong_long ()
-{
-  unsigned long long v = 0;
-  unsigned long long vm = 1;
-  char c;
-  
-  do {
-    unsigned char *b = (unsigned char *) m_stream.get (1);
-    if (! b) {
-      error (tl::translate ("Unexpected end-of-file"));
-      return 0;
-    }
-    c = *b;
-    if (vm > std::numeric_limits <unsigned long long>::max () / 128 && 
-        (unsigned long long) (c & 0x7f) > (std::numeric_limits <unsigned long long>::max () / vm)) {
-      warn (tl::translate ("Unsigned long value overflow"));
-    }
-    v += (unsigned long long) (c & 0x7f) * vm;
-    vm <<= 7;
-  } while ((c & 0x80) != 0);
+  const std::string &data () const
+  {
+    return m_data;
+  }
 
-  return v;
-}
+private:
+  std::string m_data;
+};
 
-inline long 
-OASISDumper::get_long ()
+/**
+ *  @brief A warning issued while dumping a part of the file
+ *
+ *  "output_pos" is the output position where the warning is reported.
+ */
+struct OASISDumpWarning
 {
-  unsigned long u = get_ulong ();
-  if ((u & 1) != 0) {
-    return -long (u >> 1);
-  } else {
-    return long (u >> 1);
-  }
-}
+  size_t output_pos;
+  std::string msg;
+  size_t pos;
+};
 
-inline unsigned long 
-OASISDumper::get_ulong ()
+/**
+ *  @brief A dumper formatting a part of the file into a buffer
+ *
+ *  Warnings are collected, so they can be reported at the same place as in
+ *  the serial dump.
+ */
+class OASISPartDumper
+  : public OASISDumper
 {
-  unsigned long v = 0;
-  unsigned long vm = 1;
-  char c;
-  
-  do {
-    unsigned char *b = (unsigned char *) m_stream.get (1);
-    if (! b) {
-      error (tl::translate ("Unexpected end-of-file"));
-      return 0;
-    }
-    c = *b;
-    if (vm > std::numeric_limits <unsigned long>::max () / 128 && 
-        (unsigned long) (c & 0x7f) > (std::numeric_limits <unsigned long>::max () / vm)) {
-      warn (tl::translate ("Unsigned long value overflow"));
-    }
-    v += (unsigned long) (c & 0x7f) * vm;
-    vm <<= 7;
-  } while ((c & 0x80) != 0);
-
-  return v;
-}
+public:
+  OASISPartDumper (tl::InputStreamBase &s)
+    : OASISDumper (s), m_out (m_buffer)
+  {
+    set_output (&m_out);
+  }
 
-inline int 
-OASISDumper::get_int ()
-{
-  unsigned int u = get_uint ();
-  if ((u & 1) != 0) {
-    return -int (u >> 1);
-  } else {
-    return int (u >> 1);
+  virtual void warn (const std::string &msg, size_t pos)
+  {
+    m_warnings.push_back (OASISDumpWarning ());
+    m_warnings.back ().output_pos = m_out.pos ();
+    m_warnings.back ().msg = msg;
+    m_warnings.back ().pos = pos;
   }
-}
 
-inline unsigned int 
-OASISDumper::get_uint ()
-{
-  unsigned int v = 0;
-  unsigned int vm = 1;
-  char c;
-  
-  do {
-    unsigned char *b = (unsigned char *) m_stream.get (1);
-    if (! b) {
-      error (tl::translate ("Unexpected end-of-file"));
-      return 0;
-    }
-    c = *b;
-    if (vm > std::numeric_limits <unsigned int>::max () / 128 && 
-        (unsigned int) (c & 0x7f) > (std::numeric_limits <unsigned int>::max () / vm)) {
-      warn (tl::translate ("Unsigned integer value overflow"));
-    }
-    v += (unsigned int) (c & 0x7f) * vm;
-    vm <<= 7;
-  } while ((c & 0x80) != 0);
+  const std::string &data () const
+  {
+    return m_buffer.data ();
+  }
 
-  return v;
-}
+  const std::vector<OASISDumpWarning> &warnings () const
+  {
+    return m_warnings;
+  }
 
-std::string 
-OASISDumper::get_str ()
-{
-  std::string s;
-  get_str (s);
-  return s;
-}
+private:
+  OASISDumpBuffer m_buffer;
+  tl::OutputStream m_out;
+  std::vector<OASISDumpWarning> m_warnings;
+};
 
-void
-OASISDumper::get_str (std::string &s)
+/**
+ *  @brief A job dumping the part of the file between two CELL records
+ */
+class OASISDumpJob
+  : public tl::Job
 {
-  size_t l = 0;
-  get (l);
+public:
+  OASISDumpJob (const char *data, size_t size, const OASISResumePosition *from, const OASISResumePosition *to, const tl::HexDumpFormatter &formatter)
+    : m_mem (data, size), m_dumper (m_mem), mp_from (from), mp_to (to)
+  {
+    m_dumper.short_mode (formatter.short_mode ());
+    m_dumper.set_width (formatter.width ());
+  }
 
-  char *b = (char *) m_stream.get (l);
-  if (b) {
-    s.assign (b, l);
-  } else {
-    s = std::string ();
+  virtual void run ()
+  {
+    m_dumper.dump_range (mp_from, mp_to);
   }
-}
 
-double
-OASISDumper::get_real ()
-{
-  unsigned int t = get_uint ();
+  const OASISPartDumper &dumper () const
+  {
+    return m_dumper;
+  }
 
-  if (t == 0) {
+private:
+  tl::InputMemoryStream m_mem;
+  OASISPartDumper m_dumper;
+  const OASISResumePosition *mp_from, *mp_to;
+};
 
-    return double (get_ulong ()); 
+// ---------------------------------------------------------------
+//  OASISStatistics definition and implementation
 
-  } else if (t == 1) {
+static const char *record_names [] = {
+  "PAD", "START", "END", "CELLNAME", "CELLNAME", "TEXTSTRING", "TEXTSTRING", 
+  "PROPNAME", "PROPNAME", "PROPSTRING", "PROPSTRING", "LAYERNAME", "LAYERNAME",
+  "CELL", "CELL", "XYABSOLUTE", "XYRELATIVE", "PLACEMENT", "PLACEMENT", "TEXT", 
+  "RECTANGLE", "POLYGON", "PATH", "TRAPEZOID", "TRAPEZOID", "TRAPEZOID", 
+  "CTRAPEZOID", "CIRCLE", "PROPERTY", "PROPERTY", "XNAME", "XNAME", "XELEMENT",
+  "XGEOMETRY", "CBLOCK"
+};
 
-    return -double (get_ulong ()); 
+static const unsigned int num_record_types = sizeof (record_names) / sizeof (record_names [0]);
 
-  } else if (t == 2) {
+/**
+ *  @brief A visitor collecting the record and byte counts
+ *
+ *  The record sizes are derived from the record positions, so no field is 
+ *  formatted. Records inside CBLOCKs are counted with their uncompressed size.
+ *  The CBLOCK records are counted with their size in the file.
+ */
+class OASISStatistics
+  : public OASISVisitor
+{
+public:
+  OASISStatistics ()
+    : m_first_pos (0), m_end_pos (0), mp_last (&m_raw), m_cell (-1), m_cblock_end (0)
+  {
+    for (unsigned int i = 0; i < num_record_types; ++i) {
+      m_counts [i] = 0;
+      m_bytes [i] = 0;
+      m_inflated_bytes [i] = 0;
+    }
+  }
 
-    return 1.0 / double (get_ulong ()); 
+  virtual void end_file (size_t pos)
+  {
+    m_inflated.close (m_cblock_end, *this, true);
+    m_raw.close (pos, *this, false);
+    m_end_pos = pos;
+  }
 
-  } else if (t == 3) {
+  virtual void name (NameTable table, unsigned long id, const std::string &name)
+  {
+    if (table == CellNames) {
+      m_cell_names [id] = name;
+    }
+  }
 
-    return -1.0 / double (get_ulong ()); 
+  virtual void begin_cell (const OASISName &cell)
+  {
+    m_cell = int (m_cells.size ());
+    m_cells.push_back (CellStatistics ());
+    m_cells.back ().name = cell;
 
-  } else if (t == 4) {
+    //  the CELL record itself belongs to the cell
+    mp_last->cell = m_cell;
+  }
 
-    double d = double (get_ulong ());
-    return d / double (get_ulong ()); 
+  virtual void end_cell ()
+  {
+    m_cell = -1;
+  }
 
-  } else if (t == 5) {
+  virtual void record (unsigned int type, size_t pos, bool inflated)
+  {
+    if (inflated) {
+      m_inflated.close (pos, *this, true);
+      m_inflated.open (type, pos, m_cell);
+      mp_last = &m_inflated;
+    } else {
+      if (m_raw.type < 0) {
+        m_first_pos = pos;
+      }
+      m_inflated.close (m_cblock_end, *this, true);
+      m_raw.close (pos, *this, false);
+      //  the CBLOCK bytes are not attributed to the cell
+      m_raw.open (type, pos, type == 34 ? -1 : m_cell);
+      mp_last = &m_raw;
+    }
+  }
 
-    double d = double (get_ulong ());
-    return -d / double (get_ulong ()); 
+  virtual void cblock (size_t pos, size_t comp_bytes, size_t uncomp_bytes)
+  {
+    m_cblocks.push_back (CBlockStatistics ());
+    m_cblocks.back ().pos = pos;
+    m_cblocks.back ().comp_bytes = comp_bytes;
+    m_cblocks.back ().uncomp_bytes = uncomp_bytes;
+    m_cblock_end = uncomp_bytes;
+  }
 
-  } else if (t == 6) {
+  void report (std::string &out) const;
 
-    union {
-      float f;
-      uint32_t i;
-    } i2f;
+private:
+  struct OpenRecord
+  {
+    OpenRecord () : type (-1), pos (0), cell (-1) { }
 
-    unsigned char *b = (unsigned char *) m_stream.get (sizeof (i2f.i));
-    if (! b) {
-      error (tl::translate ("Unexpected end-of-file"));
-    }
-    i2f.i = 0;
-    b += sizeof (i2f.i);
-    for (unsigned int i = 0; i < sizeof (i2f.i); ++i) {
-      i2f.i = (i2f.i << 8) + uint32_t (*--b);
+    void open (unsigned int t, size_t p, int c)
+    {
+      type = int (t);
+      pos = p;
+      cell = c;
     }
 
-    return double (i2f.f);
-
-  } else if (t == 7) {
-
-    union {
-      double d;
-      uint64_t i;
-    } i2f;
+    void close (size_t end, OASISStatistics &stat, bool inflated)
+    {
+      if (type >= 0) {
+        stat.add (type, end > pos ? end - pos : 0, cell, inflated);
+        type = -1;
+      }
+    }
 
-    unsigned char *b = (unsigned char *) m_stream.get (sizeof (i2f.i));
-    if (! b) {
-      error (tl::translate ("Unexpected end-of-file"));
+    int type;
+    size_t pos;
+    int cell;
+  };
+
+  struct CellStatistics
+  {
+    CellStatistics () : bytes (0), records (0) { }
+
+    OASISName name;
+    size_t bytes;
+    size_t records;
+  };
+
+  struct CBlockStatistics
+  {
+    size_t pos, comp_bytes, uncomp_bytes;
+  };
+
+  size_t m_counts [num_record_types];
+  size_t m_bytes [num_record_types];
+  size_t m_inflated_bytes [num_record_types];
+  size_t m_first_pos, m_end_pos;
+  OpenRecord m_raw, m_inflated;
+  OpenRecord *mp_last;
+  int m_cell;
+  size_t m_cblock_end;
+  std::vector<CellStatistics> m_cells;
+  std::vector<CBlockStatistics> m_cblocks;
+  std::map<unsigned long, std::string> m_cell_names;
+
+  void add (int type, size_t n, int cell, bool inflated)
+  {
+    //  the bytes of records inside CBLOCKs are part of the CBLOCK record in the file
+    m_counts [type] += 1;
+    if (inflated) {
+      m_inflated_bytes [type] += n;
+    } else {
+      m_bytes [type] += n;
     }
-    i2f.i = 0;
-    b += sizeof (i2f.i);
-    for (unsigned int i = 0; i < sizeof (i2f.i); ++i) {
-      i2f.i = (i2f.i << 8) + uint64_t (*--b);
+    if (cell >= 0) {
+      m_cells [cell].bytes += n;
+      m_cells [cell].records += 1;
     }
-
-    return double (i2f.d);
-
-  } else {
-    error (tl::sprintf (tl::translate ("Invalid real type %d"), t));
-    return 0.0;
   }
-}
 
-db::Coord
-OASISDumper::get_ucoord (unsigned long grid)
-{
-  unsigned long long lx = 0;
-  get (lx);
-  lx *= grid;
-  if (lx > (unsigned long long) (std::numeric_limits <db::Coord>::max ())) {
-    warn (tl::translate ("Coordinate value overflow"));
+  std::string cell_name (const OASISName &cell) const
+  {
+    if (! cell.by_id) {
+      return cell.name;
+    }
+    std::map<unsigned long, std::string>::const_iterator n = m_cell_names.find (cell.id);
+    if (n != m_cell_names.end ()) {
+      return n->second;
+    } else {
+      return "ID " + tl::to_string (cell.id);
+    }
   }
-  return db::Coord (lx);
-}
 
-db::Coord
-OASISDumper::get_coord (long grid)
-{
-  long long lx = 0;
-  get (lx);
-  lx *= grid;
-  if (lx < (long long) (std::numeric_limits <db::Coord>::min ()) ||
-      lx > (long long) (std::numeric_limits <db::Coord>::max ())) {
-    warn (tl::translate ("Coordinate value overflow"));
+  static bool larger_cell (const CellStatistics *a, const CellStatistics *b)
+  {
+    return a->bytes > b->bytes;
   }
-  return db::Coord (lx);
-}
+};
 
-db::Point
-OASISDumper::get_2delta (long grid)
+void
+OASISStatistics::report (std::string &out) const
 {
-  unsigned long long l1 = 0;
-  get (l1);
+  size_t total_count = 0, total_bytes = 0, total_inflated = 0;
 
-  long long lx = l1 >> 2;
-  lx *= grid;
-  if (lx > (long long) (std::numeric_limits <db::Coord>::max ())) {
-    warn (tl::translate ("Coordinate value overflow"));
-  }
-  db::Coord x = lx;
-
-  switch (l1 & 3) {
-  case 0:
-    return db::Point (x, 0);
-  case 1:
-    return db::Point (0, x);
-  case 2:
-    return db::Point (-x, 0);
-  case 3:
-  default:
-    return db::Point (0, -x);
+  out += tl::sprintf ("%-4s %-12s %12s %14s %14s\n", "type", "record", "count", "bytes", "in CBLOCKs");
+  for (unsigned int i = 0; i < num_record_types; ++i) {
+    out += tl::sprintf ("%-4u %-12s %12lu %14lu %14lu\n", i, record_names [i], m_counts [i], m_bytes [i], m_inflated_bytes [i]);
+    total_count += m_counts [i];
+    total_bytes += m_bytes [i];
+    total_inflated += m_inflated_bytes [i];
   }
-}
+  //  with the magic bytes, the total is the file size
+  out += tl::sprintf ("%-17s %12s %14lu\n", "magic bytes", "", m_first_pos);
+  total_bytes += m_first_pos;
+  out += tl::sprintf ("%-17s %12lu %14lu %14lu\n", "total", total_count, total_bytes, total_inflated);
+  out += "\n";
 
-db::Point
-OASISDumper::get_3delta (long grid)
-{
-  unsigned long long l1 = 0;
-  get (l1);
+  out += tl::sprintf ("magic bytes: %lu\n", m_first_pos);
+  out += tl::sprintf ("file size: %lu\n", m_end_pos);
+  out += tl::sprintf ("bytes in CBLOCKs: %lu (uncompressed: %lu)\n", m_bytes [34], total_inflated);
+  out += "\n";
 
-  long long lx = l1 >> 3;
-  lx *= grid;
-  if (lx > (long long) (std::numeric_limits <db::Coord>::max ())) {
-    warn (tl::translate ("Coordinate value overflow"));
-  }
-  db::Coord x = lx;
-
-  switch (l1 & 7) {
-  case 0:
-    return db::Point (x, 0);
-  case 1:
-    return db::Point (0, x);
-  case 2:
-    return db::Point (-x, 0);
-  case 3:
-    return db::Point (0, -x);
-  case 4:
-    return db::Point (x, x);
-  case 5:
-    return db::Point (-x, x);
-  case 6:
-    return db::Point (-x, -x);
-  case 7:
-  default:
-    return db::Point (x, -x);
+  std::vector<const CellStatistics *> cells;
+  cells.reserve (m_cells.size ());
+  for (std::vector<CellStatistics>::const_iterator c = m_cells.begin (); c != m_cells.end (); ++c) {
+    cells.push_back (&*c);
   }
-}
-
-db::Point
-OASISDumper::get_gdelta (long grid)
-{
-  unsigned long long l1 = 0;
-  get (l1);
-
-  if ((l1 & 1) != 0) {
+  std::stable_sort (cells.begin (), cells.end (), &larger_cell);
 
-    long long lx = ((l1 & 2) == 0 ? (long long) (l1 >> 2) : -(long long) (l1 >> 2));
-    lx *= grid;
-    if (lx < (long long) (std::numeric_limits <db::Coord>::min ()) ||
-        lx > (long long) (std::numeric_limits <db::Coord>::max ())) {
-      warn (tl::translate ("Coordinate value overflow"));
-    }
+  out += tl::sprintf ("%14s %12s  %s\n", "bytes", "records", "cell");
+  for (std::vector<const CellStatistics *>::const_iterator c = cells.begin (); c != cells.end (); ++c) {
+    out += tl::sprintf ("%14lu %12lu  %s\n", (*c)->bytes, (*c)->records, cell_name ((*c)->name));
+  }
 
-    long long ly;
-    get (ly);
-    ly *= grid;
-    if (ly < (long long) (std::numeric_limits <db::Coord>::min ()) ||
-        ly > (long long) (std::numeric_limits <db::Coord>::max ())) {
-      warn (tl::translate ("Coordinate value overflow"));
+  if (! m_cblocks.empty ()) {
+    out += "\n";
+    out += tl::sprintf ("%14s %14s %14s %8s\n", "CBLOCK", "compressed", "uncompressed", "ratio");
+    for (std::vector<CBlockStatistics>::const_iterator b = m_cblocks.begin (); b != m_cblocks.end (); ++b) {
+      double ratio = b->comp_bytes > 0 ? double (b->uncomp_bytes) / double (b->comp_bytes) : 0.0;
+      out += tl::sprintf ("%14lu %14lu %14lu %8.2f\n", b->pos, b->comp_bytes, b->uncomp_bytes, ratio);
     }
-    
-    return db::Point (db::Coord (lx), db::Coord (ly));
+  }
+}
 
+// ---------------------------------------------------------------
+//  OASISCellNodes definition and implementation
+
+/**
+ *  @brief A visitor base class collecting the cells as nodes
+ *
+ *  Cells are referenced by ID or by name. As the CELLNAME records may follow the
+ *  references, references by ID and by name are separate nodes while reading.
+ *  "resolve" unifies them through the cell names in a hierarchy graph.
+ */
+class OASISCellNodes
+  : public OASISVisitor
+{
+public:
+  virtual void name (NameTable table, unsigned long id, const std::string &name)
+  {
+    if (table == CellNames) {
+      m_cell_names [id] = name;
+    }
+  }
+
+protected:
+  /**
+   *  @brief Gets the node for the given cell reference, creating it if required
+   */
+  uint32_t node (const OASISName &cell);
+
+  /**
+   *  @brief Creates the graph nodes for all nodes in the order the nodes were created
+   *
+   *  "graph_nodes" receives the graph node for every node.
+   */
+  void resolve (db::HierarchyGraph &graph, std::vector<size_t> &graph_nodes) const;
+
+private:
+  std::map<unsigned long, std::string> m_cell_names;
+  std::map<unsigned long, uint32_t> m_node_by_id;
+  std::map<std::string, uint32_t> m_node_by_name;
+  std::vector<OASISName> m_nodes;
+
+  std::string cell_name (const OASISName &cell) const;
+};
+
+uint32_t
+OASISCellNodes::node (const OASISName &cell)
+{
+  uint32_t n = uint32_t (m_nodes.size ());
+  if (cell.by_id) {
+    n = m_node_by_id.insert (std::make_pair (cell.id, n)).first->second;
   } else {
+    n = m_node_by_name.insert (std::make_pair (cell.name, n)).first->second;
+  }
 
-    long long lx = l1 >> 4;
-    lx *= grid;
-    if (lx > (long long) (std::numeric_limits <db::Coord>::max ())) {
-      warn (tl::translate ("Coordinate value overflow"));
-    }
-    db::Coord x = lx;
-
-    switch ((l1 >> 1) & 7) {
-    case 0:
-      return db::Point (x, 0);
-    case 1:
-      return db::Point (0, x);
-    case 2:
-      return db::Point (-x, 0);
-    case 3:
-      return db::Point (0, -x);
-    case 4:
-      return db::Point (x, x);
-    case 5:
-      return db::Point (-x, x);
-    case 6:
-      return db::Point (-x, -x);
-    case 7:
-    default:
-      return db::Point (x, -x);
-    }
-
+  if (n == m_nodes.size ()) {
+    m_nodes.push_back (cell);
   }
-}
 
-void 
-OASISDumper::error (const std::string &msg)
-{
-  throw OASISDumperException (msg, m_stream.pos (), "UNKNOWN_CELL");
+  return n;
 }
 
-void 
-OASISDumper::warn (const std::string &msg) 
+std::string
+OASISCellNodes::cell_name (const OASISName &cell) const
 {
-  std::cerr << msg 
-           << tl::translate (" (position=") << m_stream.pos ()
-           << ")"
-           << std::endl;
+  if (! cell.by_id) {
+    return cell.name;
+  }
+  std::map<unsigned long, std::string>::const_iterator n = m_cell_names.find (cell.id);
+  if (n != m_cell_names.end ()) {
+    return n->second;
+  } else {
+    return "ID " + tl::to_string (cell.id);
+  }
 }
 
 void
-OASISDumper::emit (const std::string &msg)
+OASISCellNodes::resolve (db::HierarchyGraph &graph, std::vector<size_t> &graph_nodes) const
 {
-  size_t last_pos = m_last_emit;
-  m_last_emit = m_stream.pos ();
-
-  const char *r = m_stream.recorded ();
-  std::cout << tl::sprintf ("%09d   ", last_pos);
-  for (size_t i = 0; i < m_width; ++i) {
-    if (last_pos + i < m_last_emit) {
-      char c = *r++;
-      std::cout << tl::sprintf ("%02x ", int ((unsigned char) c));
-    } else {
-      std::cout << "   ";
-    }
-  }
-
-  m_stream.reset_recording ();
-
-  std::cout << " " << msg << std::endl;
-
-  last_pos += m_width;
-  while (last_pos < m_last_emit) {
-
-    std::cout << tl::sprintf ("%09d + ", last_pos);
-    if (m_short_mode) {
-
-      std::cout << "..." << std::endl;
-      break;
-
-    } else {
-
-      for (size_t i = 0; i < m_width; ++i) {
-        if (last_pos + i < m_last_emit) {
-          char c = *r++;
-          std::cout << tl::sprintf ("%02x ", int ((unsigned char) c));
-        } else {
-          break;
-        }
-      }
-
-      last_pos += m_width;
-      std::cout << std::endl;
-
-    }
+  graph_nodes.clear ();
+  graph_nodes.reserve (m_nodes.size ());
+  for (std::vector<OASISName>::const_iterator n = m_nodes.begin (); n != m_nodes.end (); ++n) {
+    graph_nodes.push_back (graph.node (cell_name (*n)));
   }
 }
 
-static const char magic_bytes[] = { "%SEMI-OASIS\015\012" };
+// ---------------------------------------------------------------
+//  OASISShapeCounter definition and implementation
 
-void 
-OASISDumper::dump ()
+/**
+ *  @brief Shape and vertex counts
+ */
+struct OASISShapeCounts
 {
-  unsigned char r;
-  char *mb;
+  OASISShapeCounts () : shapes (0), vertices (0) { }
 
-  //  read magic bytes
-  mb = (char *) m_stream.get (sizeof (magic_bytes) - 1);
-  if (! mb) {
-    error (tl::translate ("File too short"));
-    return;
-  }
-  if (strncmp (mb, magic_bytes, sizeof (magic_bytes) - 1) != 0) {
-    error (tl::translate ("Format error (missing magic bytes)"));
+  void add (const OASISShapeCounts &other, uint64_t n)
+  {
+    shapes += other.shapes * n;
+    vertices += other.vertices * n;
   }
 
-  emit ("magic bytes");
+  uint64_t shapes, vertices;
+};
 
-  //  read first record
-  r = get_byte ();
-  if (r != 1) {
-    error (tl::translate ("Format error (START record expected)"));
-  }
+/**
+ *  @brief A visitor counting the shapes and vertices per layer and cell
+ *
+ *  Repetitions are not expanded: a shape with a repetition counts as many 
+ *  shapes as the repetition has instances. The placements are collected with
+ *  their instance count, so the flattened counts can be computed from the 
+ *  counts of the child cells without walking the hierarchy instance by instance.
+ *
+ *  Rectangles and trapezoids have 4 vertices, CTRAPEZOID triangles 3, polygons
+ *  the number of points (including the implicit ones) and paths the number of
+ *  spine points. Circles count as shapes without vertices. Texts are not counted.
+ */
+class OASISShapeCounter
+  : public OASISCellNodes
+{
+public:
+  typedef std::pair<unsigned int, unsigned int> layer_type;
+  typedef std::map<layer_type, OASISShapeCounts> counts_map;
 
-  emit ("START");
+  OASISShapeCounter ()
+    : mp_cell (0), mp_last (0)
+  { }
 
-  std::string v = get_str ();
-  if (v != "1.0") {
-    error (tl::sprintf (tl::translate ("Format error (only version 1.0 is supported, file has version %s)"), v));
+  virtual void begin_cell (const OASISName &cell)
+  {
+    m_cells.push_back (CellCounts ());
+    mp_cell = &m_cells.back ();
+    mp_cell->node = node (cell);
+    mp_last = 0;
   }
 
-  emit ("version (\"" + v + "\")");
-
-  double res = get_real ();
-  if (res < 1e-6) {
-    error (tl::sprintf (tl::translate ("Invalid resolution of %g"), res));
+  virtual void end_cell ()
+  {
+    mp_cell = 0;
+    mp_last = 0;
   }
 
-  emit ("resolution (" + tl::to_string (res) + ")");
-
-  //  read over table offsets if required
-  bool table_offsets_at_end = get_uint ();
-  emit ("table flag (" + std::string (table_offsets_at_end ? "at end" : "here") + ")");
-
-  if (! table_offsets_at_end) {
-    for (unsigned int i = 0; i < 12; ++i) {
-      unsigned long t = get_ulong ();
-      emit ("tables entry (" + tl::to_string (t) + ")");
+  virtual void placement (const OASISName &cell, const db::Point & /*pos*/, double /*mag*/, double /*angle*/, bool /*mirror*/, const OASISRepetition *rep)
+  {
+    if (mp_cell) {
+      mp_cell->placements [node (cell)] += multiplicity (rep);
     }
   }
 
-  //  read next record
-  while (true) {
-
-    r = get_byte ();
-
-    if (r == 0 /*PAD*/) {
-
-      emit ("PAD");
-
-    } else if (r == 2 /*END*/) {
-
-      emit ("END");
-
-      if (table_offsets_at_end) {
-        for (unsigned int i = 0; i < 12; ++i) {
-          unsigned long t = get_ulong ();
-          emit ("tables entry (" + tl::to_string (t) + ")");
-        }
-      }
-
-      std::string padding = get_str ();
-      emit ("padding string (\"" + padding + "\")");
-
-      unsigned int vs = get_uint ();
-      emit ("validation scheme (" + tl::to_string (vs) + ")");
-
-      if (vs == 1 || vs == 2) {
-        for (unsigned int i = 0; i < 4; ++i) {
-          get_byte ();
-        }
-        emit ("validation signature");
-      }
-
-      break;
-
-    } else if (r == 3 || r == 4 /*CELLNAME*/) {
-
-      //  read a cell name
-      std::string name = get_str ();
-
-      //  and the associated id
-      if (r == 3) {
-        emit ("CELLNAME (\"" + name + "\")");
-      } else {
-        unsigned long id = 0;
-        get (id);
-        emit ("CELLNAME (\"" + name + "\", id=" + tl::to_string (id) + ")");
-      }
-
-    } else if (r == 5 || r == 6 /*TEXTSTRING*/) {
-
-      //  read a text string
-      std::string name = get_str ();
-
-      //  and the associated id
-      if (r == 5) {
-        emit ("TEXTSTRING (\"" + name + "\")");
-      } else {
-        unsigned long id = 0;
-        get (id);
-        emit ("TEXTSTRING (\"" + name + "\", id=" + tl::to_string (id) + ")");
-      }
-
-    } else if (r == 7 || r == 8 /*PROPNAME*/) {
-
-      //  read a property name
-      std::string name = get_str ();
-
-      //  and the associated id
-      if (r == 7) {
-        emit ("PROPNAME (\"" + name + "\")");
-      } else {
-        unsigned long id = 0;
-        get (id);
-        emit ("PROPNAME (\"" + name + "\", id=" + tl::to_string (id) + ")");
-      }
-
-    } else if (r == 9 || r == 10 /*PROPSTRING*/) {
-
-      //  read a property string
-      std::string name = get_str ();
-
-      //  and the associated id
-      if (r == 9) {
-        emit ("PROPSTRING (\"" + name + "\")");
-      } else {
-        unsigned long id = 0;
-        get (id);
-        emit ("PROPSTRING (\"" + name + "\", id=" + tl::to_string (id) + ")");
-      }
-
-    } else if (r == 11 || r == 12 /*LAYERNAME*/) {
-
-      //  read a layer name 
-      std::string name = get_str ();
-
-      unsigned int dt1 = 0, dt2 = std::numeric_limits<unsigned int>::max () - 1;
-      unsigned int l1 = 0, l2 = std::numeric_limits<unsigned int>::max () - 1;
-      unsigned int it;
-
-      it = get_uint ();
-      if (it == 0) {
-        //  keep limits
-      } else if (it == 1) {
-        l2 = get_uint ();
-      } else if (it == 2) {
-        l1 = get_uint ();
-      } else if (it == 3) {
-        l1 = get_uint ();
-        l2 = l1;
-      } else if (it == 4) {
-        l1 = get_uint ();
-        l2 = get_uint ();
-      } else {
-        error (tl::translate ("Invalid LAYERNAME interval mode (layer)"));
-      }
-
-      it = get_uint ();
-      if (it == 0) {
-        //  keep limits
-      } else if (it == 1) {
-        dt2 = get_uint ();
-      } else if (it == 2) {
-        dt1 = get_uint ();
-      } else if (it == 3) {
-        dt1 = get_uint ();
-        dt2 = dt1;
-      } else if (it == 4) {
-        dt1 = get_uint ();
-        dt2 = get_uint ();
-      } else {
-        error (tl::translate ("Invalid LAYERNAME interval mode (datatype)"));
-      }
-
-      //  and the associated id
-      emit ("LAYERNAME (\"" + name + "\", layers=" + tl::to_string (l1) + ".." + tl::to_string (l2) + ", datatypes=" + tl::to_string (dt1) + ".." + tl::to_string (dt2) + ")");
-      
-    } else if (r == 28 || r == 29 /*PROPERTY*/) {
-
-      if (r == 28) {
-        read_properties ();
-      } else {
-        emit ("PROPERTY (repeat)");
-      }
-
-    } else if (r == 30 || r == 31 /*XNAME*/) {
-
-      emit ("XNAME");
-
-      //  read a XNAME: it is simply ignored
-      get_ulong ();
-      get_str ();
-      if (r == 31) {
-        get_ulong ();
-      }
-
-      emit ("data"); //  TODO: refine
-
-    } else if (r == 13 || r == 14 /*CELL*/) {
-
-      db::cell_index_type cell_index = 0;
-
-      //  read a cell
-      if (r == 13) {
-
-        unsigned long id = 0;
-        get (id);
-
-        emit ("CELL (" + tl::to_string (id) + ")");
-
-      } else {
-
-        std::string name = get_str ();
-        emit ("CELL (\"" + name + "\")");
-
-      }
-
-      do_read_cell ();
-
-    } else if (r == 34 /*CBLOCK*/) {
-
-      emit ("CBLOCK (data will be expanded)");
-
-      unsigned int type = get_uint ();
-      if (type != 0) {
-        error (tl::sprintf (tl::translate ("Invalid CBLOCK compression type %d"), type));
-      }
-
-      size_t uncomp_bytes = 0, comp_bytes = 0;
-      get (uncomp_bytes);
-      get (comp_bytes);
-      emit ("cblock-info (type=" + tl::to_string (type) + ", uncomp-bytes=" + tl::to_string (uncomp_bytes) + ", comp_bytes=" + tl::to_string (comp_bytes) + ")");
-
-      //  put the stream into deflating mode
-      m_stream.inflate ();
+  virtual void rectangle (unsigned int layer, unsigned int datatype, const db::Point & /*pos*/, db::Coord /*w*/, db::Coord /*h*/, const OASISRepetition *rep)
+  {
+    add (layer, datatype, 4, rep);
+  }
 
-    } else {
-      error (tl::sprintf (tl::translate ("Invalid record type on global level %d"), int (r)));
-    }
+  virtual void polygon (unsigned int layer, unsigned int datatype, const db::Point & /*pos*/, const db::Point * /*points*/, size_t n, const OASISRepetition *rep)
+  {
+    add (layer, datatype, n, rep);
+  }
 
+  virtual void path (unsigned int layer, unsigned int datatype, db::Coord /*half_width*/, db::Coord /*bgn_ext*/, db::Coord /*end_ext*/, const db::Point & /*pos*/, const db::Point * /*points*/, size_t n, const OASISRepetition *rep)
+  {
+    add (layer, datatype, n, rep);
   }
 
-  emit ("tail");
+  virtual void trapezoid (unsigned int layer, unsigned int datatype, const db::Point & /*pos*/, db::Coord /*w*/, db::Coord /*h*/, db::Coord /*a*/, db::Coord /*b*/, bool /*vertical*/, const OASISRepetition *rep)
+  {
+    add (layer, datatype, 4, rep);
+  }
 
-  //  check if there are no more bytes
-  mb = (char *) m_stream.get (254);
-  if (mb) {
-    error (tl::translate ("Format error (too many bytes after END record)"));
+  virtual void ctrapezoid (unsigned int layer, unsigned int datatype, unsigned int type, const db::Point & /*pos*/, db::Coord /*w*/, db::Coord /*h*/, const OASISRepetition *rep)
+  {
+    add (layer, datatype, (type >= 16 && type < 24) ? 3 : 4, rep);
   }
-}
 
-void
-OASISDumper::read_element_properties ()
-{
-  while (true) {
+  virtual void circle (unsigned int layer, unsigned int datatype, const db::Point & /*pos*/, db::Coord /*r*/, const OASISRepetition *rep)
+  {
+    add (layer, datatype, 0, rep);
+  }
 
-    unsigned char m = get_byte ();
+  void report (std::string &out) const;
 
-    if (m == 28) {
-      read_properties ();
-    } else if (m != 29) {
-      m_stream.unget (1);
-      break;
-    } else {
-      emit ("PROPERTY (repeat)");
-    }
+private:
+  struct CellCounts
+  {
+    CellCounts () : node (0) { }
 
-  } 
-}
+    uint32_t node;
+    counts_map counts;
+    std::map<uint32_t, uint64_t> placements;
+  };
 
-void 
-OASISDumper::read_properties ()
-{
-  unsigned char m = get_byte ();
+  std::list<CellCounts> m_cells;
+  CellCounts *mp_cell;
+  layer_type m_last_layer;
+  OASISShapeCounts *mp_last;
 
-  if (m & 0x04) {
-    if (m & 0x02) {
-      unsigned long id;
-      get (id);
-      emit ("PROPERTY (id=" + tl::to_string (id) + ")");
-    } else {
-      std::string name;
-      get_str (name);
-      emit ("PROPERTY (name=" + name + ")");
-    }
-  } else {
-    emit ("PROPERTY (same id)");
+  static uint64_t multiplicity (const OASISRepetition *rep)
+  {
+    return rep ? uint64_t (rep->size ()) : 1;
   }
 
-  if (! (m & 0x08)) {
-
-    unsigned long n = ((unsigned long) (m >> 4)) & 0x0f;
-    if (n == 15) {
-      get (n);
+  void add (unsigned int layer, unsigned int datatype, size_t vertices, const OASISRepetition *rep)
+  {
+    if (! mp_cell) {
+      return;
     }
 
-    int index = 0;
-    while (n > 0) {
-
-      unsigned char t = get_byte ();
-      if (t < 8) {
-
-        m_stream.unget (1);
-        double v = get_real ();
-        emit (std::string ("value[") + tl::to_string (index) + "]=" + tl::to_string(v) + " (type " + tl::to_string (int (t)) + ")");
-
-      } else if (t == 8) {
-
-        unsigned long l;
-        get (l);
-        emit (std::string ("value[") + tl::to_string (index) + "]=" + tl::to_string(l) + " (type " + tl::to_string (int (t)) + ")");
-
-      } else if (t == 9) {
-
-        long l;
-        get (l);
-        emit (std::string ("value[") + tl::to_string (index) + "]=" + tl::to_string(l) + " (type " + tl::to_string (int (t)) + ")");
-
-      } else if (t == 10 || t == 11 || t == 12) {
-
-        std::string name;
-        get_str (name);
-        emit (std::string ("value[") + tl::to_string (index) + "]=" + name + " (type " + tl::to_string (int (t)) + ")");
-
-      } else if (t == 13 || t == 14 || t == 15) {
-
-        unsigned long id;
-        get (id);
-        emit (std::string ("value[") + tl::to_string (index) + "]=" + tl::to_string(id) + " (propstring-ref, type " + tl::to_string (int (t)) + ")");
-
-      } else {
-        error (tl::sprintf (tl::translate ("Invalid property value type %d"), int (t)));
-      }
+    //  consecutive shapes are usually on the same layer
+    layer_type l (layer, datatype);
+    if (! mp_last || m_last_layer != l) {
+      m_last_layer = l;
+      mp_last = &mp_cell->counts [l];
+    }
 
-      --n;
-      ++index;
+    uint64_t n = multiplicity (rep);
+    mp_last->shapes += n;
+    mp_last->vertices += n * uint64_t (vertices);
+  }
 
-    }
+  static void add_counts (counts_map &counts, const counts_map &other, uint64_t n);
+  static void print_counts (std::string &out, const counts_map &counts, const counts_map *flat);
+};
 
+void
+OASISShapeCounter::add_counts (counts_map &counts, const counts_map &other, uint64_t n)
+{
+  for (counts_map::const_iterator i = other.begin (); i != other.end (); ++i) {
+    counts [i->first].add (i->second, n);
   }
 }
 
-      
-void 
-OASISDumper::read_pointlist ()
+void
+OASISShapeCounter::print_counts (std::string &out, const counts_map &counts, const counts_map *flat)
 {
-  unsigned int type = get_uint ();
-
-  emit ("pointlist (type=" + tl::to_string (type) + ")");
-  
-  unsigned long n = 0;
-  get (n);
-  if (n == 0) {
-    error (tl::translate ("Invalid point list: length is zero").c_str ());
+  std::set<layer_type> layers;
+  for (counts_map::const_iterator i = counts.begin (); i != counts.end (); ++i) {
+    layers.insert (i->first);
   }
-
-  if (type == 0 || type == 1) {
-
-    bool h = (type == 0);
-
-    db::Point pos;
-    for (unsigned long i = 0; i < n; ++i) {
-      db::Coord d = get_coord ();
-      if (h) {
-        pos += db::Point (d, 0);
-      } else {
-        pos += db::Point (0, d);
-      }
-      emit ("  xy=" + pos.to_string ());
-      h = ! h;
+  if (flat) {
+    for (counts_map::const_iterator i = flat->begin (); i != flat->end (); ++i) {
+      layers.insert (i->first);
     }
+  }
 
-  } else if (type == 2) {
-
-    db::Point pos;
-    for (unsigned long i = 0; i < n; ++i) {
-      pos += get_2delta ();
-      emit ("  xy=" + pos.to_string ());
-    }
+  OASISShapeCounts total, flat_total;
+  OASISShapeCounts none;
 
-  } else if (type == 3) {
+  for (std::set<layer_type>::const_iterator l = layers.begin (); l != layers.end (); ++l) {
 
-    db::Point pos;
-    for (unsigned long i = 0; i < n; ++i) {
-      pos += get_3delta ();
-      emit ("  xy=" + pos.to_string ());
-    }
+    std::string ld = tl::to_string (l->first) + "/" + tl::to_string (l->second);
 
-  } else if (type == 4) {
+    counts_map::const_iterator c = counts.find (*l);
+    const OASISShapeCounts &cc = (c != counts.end () ? c->second : none);
+    total.add (cc, 1);
 
-    db::Point pos;
-    for (unsigned long i = 0; i < n; ++i) {
-      pos += get_gdelta ();
-      emit ("  xy=" + pos.to_string ());
+    if (flat) {
+      counts_map::const_iterator fc = flat->find (*l);
+      const OASISShapeCounts &fcc = (fc != flat->end () ? fc->second : none);
+      flat_total.add (fcc, 1);
+      out += tl::sprintf ("  %-16s %16lu %16lu %16lu %16lu\n", ld, cc.shapes, cc.vertices, fcc.shapes, fcc.vertices);
+    } else {
+      out += tl::sprintf ("  %-16s %16lu %16lu\n", ld, cc.shapes, cc.vertices);
     }
 
-  } else if (type == 5) {
-
-    db::Point pos;
-    db::Point delta;
-    for (unsigned long i = 0; i < n; ++i) {
-      delta += get_gdelta ();
-      pos += delta;
-      emit ("  xy=" + pos.to_string ());
-    }
+  }
 
+  if (flat) {
+    out += tl::sprintf ("  %-16s %16lu %16lu %16lu %16lu\n", "total", total.shapes, total.vertices, flat_total.shapes, flat_total.vertices);
   } else {
-    error (tl::sprintf (tl::translate ("Invalid point list type %d"), type));
+    out += tl::sprintf ("  %-16s %16lu %16lu\n", "total", total.shapes, total.vertices);
   }
 }
 
 void
-OASISDumper::read_repetition ()
+OASISShapeCounter::report (std::string &out) const
 {
-  unsigned int type = get_uint ();
-  emit ("repetition (type=" + tl::to_string (type) + ")");
-  
-  if (type == 0) {
-    
-    //  reuse modal variable
-
-  } else if (type == 1) {
-
-    unsigned long nx = 0, ny = 0;
-    get (nx); 
-    emit ("  nx=" + tl::to_string (nx));
-    get (ny);
-    emit ("  ny=" + tl::to_string (ny));
-
-    db::Coord dx = get_ucoord ();
-    emit ("  dx=" + tl::to_string (dx));
-    db::Coord dy = get_ucoord ();
-    emit ("  dy=" + tl::to_string (dy));
-
-  } else if (type == 2) {
-
-    unsigned long nx = 0;
-    get (nx); 
-    emit ("  nx=" + tl::to_string (nx));
-
-    db::Coord dx = get_ucoord ();
-    emit ("  dx=" + tl::to_string (dx));
-
-  } else if (type == 3) {
-
-    unsigned long ny = 0;
-    get (ny);
-    emit ("  ny=" + tl::to_string (ny));
-
-    db::Coord dy = get_ucoord ();
-    emit ("  dy=" + tl::to_string (dy));
-
-  } else if (type == 4 || type == 5) {
-    
-    unsigned long n = 0;
-    get (n);
-    emit ("  n=" + tl::to_string (n));
-
-    unsigned long lgrid = 1;
-    if (type == 5) {
-      get (lgrid);
-      emit ("  grid=" + tl::to_string (lgrid));
-    }
+  db::HierarchyGraph graph;
+  std::vector<size_t> graph_nodes;
+  resolve (graph, graph_nodes);
 
-    db::Coord x = 0;
-    for (unsigned long i = 0; i <= n; ++i) {
-      x += get_ucoord (lgrid);
-      emit ("  x=" + tl::to_string (x));
+  //  "cells" lists the defined cells in the order of their definition - a cell defined 
+  //  more than once is listed once with the counts of all definitions
+  std::vector<counts_map> counts (graph.size ());
+  std::vector<size_t> cells;
+  for (std::list<CellCounts>::const_iterator c = m_cells.begin (); c != m_cells.end (); ++c) {
+    size_t n = graph_nodes [c->node];
+    if (! graph.defined (n)) {
+      graph.set_defined (n);
+      cells.push_back (n);
     }
-
-  } else if (type == 6 || type == 7) {
-    
-    unsigned long n = 0;
-    get (n);
-    emit ("  n=" + tl::to_string (n));
-
-    unsigned long lgrid = 1;
-    if (type == 7) {
-      get (lgrid);
-      emit ("  grid=" + tl::to_string (lgrid));
+    add_counts (counts [n], c->counts, 1);
+    for (std::map<uint32_t, uint64_t>::const_iterator p = c->placements.begin (); p != c->placements.end (); ++p) {
+      graph.add_child (n, graph_nodes [p->first], p->second);
     }
+  }
 
-    db::Coord y = 0;
-    for (unsigned long i = 0; i <= n; ++i) {
-      y += get_ucoord (lgrid);
-      emit ("  y=" + tl::to_string (y));
-    }
-
-  } else if (type == 8) {
-
-    unsigned long n = 0, m = 0;
-
-    get (n); 
-    emit ("  n=" + tl::to_string (n));
-    get (m);
-    emit ("  m=" + tl::to_string (m));
-    db::Point dn = get_gdelta (); 
-    emit ("  dn=" + tl::to_string (dn));
-    db::Point dm = get_gdelta (); 
-    emit ("  dm=" + tl::to_string (dm));
-
-  } else if (type == 9) {
-
-    unsigned long n = 0;
-    get (n); 
-    emit ("  n=" + tl::to_string (n));
-    db::Point dn = get_gdelta (); 
-    emit ("  dn=" + tl::to_string (dn));
-
-  } else if (type == 10) {
-
-    unsigned long n = 0;
-    get (n);
-    emit ("  n=" + tl::to_string (n));
+  graph.finish ();
 
-    db::Point p;
-    for (unsigned long i = 0; i <= n; ++i) {
-      p += get_gdelta ();
-      emit ("  xy=" + p.to_string ());
+  //  children come first, so their flattened counts are complete when the parents need them
+  std::vector<counts_map> flat (graph.size ());
+  for (std::vector<size_t>::const_iterator i = graph.bottom_up ().begin (); i != graph.bottom_up ().end (); ++i) {
+    flat [*i] = counts [*i];
+    for (db::HierarchyGraph::children_type::const_iterator c = graph.children (*i).begin (); c != graph.children (*i).end (); ++c) {
+      add_counts (flat [*i], flat [c->first], c->second);
     }
+  }
 
-  } else if (type == 11) {
-
-    unsigned long n = 0;
-    get (n);
-    emit ("  n=" + tl::to_string (n));
+  std::string header = tl::sprintf ("  %-16s %16s %16s", "layer/datatype", "shapes", "vertices");
 
-    unsigned long grid = 0;
-    get (grid);
-    emit ("  grid=" + tl::to_string (grid));
+  for (std::vector<size_t>::const_iterator i = cells.begin (); i != cells.end (); ++i) {
+    out += "cell " + graph.name (*i) + "\n";
+    out += header + tl::sprintf (" %16s %16s\n", "flat shapes", "flat vertices");
+    print_counts (out, counts [*i], &flat [*i]);
+    out += "\n";
+  }
 
-    db::Point p;
-    for (unsigned long i = 0; i <= n; ++i) {
-      p += get_gdelta (grid);
-      emit ("  xy=" + p.to_string ());
+  //  the flattened layout is the sum of the flattened top cells
+  counts_map layout;
+  for (size_t i = 0; i < graph.size (); ++i) {
+    if (graph.is_top (i)) {
+      add_counts (layout, flat [i], 1);
     }
-
-  } else {
-    error (tl::sprintf (tl::translate ("Invalid repetition type %d"), type));
   }
-}
-
-void 
-OASISDumper::do_read_placement (unsigned int r)
-{
-  unsigned char m = get_byte ();
-  emit ("PLACEMENT");
-
-  //  locate cell
-  if (m & 0x80) {
-
-    if (m & 0x40) {
-
-      //  cell by id
-      unsigned long id;
-      get (id);
 
-      emit ("id=" + tl::to_string (id));
+  out += "flattened layout (top cells: " + graph.top_cell_names () + ")\n";
+  out += header + "\n";
+  print_counts (out, layout, 0);
+}
 
-    } else {
+// ---------------------------------------------------------------
+//  OASISHierarchy definition and implementation
 
-      //  cell by name
-      std::string name;
-      get_str (name);
-      emit ("name=" + name);
+/**
+ *  @brief A visitor collecting the placement hierarchy
+ *
+ *  Every cell (defined or referenced) is a node. A node stores the list of child
+ *  nodes with their instance counts, which are merged at the end of the cell. 
+ *  Names are stored once per node, so the memory does not grow with the number
+ *  of placements. Repetitions count with their instance count.
+ */
+class OASISHierarchy
+  : public OASISCellNodes
+{
+public:
+  OASISHierarchy ()
+    : m_current (0), m_in_cell (false)
+  { }
 
+  virtual void begin_cell (const OASISName &cell)
+  {
+    m_current = node (cell);
+    if (m_current >= m_children.size ()) {
+      m_children.resize (m_current + 1);
+      m_defined.resize (m_current + 1, false);
     }
+    m_in_cell = true;
+    m_defined [m_current] = true;
+  }
 
-  } 
-
-  if (r == 18) {
-
-    if (m & 0x04) {
-      double mag = get_real ();
-      emit ("mag=" + tl::to_string (mag));
+  virtual void end_cell ()
+  {
+    if (m_in_cell) {
+      db::HierarchyGraph::merge (m_children [m_current]);
     }
+    m_in_cell = false;
+  }
 
-    if (m & 0x02) {
-      double angle_deg = get_real ();
-      emit ("angle=" + tl::to_string (angle_deg));
+  virtual void placement (const OASISName &cell, const db::Point & /*pos*/, double /*mag*/, double /*angle*/, bool /*mirror*/, const OASISRepetition *rep)
+  {
+    if (! m_in_cell) {
+      return;
     }
 
-  }
-      
-  // bool mirror = (m & 0x01) != 0;
+    uint32_t child = node (cell);
+    uint64_t n = rep ? uint64_t (rep->size ()) : 1;
 
-  if (m & 0x20) {
-    db::Coord x;
-    get (x);
-    emit ("x=" + tl::to_string (x));
-  }
-
-  if (m & 0x10) {
-    db::Coord y;
-    get (y);
-    emit ("y=" + tl::to_string (y));
+    //  consecutive placements often refer to the same cell
+    db::HierarchyGraph::children_type &children = m_children [m_current];
+    if (! children.empty () && children.back ().first == child) {
+      children.back ().second += n;
+    } else {
+      children.push_back (db::HierarchyGraph::child_type (child, n));
+    }
   }
 
-  if (m & 0x8) {
-    read_repetition ();
-  } 
+  void report (std::string &out) const;
 
-  read_element_properties ();
-}
+private:
+  //  the children and the defined flag per node (for the nodes up to the last cell defined)
+  std::vector<db::HierarchyGraph::children_type> m_children;
+  std::vector<bool> m_defined;
+  uint32_t m_current;
+  bool m_in_cell;
+};
 
-void 
-OASISDumper::do_read_text ()
+void
+OASISHierarchy::report (std::string &out) const
 {
-  unsigned char m = get_byte ();
+  //  references by ID and by name are unified through the cell names
+  db::HierarchyGraph graph;
+  std::vector<size_t> graph_nodes;
+  resolve (graph, graph_nodes);
 
-  emit ("TEXT");
-
-  if (m & 0x40) {
-    if (m & 0x20) {
-      unsigned long id;
-      get (id);
-      emit ("id=" + tl::to_string (id));
-    } else {
-      std::string t = get_str ();
-      emit ("Text=" + t);
+  for (size_t i = 0; i < m_children.size (); ++i) {
+    size_t n = graph_nodes [i];
+    if (m_defined [i]) {
+      graph.set_defined (n);
+    }
+    for (db::HierarchyGraph::children_type::const_iterator c = m_children [i].begin (); c != m_children [i].end (); ++c) {
+      graph.add_child (n, graph_nodes [c->first], c->second);
     }
-  } 
-
-  if (m & 0x1) {
-    unsigned int l = get_uint ();
-    emit ("layer=" + tl::to_string (l));
   }
 
-  if (m & 0x2) {
-    unsigned int dt = get_uint ();
-    emit ("texttype=" + tl::to_string (dt));
-  }
+  graph.finish ();
 
-  if (m & 0x10) {
-    db::Coord x;
-    get (x);
-    emit ("x=" + tl::to_string (x));
+  out += tl::sprintf ("%16s %6s %14s %10s  %s\n", "flat instances", "depth", "placements", "children", "cell");
+  for (size_t i = 0; i < graph.size (); ++i) {
+    out += tl::sprintf ("%16lu %6u %14lu %10lu  %s%s\n", graph.instances (i), graph.depth (i), graph.placements (i), graph.children (i).size (), graph.name (i), graph.defined (i) ? "" : " (undefined)");
   }
+  out += "\n";
 
-  if (m & 0x8) {
-    db::Coord y;
-    get (y);
-    emit ("y=" + tl::to_string (y));
-  }
+  out += "top cells: " + graph.top_cell_names () + "\n";
 
-  if (m & 0x4) {
-    read_repetition ();
+  for (size_t i = 0; i < graph.size (); ++i) {
+    if (! graph.defined (i)) {
+      out += "undefined reference: " + graph.name (i) + " (from " + graph.parent_names (i) + ")\n";
+    }
   }
+}
+
+// ---------------------------------------------------------------
+//  OASISDumper implementation
 
-  read_element_properties ();
+OASISDumper::OASISDumper (tl::InputStreamBase &s)
+  : mp_source (&s), m_parser (s), mp_output (0), m_threads (1), m_select (false), m_range (false)
+{
+  //  .. nothing yet ..
 }
 
 void 
-OASISDumper::do_read_rectangle ()
+OASISDumper::dump ()
 {
-  unsigned char m = get_byte ();
-
-  emit ("RECTANGLE");
-
-  if (m & 0x1) {
-    unsigned int l = get_uint ();
-    emit ("layer=" + tl::to_string (l));
-  }
-
-  if (m & 0x2) {
-    unsigned int dt = get_uint ();
-    emit ("datatype=" + tl::to_string (dt));
-  }
-
-  if (m & 0x40) {
-    db::Coord w = get_ucoord ();
-    emit ("width=" + tl::to_string (w));
-  } 
-  if (m & 0x80) {
-    //  ..
+  if (m_threads > 1 && ! m_select && ! m_range && mp_source->mapped_data ()) {
+    dump_parallel ();
   } else {
-    if (m & 0x20) {
-      db::Coord h = get_ucoord ();
-      emit ("height=" + tl::to_string (h));
-    } 
+    m_parser.parse (*this);
   }
-
-  if (m & 0x10) {
-    db::Coord x;
-    get (x);
-    emit ("x=" + tl::to_string (x));
-  }
-
-  if (m & 0x8) {
-    db::Coord y;
-    get (y);
-    emit ("y=" + tl::to_string (y));
-  }
-
-  if (m & 0x4) {
-    read_repetition ();
-  }
-
-  read_element_properties ();
 }
 
-void  
-OASISDumper::do_read_polygon ()
+void 
+OASISDumper::dump_statistics ()
 {
-  unsigned char m = get_byte ();
-  emit ("POLYGON");
-
-  if (m & 0x1) {
-    unsigned int l = get_uint ();
-    emit ("layer=" + tl::to_string (l));
-  }
+  OASISStatistics stat;
+  m_parser.parse (stat);
 
-  if (m & 0x2) {
-    unsigned int dt = get_uint ();
-    emit ("datatype=" + tl::to_string (dt));
-  }
-
-  if (m & 0x20) {
-    read_pointlist ();
-  }
+  std::string out;
+  stat.report (out);
+  write (out.c_str (), out.size ());
+}
 
-  if (m & 0x10) {
-    db::Coord x;
-    get (x);
-    emit ("x=" + tl::to_string (x));
-  }
+void 
+OASISDumper::dump_shape_counts ()
+{
+  OASISShapeCounter counter;
+  m_parser.parse (counter);
 
-  if (m & 0x8) {
-    db::Coord y;
-    get (y);
-    emit ("y=" + tl::to_string (y));
-  }
+  std::string out;
+  counter.report (out);
+  write (out.c_str (), out.size ());
+}
 
-  if (m & 0x4) {
-    read_repetition ();
-  }
+void 
+OASISDumper::dump_hierarchy ()
+{
+  OASISHierarchy hierarchy;
+  m_parser.parse (hierarchy);
 
-  read_element_properties ();
+  std::string out;
+  hierarchy.report (out);
+  write (out.c_str (), out.size ());
 }
 
-void  
-OASISDumper::do_read_path ()
+void
+OASISDumper::dump_range (const OASISResumePosition *from, const OASISResumePosition *to)
 {
-  unsigned char m = get_byte ();
-  emit ("PATH");
+  m_parser.parse_range (*this, from, to);
+}
 
-  if (m & 0x1) {
-    unsigned int l = get_uint ();
-    emit ("layer=" + tl::to_string (l));
-  }
+void
+OASISDumper::dump_parallel ()
+{
+  const char *data = mp_source->mapped_data ();
+  size_t size = mp_source->mapped_size ();
 
-  if (m & 0x2) {
-    unsigned int dt = get_uint ();
-    emit ("datatype=" + tl::to_string (dt));
+  //  find the cells with a quick scan - this reads the whole file before the output starts. 
+  //  On errors, the serial dump reports them at the right place.
+  std::vector<OASISResumePosition> cells;
+  try {
+    tl::InputMemoryStream mem (data, size);
+    OASISParser scanner (mem);
+    scanner.set_threads (m_threads);
+    scanner.scan_cells (cells);
+  } catch (tl::Exception &) {
+    cells.clear ();
   }
 
-  if (m & 0x40) {
-    db::Coord w = get_ucoord ();
-    emit ("half_width=" + tl::to_string (w));
+  if (cells.empty ()) {
+    m_parser.parse (*this);
+    return;
   }
 
-  if (m & 0x80) {
+  //  Small cells are combined into parts of a reasonable size. The jobs keep the output
+  //  of a part in memory, so larger parts are dumped by this thread, writing the output
+  //  directly. A cell larger than that forms a part of its own.
+  const size_t min_part_size = 256 * 1024;
+  const size_t max_part_size = std::max (min_part_size, std::min (size / m_threads, size_t (64 * 1024 * 1024)));
 
-    unsigned int e = get_uint ();
-    emit ("extensions (type=" + tl::to_string (e) + ")");
-    db::Coord ext1 = 0, ext2 = 0;
-    if ((e & 0x0c) == 0x0c) {
-      db::Coord e1 = get_coord ();
-      emit ("  e1=" + tl::to_string (e1));
+  std::vector<const OASISResumePosition *> bounds;
+  bounds.push_back (0);
+  size_t last_offset = 0;
+  for (std::vector<OASISResumePosition>::const_iterator c = cells.begin (); c != cells.end (); ++c) {
+    size_t cell_end = (c + 1 != cells.end () ? size_t ((c + 1)->offset) : size);
+    bool large_cell = (cell_end - c->offset > max_part_size);
+    if (c->offset >= last_offset + min_part_size || (large_cell && c->offset > last_offset)) {
+      bounds.push_back (&*c);
+      last_offset = c->offset;
     }
-    if ((e & 0x03) == 0x03) {
-      db::Coord e2 = get_coord ();
-      emit ("  e2=" + tl::to_string (e2));
-    }
-
-  }
-
-  if (m & 0x20) {
-    read_pointlist ();
-  }
-
-  if (m & 0x10) {
-    db::Coord x;
-    get (x);
-    emit ("x=" + tl::to_string (x));
   }
+  bounds.push_back (0);
 
-  if (m & 0x8) {
-    db::Coord y;
-    get (y);
-    emit ("y=" + tl::to_string (y));
-  }
+  tl::ThreadPool pool (m_threads);
 
-  if (m & 0x4) {
-    read_repetition ();
-  }
+  size_t max_pending = 2 * size_t (m_threads);
 
-  read_element_properties ();
-}
+  //  the parts in output order - true for parts dumped by a job, false for parts dumped here
+  std::deque<std::pair<size_t, bool> > parts;
 
-void  
-OASISDumper::do_read_trapezoid (unsigned char r)
-{
-  unsigned char m = get_byte ();
-  emit ("TRAPEZOID");
+  for (size_t i = 0; i + 1 < bounds.size () || ! parts.empty (); ) {
 
-  if (m & 0x1) {
-    unsigned int l = get_uint ();
-    emit ("layer=" + tl::to_string (l));
-  }
+    //  keep the pool busy, but limit the memory for the pending output
+    if (i + 1 < bounds.size () && pool.pending () < max_pending) {
+      size_t part_end = bounds [i + 1] ? size_t (bounds [i + 1]->offset) : size;
+      size_t part_begin = bounds [i] ? size_t (bounds [i]->offset) : 0;
+      bool in_job = (part_end - part_begin <= max_part_size);
+      if (in_job) {
+        pool.submit (new OASISDumpJob (data, size, bounds [i], bounds [i + 1], m_formatter));
+      }
+      parts.push_back (std::make_pair (i, in_job));
+      ++i;
+      continue;
+    }
 
-  if (m & 0x2) {
-    unsigned int dt = get_uint ();
-    emit ("datatype=" + tl::to_string (dt));
-  }
+    std::pair<size_t, bool> part = parts.front ();
+    parts.pop_front ();
 
-  if (m & 0x40) {
-    db::Coord w = get_ucoord ();
-    emit ("w=" + tl::to_string (w));
-  }
+    if (! part.second) {
+      //  the jobs continue with the following parts meanwhile
+      dump_range (bounds [part.first], bounds [part.first + 1]);
+      continue;
+    }
 
-  if (m & 0x20) {
-    db::Coord h = get_ucoord ();
-    emit ("h=" + tl::to_string (h));
-  }
+    std::unique_ptr<OASISDumpJob> job (dynamic_cast<OASISDumpJob *> (pool.wait_next ()));
+    if (! job.get ()) {
+      break;
+    }
 
-  if (r == 23 || r == 24) {
-    db::Coord a = get_coord ();
-    emit ("a=" + tl::to_string (a));
-  }
-  if (r == 23 || r == 25) {
-    db::Coord b = get_coord ();
-    emit ("b=" + tl::to_string (b));
-  }
+    const std::string &out = job->dumper ().data ();
+    const std::vector<OASISDumpWarning> &warnings = job->dumper ().warnings ();
 
-  if (m & 0x10) {
-    db::Coord x;
-    get (x);
-    emit ("x=" + tl::to_string (x));
-  }
+    size_t written = 0;
+    for (std::vector<OASISDumpWarning>::const_iterator w = warnings.begin (); w != warnings.end (); ++w) {
+      write (out.c_str () + written, w->output_pos - written);
+      written = w->output_pos;
+      OASISDumper::warn (w->msg, w->pos);
+    }
+    write (out.c_str () + written, out.size () - written);
 
-  if (m & 0x8) {
-    db::Coord y;
-    get (y);
-    emit ("y=" + tl::to_string (y));
-  }
+    if (job->failed ()) {
+      throw tl::Exception (job->error ());
+    }
 
-  if (m & 0x4) {
-    read_repetition ();
   }
-
-  read_element_properties ();
 }
 
-void  
-OASISDumper::do_read_ctrapezoid ()
+void
+OASISDumper::write (const char *data, size_t n)
 {
-  unsigned char m = get_byte ();
-  emit ("CTRAPEZOID");
-
-  if (m & 0x1) {
-    unsigned int l = get_uint ();
-    emit ("layer=" + tl::to_string (l));
-  }
-
-  if (m & 0x2) {
-    unsigned int dt = get_uint ();
-    emit ("datatype=" + tl::to_string (dt));
-  }
-
-  if (m & 0x80) {
-    unsigned int type = get_uint ();
-    emit ("type=(" + tl::to_string (type));
-  }
-
-  if (m & 0x40) {
-    db::Coord w = get_ucoord ();
-    emit ("w=" + tl::to_string (w));
-  }
-
-  if (m & 0x20) {
-    db::Coord h = get_ucoord ();
-    emit ("h=" + tl::to_string (h));
-  }
-
-  if (m & 0x10) {
-    db::Coord x;
-    get (x);
-    emit ("x=" + tl::to_string (x));
-  }
-
-  if (m & 0x8) {
-    db::Coord y;
-    get (y);
-    emit ("y=" + tl::to_string (y));
-  }
-
-  if (m & 0x4) {
-    read_repetition ();
+  if (mp_output) {
+    mp_output->put (data, n);
+  } else {
+    std::cout.write (data, n);
   }
-
-  read_element_properties ();
 }
 
-void  
-OASISDumper::do_read_circle ()
+void 
+OASISDumper::warn (const std::string &msg, size_t pos) 
 {
-  unsigned char m = get_byte ();
-  emit ("CIRCLE");
-
-  if (m & 0x1) {
-    unsigned int l = get_uint ();
-    emit ("layer=" + tl::to_string (l));
-  }
-
-  if (m & 0x2) {
-    unsigned int dt = get_uint ();
-    emit ("datatype=" + tl::to_string (dt));
-  }
-
-  if (m & 0x20) {
-    db::Coord r = get_ucoord ();
-    emit ("r=" + tl::to_string (r));
-  }
-
-  if (m & 0x10) {
-    db::Coord x;
-    get (x);
-    emit ("x=" + tl::to_string (x));
-  }
-
-  if (m & 0x8) {
-    db::Coord y;
-    get (y);
-    emit ("y=" + tl::to_string (y));
-  }
-
-  if (m & 0x4) {
-    read_repetition ();
+  //  write the pending output first, so the warning shows up at the right place
+  if (mp_output) {
+    mp_output->flush ();
+  } else {
+    std::cout.flush ();
   }
 
-  read_element_properties ();
+  OASISVisitor::warn (msg, pos);
 }
 
-void 
-OASISDumper::do_read_cell ()
+void
+OASISDumper::trace (size_t pos, const char *data, size_t n, const std::string &msg)
 {
-  bool xy_absolute = true;
-
-  //  read next record
-  while (true) {
+  m_formatter.clear ();
+  m_formatter.format (pos, data, n, msg);
 
-    unsigned char r = get_byte ();
-
-    if (r == 0 /*PAD*/) {
-
-      //  simply skip.
-
-    } else if (r == 15 /*XYABSOLUTE*/) {
-
-      //  switch to absolute mode
-      xy_absolute = true;
-      emit ("XYABSOLUTE");
-
-    } else if (r == 16 /*XYRELATIVE*/) {
-
-      //  switch to relative mode
-      xy_absolute = false;
-      emit ("XYRELATIVE");
-
-    } else if (r == 17 || r == 18 /*PLACEMENT*/) {
-
-      do_read_placement (r);
-
-    } else if (r == 19 /*TEXT*/) {
-
-      do_read_text ();
-
-    } else if (r == 20 /*RECTANGLE*/) {
-
-      do_read_rectangle ();
-
-    } else if (r == 21 /*POLYGON*/) {
-
-      do_read_polygon ();
-
-    } else if (r == 22 /*PATH*/) {
-
-      do_read_path ();
-
-    } else if (r == 23 || r == 24 || r == 25 /*TRAPEZOID*/) {
-
-      do_read_trapezoid (r);
-
-    } else if (r == 26 /*CTRAPEZOID*/) {
-
-      do_read_ctrapezoid ();
-
-    } else if (r == 27 /*CIRCLE*/) {
-
-      do_read_circle ();
-
-    } else if (r == 28 || r == 29 /*PROPERTY*/) {
-
-      if (r == 28) {
-        read_properties ();
-      } else {
-        emit ("PROPERTY (repeat)");
-      }
-
-    } else if (r == 32 /*XELEMENT*/) {
-
-      //  read over
-      get_ulong ();
-      get_str ();
-      emit ("XELEMENT");
-
-    } else if (r == 33 /*XGEOMETRY*/) {
-
-      //  read over.
-
-      unsigned char m = get_byte ();
-      emit ("XGEOMTERY");
-
-      unsigned int a = get_uint ();
-      emit ("attribute=" + tl::to_string (a));
-
-      if (m & 0x1) {
-        unsigned int l = get_uint ();
-        emit ("layer=" + tl::to_string (l));
-      }
-
-      if (m & 0x2) {
-        unsigned int dt = get_uint ();
-        emit ("datatype=" + tl::to_string (dt));
-      }
-
-      //  data payload:
-      get_str ();
-      emit ("data");
-
-      if (m & 0x10) {
-        db::Coord x;
-        get (x);
-        emit ("x=" + tl::to_string (x));
-      }
-
-      if (m & 0x8) {
-        db::Coord y;
-        get (y);
-        emit ("y=" + tl::to_string (y));
-      }
-
-      if (m & 0x4) {
-        read_repetition ();
-      }
-
-    } else if (r == 34 /*CBLOCK*/) {
-
-      emit ("CBLOCK (data will be expanded)");
-
-      unsigned int type = get_uint ();
-      if (type != 0) {
-        error (tl::sprintf (tl::translate ("Invalid CBLOCK compression type %d"), type));
-      }
-
-      size_t uncomp_bytes = 0, comp_bytes = 0;
-      get (uncomp_bytes);
-      get (comp_bytes);
-      emit ("cblock-info (type=" + tl::to_string (type) + ", uncomp-bytes=" + tl::to_string (uncomp_bytes) + ", comp_bytes=" + tl::to_string (comp_bytes) + ")");
-
-      //  put the stream into deflating mode
-      m_stream.inflate ();
-
-    } else {
-      //  put the byte back into the stream
-      m_stream.unget (1);
-      break;
-    }
-
-  }
+  write (m_formatter.data (), m_formatter.size ());
 }
 
 }
@@ -24,53 +24,36 @@
 #ifndef HDR_dbOASISDumper
 #define HDR_dbOASISDumper
 
-#include "tlException.h"
+#include "dbOASISParser.h"
 #include "tlStream.h"
-#include "dbTypes.h"
-#include "dbPoint.h"
-
-#include <map>
-#include <set>
+#include "tlHexDump.h"
 
 namespace db
 {
 
 /**
- *  @brief Generic base class of OASIS reader exceptions
- */
-class KLAYOUT_DLL OASISDumperException
-  : public tl::Exception
-{
-public:
-  OASISDumperException (const std::string &msg, size_t p, const std::string &cell)
-    : tl::Exception (tl::sprintf (tl::translate ("%s (position=%ld, cell=%s)"), msg, p, cell))
-  { }
-};
-
-/**
- *  @brief The OASIS format stream reader
+ *  @brief The OASIS dumper
+ *
+ *  The dumper is a visitor of the OASIS parser which prints every field 
+ *  together with the bytes it was read from.
  */
 class KLAYOUT_DLL OASISDumper
+  : public OASISVisitor
 {
 public: 
   /**
-   *  @brief Construct a stream reader object
+   *  @brief Construct a dumper object
    *
    *  @param s The stream delegate from which to read stream data from
    */
   OASISDumper (tl::InputStreamBase &s);
 
-  /**  
-   *  @brief Destructor
-   */
-  ~OASISDumper ();
-
   /**
    *  @brief Set short mode
    */
   void short_mode (bool s)
   {
-    m_short_mode = s;
+    m_formatter.set_short_mode (s);
   }
 
   /**
@@ -78,114 +61,159 @@ public:
    */
   void set_width (size_t w)
   {
-    m_width = w;
+    m_formatter.set_width (w);
   }
 
-  /** 
-   *  @brief The basic dumper method 
-   */
-  void dump ();
-
   /**
-   *  @brief Issue an error with positional informations
+   *  @brief Set the output stream
    *
-   *  Reimplements OASISDiagnostics
+   *  If no output stream is set, the output goes to std::cout.
+   *  The dumper does not take ownership of the stream.
    */
-  void error (const std::string &txt);
+  void set_output (tl::OutputStream *out)
+  {
+    mp_output = out;
+  }
 
   /**
-   *  @brief Issue a warning with positional informations
+   *  @brief Set the number of threads
    *
-   *  Reimplements OASISDiagnostics
+   *  With more than one thread, the CBLOCKs are inflated in the background 
+   *  (see OASISParser::set_threads) and the cells are formatted in parallel
+   *  (see "dump").
    */
-  void warn (const std::string &txt);
-
-private:
-  tl::InputStream m_stream;
-  size_t m_last_emit;
-  size_t m_width;
-  bool m_short_mode;
-
-  void do_read ();
-  void do_read_cell ();
-  void do_read_placement (unsigned int r);
-
-  void do_read_text ();
-  void do_read_rectangle ();
-  void do_read_polygon ();
-  void do_read_path ();
-  void do_read_trapezoid (unsigned char r);
-  void do_read_ctrapezoid ();
-  void do_read_circle ();
-
-  void read_repetition ();
-  void read_pointlist ();
-  void read_properties ();
-  void read_element_properties ();
-
-  void emit (const std::string &msg);
-
-  unsigned char get_byte ()
+  void set_threads (unsigned int n)
   {
-    unsigned char *b = (unsigned char *) m_stream.get (1);
-    if (! b) {
-      error (tl::translate ("Unexpected end-of-file"));
-      return 0;
-    } else {
-      return *b;
-    }
+    m_threads = n;
+    m_parser.set_threads (n);
   }
 
-  long long get_long_long ();
-  unsigned long long get_ulong_long ();
-  long get_long ();
-  unsigned long get_ulong ();
-  int get_int ();
-  unsigned int get_uint ();
-
-  void get (long long &l)
+  /**
+   *  @brief Dump only the cell with the given name
+   *
+   *  See OASISParser::select_cell for details.
+   */
+  void select_cell (const std::string &name)
   {
-    l = get_long_long ();
+    m_select = true;
+    m_parser.select_cell (name);
   }
 
-  void get (unsigned long long &l)
+  /**
+   *  @brief Dump only the cell with the given CELLNAME ID
+   *
+   *  See OASISParser::select_cell_id for details.
+   */
+  void select_cell_id (unsigned long id)
   {
-    l = get_ulong_long ();
+    m_select = true;
+    m_parser.select_cell_id (id);
   }
 
-  void get (long &l)
+  /**
+   *  @brief Dump only the records in the given range of file offsets
+   *
+   *  See OASISParser::set_byte_range for details.
+   */
+  void set_byte_range (size_t from, size_t to)
   {
-    l = get_long ();
+    m_range = true;
+    m_parser.set_byte_range (from, to);
   }
 
-  void get (unsigned long &l)
+  /**
+   *  @brief Set a cell index for locating the selected cell
+   *
+   *  See OASISParser::set_index for details.
+   */
+  void set_index (const CellIndex *index)
   {
-    l = get_ulong ();
+    m_parser.set_index (index);
   }
 
-  void get (int &l)
+  /**
+   *  @brief Collect the cell positions into the given index instead of dumping
+   */
+  void build_index (CellIndex &index)
   {
-    l = get_int ();
+    m_parser.build_index (index);
   }
 
-  void get (unsigned int &l)
-  {
-    l = get_uint ();
-  }
+  /** 
+   *  @brief The basic dumper method 
+   *
+   *  With more than one thread and an input which provides the file as a memory
+   *  block, the file is scanned for the CELL records first. The parts between the
+   *  cells are formatted by a pool of threads into separate buffers. The buffers 
+   *  are written in file order, so the output is the same as in the serial case.
+   */
+  void dump ();
+
+  /**
+   *  @brief Prints statistics instead of the dump
+   *
+   *  The statistics list the number of records and bytes per record type, the 
+   *  bytes per cell and the compressed and uncompressed size of every CBLOCK.
+   *  No field is formatted, so this is much faster than "dump".
+   */
+  void dump_statistics ();
+
+  /**
+   *  @brief Prints the number of shapes and vertices per layer and cell instead of the dump
+   *
+   *  Besides the counts of the cells themselves, the counts of the flattened cells
+   *  and of the flattened layout are given. Repetitions and arrays are accounted 
+   *  for by their instance count, so nothing is expanded.
+   */
+  void dump_shape_counts ();
+
+  /**
+   *  @brief Prints the placement hierarchy instead of the dump
+   *
+   *  For every cell, the report lists the number of instances in the flattened
+   *  layout, the depth (the longest path from a top cell), the number of placements
+   *  and the number of distinct children. Repetitions count with their instance
+   *  count. The top cells and the references to undefined cells are listed too.
+   *  A recursive hierarchy is reported as an error.
+   */
+  void dump_hierarchy ();
+
+  /**
+   *  @brief Dumps a part of the file
+   *
+   *  See OASISParser::parse_range for details.
+   */
+  void dump_range (const OASISResumePosition *from, const OASISResumePosition *to);
 
-  void get (double &d)
+  /**
+   *  @brief Reimplementation of OASISVisitor: the dumper wants to see every field
+   */
+  virtual bool wants_trace () const
   {
-    d = get_real ();
+    return true;
   }
 
-  std::string get_str ();
-  void get_str (std::string &s);
-  double get_real ();
-  db::Point get_gdelta (long grid = 1);
-  db::Point get_3delta (long grid = 1);
-  db::Point get_2delta (long grid = 1);
-  db::Coord get_coord (long grid = 1);
-  db::Coord get_ucoord (unsigned long grid = 1);
+  /**
+   *  @brief Reimplementation of OASISVisitor: prints a field
+   */
+  virtual void trace (size_t pos, const char *data, size_t n, const std::string &msg);
+
+  /**
+   *  @brief Reimplementation of OASISVisitor: prints a warning
+   */
+  virtual void warn (const std::string &msg, size_t pos);
+
+private:
+  tl::InputStreamBase *mp_source;
+  OASISParser m_parser;
+  tl::HexDumpFormatter m_formatter;
+  tl::OutputStream *mp_output;
+  unsigned int m_threads;
+  bool m_select;
+  bool m_range;
+
+  void dump_parallel ();
+  void write (const char *data, size_t n);
 };
 
 }
@@ -0,0 +1,2837 @@
+/*
+
+  KLayout Layout Viewer
+  Copyright (C) 2013-2018 Matthias Koefferlein
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+
+
+#include "dbOASISParser.h"
+
+#include "tlException.h"
+#include "tlString.h"
+#include "tlDeflate.h"
+#include "tlThreads.h"
+#include "tlAssert.h"
+
+#include <limits>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#if defined(__BMI2__)
+#  include <immintrin.h>
+#endif
+#include <iostream>
+
+namespace db
+{
+
+// ---------------------------------------------------------------
+//  OASISCBlockPrefetcher definition and implementation
+
+/**
+ *  @brief A job inflating one CBLOCK
+ */
+class OASISCBlockInflateJob
+  : public tl::Job
+{
+public:
+  OASISCBlockInflateJob (const char *data, size_t size, size_t offset, size_t comp_bytes, size_t uncomp_bytes)
+    : mp_data (data), m_size (size), m_offset (offset), m_initial_bytes (0), m_comp_bytes (0)
+  {
+    //  "uncomp_bytes" is taken from the file and not trusted for the allocation: 
+    //  the buffer starts with a plausible expansion of the compressed data and grows
+    //  while inflating
+    m_initial_bytes = std::min (uncomp_bytes, std::min (comp_bytes, size - offset) * 16);
+  }
+
+  virtual void run ()
+  {
+    tl::InputMemoryStream mem (mp_data + m_offset, m_size - m_offset);
+    tl::InputStream stream (mem);
+    tl::InflateFilter filter (stream);
+
+    //  like in the serial case, the compressed block ends where the DEFLATE stream 
+    //  ends - the uncompressed size is checked by the parser when the block is done
+    size_t n = 0;
+    m_inflated.resize (std::max (m_initial_bytes, size_t (1)));
+    while (true) {
+      n += filter.read (&m_inflated [n], m_inflated.size () - n);
+      if (n < m_inflated.size () || filter.at_end ()) {
+        break;
+      }
+      m_inflated.resize (m_inflated.size () * 2);
+    }
+    m_inflated.resize (n);
+
+    m_comp_bytes = stream.pos ();
+  }
+
+  size_t offset () const
+  {
+    return m_offset;
+  }
+
+  size_t comp_bytes () const
+  {
+    return m_comp_bytes;
+  }
+
+  std::vector<char> &inflated ()
+  {
+    return m_inflated;
+  }
+
+private:
+  const char *mp_data;
+  size_t m_size;
+  size_t m_offset;
+  size_t m_initial_bytes;
+  size_t m_comp_bytes;
+  std::vector<char> m_inflated;
+};
+
+/**
+ *  @brief Locates the CBLOCKs of a file and inflates them in the background
+ *
+ *  The CBLOCKs are located by a "scout" parser running in a separate thread. This 
+ *  parser does not deliver events and skips the CBLOCKs using their "comp_bytes" 
+ *  value. The CBLOCKs are inflated by the workers of a thread pool and delivered to
+ *  the main parser in file order. 
+ *  If the scout fails or gets out of sync, the main parser falls back to inflating 
+ *  the CBLOCKs itself. 
+ */
+class OASISCBlockPrefetcher
+{
+public:
+  OASISCBlockPrefetcher (const char *data, size_t size, unsigned int nthreads)
+    : mp_data (data), m_size (size), m_pool (nthreads, 4 * nthreads + 4), mp_next (0)
+  {
+    m_scout = std::thread (&OASISCBlockPrefetcher::scout, this);
+  }
+
+  ~OASISCBlockPrefetcher ()
+  {
+    m_pool.stop ();
+    m_scout.join ();
+    delete mp_next;
+    mp_next = 0;
+  }
+
+  /**
+   *  @brief Registers a CBLOCK (called by the scout)
+   *
+   *  "offset" is the position of the compressed data.
+   */
+  void add (size_t offset, size_t comp_bytes, size_t uncomp_bytes)
+  {
+    if (! m_pool.submit (new OASISCBlockInflateJob (mp_data, m_size, offset, comp_bytes, uncomp_bytes))) {
+      //  stops the scout
+      throw tl::Exception (tl::translate ("CBLOCK prefetching cancelled"));
+    }
+  }
+
+  /**
+   *  @brief Gets the inflated data for the CBLOCK at the given position
+   *
+   *  @return false, if no data is available for this CBLOCK
+   */
+  bool fetch (size_t offset, std::vector<char> &data, size_t &comp_bytes)
+  {
+    while (true) {
+
+      if (! mp_next) {
+        mp_next = dynamic_cast<OASISCBlockInflateJob *> (m_pool.wait_next ());
+        if (! mp_next) {
+          return false;
+        }
+      }
+
+      if (mp_next->offset () > offset) {
+        return false;
+      }
+
+      OASISCBlockInflateJob *job = mp_next;
+      mp_next = 0;
+
+      bool ok = (job->offset () == offset && ! job->failed ());
+      if (ok) {
+        data.swap (job->inflated ());
+        comp_bytes = job->comp_bytes ();
+      }
+
+      delete job;
+
+      if (ok) {
+        return true;
+      }
+
+    }
+  }
+
+private:
+  const char *mp_data;
+  size_t m_size;
+  tl::ThreadPool m_pool;
+  OASISCBlockInflateJob *mp_next;
+  std::thread m_scout;
+
+  void scout ()
+  {
+    try {
+      tl::InputMemoryStream mem (mp_data, m_size);
+      OASISParser parser (mem);
+      parser.m_scout = true;
+      parser.mp_prefetcher = this;
+      OASISVisitor visitor;
+      parser.parse (visitor);
+    } catch (...) {
+      //  errors are reported by the main parser
+    }
+    m_pool.close ();
+  }
+};
+
+// ---------------------------------------------------------------
+//  OASISVisitor implementation
+
+void 
+OASISVisitor::warn (const std::string &msg, size_t pos)
+{
+  std::cerr << msg 
+           << tl::translate (" (position=") << pos
+           << ")"
+           << std::endl;
+}
+
+// ---------------------------------------------------------------
+//  OASISParser implementation
+
+OASISParser::OASISParser (tl::InputStreamBase &s)
+  : mp_source (&s), m_stream (s), mp_visitor (0), mp_target (0), m_trace (false), m_want_trace (false), m_elements (true), m_threads (1), mp_prefetcher (0), m_scout (false),
+    m_select (false), m_select_name_valid (false), m_select_id_valid (false), m_select_id (0),
+    m_cell_offset_propname_valid (false), m_cell_offset_propname_id (0), mp_index (0),
+    m_cblock_pending (false), m_cblock_uncomp_bytes (0),
+    m_cblock_pos (0), m_cell_offset (0), m_cell_in_cblock (false), m_cell_inner_offset (0),
+    mp_positions (0), mp_stop (0),
+    m_range (false), m_range_from (0), m_range_to (0), m_range_active (false), m_stop_at (0), m_trace_from (0)
+{
+  for (unsigned int i = 0; i < sizeof (m_next_id) / sizeof (m_next_id [0]); ++i) {
+    m_next_id [i] = 0;
+  }
+  reset_modal_variables ();
+}
+
+OASISParser::~OASISParser ()
+{
+  if (mp_prefetcher && ! m_scout) {
+    delete mp_prefetcher;
+  }
+  mp_prefetcher = 0;
+}
+
+void
+OASISParser::select_cell (const std::string &name)
+{
+  m_select = true;
+  m_select_name = name;
+  m_select_name_valid = true;
+  m_select_id_valid = false;
+}
+
+void
+OASISParser::select_cell_id (unsigned long id)
+{
+  m_select = true;
+  m_select_id = id;
+  m_select_id_valid = true;
+  m_select_name_valid = false;
+}
+
+void
+OASISParser::reset_modal_variables ()
+{
+  m_xy_absolute = true;
+  m_mm_repetition = OASISRepetition ();
+  m_mm_placement_cell = OASISName ();
+  m_mm_placement_x = m_mm_placement_y = 0;
+  m_mm_layer = m_mm_datatype = 0;
+  m_mm_textlayer = m_mm_texttype = 0;
+  m_mm_text_x = m_mm_text_y = 0;
+  m_mm_text_string = OASISName ();
+  m_mm_geometry_x = m_mm_geometry_y = 0;
+  m_mm_geometry_w = m_mm_geometry_h = 0;
+  m_mm_polygon_point_list.clear ();
+  m_mm_path_point_list.clear ();
+  m_mm_path_halfwidth = 0;
+  m_mm_path_start_extension = m_mm_path_end_extension = 0;
+  m_mm_ctrapezoid_type = 0;
+  m_mm_circle_radius = 0;
+  m_mm_last_property_name = OASISName ();
+  m_mm_last_value_list.clear ();
+}
+
+/**
+ *  @brief Compacts the 7 bit groups of a little-endian LEB128 word into a value
+ *
+ *  "w" holds up to 8 bytes of the number, the continuation bits and the bytes 
+ *  following the number must be masked out already.
+ */
+static inline uint64_t
+compact_leb128 (uint64_t w)
+{
+#if defined(__BMI2__)
+  return _pext_u64 (w, 0x7f7f7f7f7f7f7f7full);
+#else
+  w = (w & 0x007f007f007f007full) | ((w & 0x7f007f007f007f00ull) >> 1);
+  w = (w & 0x00003fff00003fffull) | ((w & 0x3fff00003fff0000ull) >> 2);
+  w = (w & 0x000000000fffffffull) | ((w & 0x0fffffff00000000ull) >> 4);
+  return w;
+#endif
+}
+
+template <class T> 
+inline T
+OASISParser::get_unsigned (const char *overflow_msg)
+{
+  //  fast path: decode numbers up to 8 bytes long from a single 64 bit word
+  size_t n = sizeof (uint64_t);
+  const unsigned char *p = (const unsigned char *) m_stream.peek (n);
+  if (p && n >= sizeof (uint64_t)) {
+
+    uint64_t w;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+    memcpy (&w, p, sizeof (w));
+#else
+    w = 0;
+    for (unsigned int i = 8; i > 0; ) {
+      w = (w << 8) | uint64_t (p [--i]);
+    }
+#endif
+
+    //  the terminating byte is the first one without the continuation bit
+    uint64_t stop = ~w & 0x8080808080808080ull;
+    if (stop != 0) {
+
+      unsigned int nbits = __builtin_ctzll (stop) + 1;
+      if (nbits < 64) {
+        w &= (uint64_t (1) << nbits) - 1;
+      }
+
+      uint64_t v = compact_leb128 (w);
+      if (sizeof (T) < sizeof (uint64_t) && v > uint64_t (std::numeric_limits <T>::max ())) {
+        warn (tl::translate (overflow_msg));
+      }
+
+      m_stream.get (nbits / 8);
+      return T (v);
+
+    }
+
+  }
+
+  //  slow path: byte by byte (at the end of the buffer or for long numbers)
+  T v = 0;
+  T vm = 1;
+  char c;
+  
+  do {
+    unsigned char *b = (unsigned char *) m_stream.get (1);
+    if (! b) {
+      error (tl::translate ("Unexpected end-of-file"));
+      return 0;
+    }
+    c = *b;
+    if (vm > std::numeric_limits <T>::max () / 128 && 
+        (T) (c & 0x7f) > (std::numeric_limits <T>::max () / vm)) {
+      warn (tl::translate (overflow_msg));
+    }
+    v += (T) (c & 0x7f) * vm;
+    vm <<= 7;
+  } while ((c & 0x80) != 0);
+
+  return v;
+}
+
+inline long long 
+OASISParser::get_long_long ()
+{
+  unsigned long long u = get_ulong_long ();
+  if ((u & 1) != 0) {
+    return -(long long) (u >> 1);
+  } else {
+    return (long long) (u >> 1);
+  }
+}
+
+inline unsigned long long 
+OASISParser::get_ulong_long ()
+{
+  return get_unsigned<unsigned long long> ("Unsigned long value overflow");
+}
+
+inline long 
+OASISParser::get_long ()
+{
+  unsigned long u = get_ulong ();
+  if ((u & 1) != 0) {
+    return -long (u >> 1);
+  } else {
+    return long (u >> 1);
+  }
+}
+
+inline unsigned long 
+OASISParser::get_ulong ()
+{
+  return get_unsigned<unsigned long> ("Unsigned long value overflow");
+}
+
+inline int 
+OASISParser::get_int ()
+{
+  unsigned int u = get_uint ();
+  if ((u & 1) != 0) {
+    return -int (u >> 1);
+  } else {
+    return int (u >> 1);
+  }
+}
+
+inline unsigned int 
+OASISParser::get_uint ()
+{
+  return get_unsigned<unsigned int> ("Unsigned integer value overflow");
+}
+
+std::string 
+OASISParser::get_str ()
+{
+  std::string s;
+  get_str (s);
+  return s;
+}
+
+void
+OASISParser::get_str (std::string &s)
+{
+  size_t l = 0;
+  get (l);
+
+  char *b = (char *) m_stream.get (l);
+  if (! b) {
+    error (tl::translate ("Unexpected end-of-file"));
+  }
+  s.assign (b, l);
+}
+
+double
+OASISParser::get_real ()
+{
+  unsigned int t = get_uint ();
+
+  if (t == 0) {
+
+    return double (get_ulong ()); 
+
+  } else if (t == 1) {
+
+    return -double (get_ulong ()); 
+
+  } else if (t == 2) {
+
+    return 1.0 / double (get_ulong ()); 
+
+  } else if (t == 3) {
+
+    return -1.0 / double (get_ulong ()); 
+
+  } else if (t == 4) {
+
+    double d = double (get_ulong ());
+    return d / double (get_ulong ()); 
+
+  } else if (t == 5) {
+
+    double d = double (get_ulong ());
+    return -d / double (get_ulong ()); 
+
+  } else if (t == 6) {
+
+    union {
+      float f;
+      uint32_t i;
+    } i2f;
+
+    unsigned char *b = (unsigned char *) m_stream.get (sizeof (i2f.i));
+    if (! b) {
+      error (tl::translate ("Unexpected end-of-file"));
+    }
+    i2f.i = 0;
+    b += sizeof (i2f.i);
+    for (unsigned int i = 0; i < sizeof (i2f.i); ++i) {
+      i2f.i = (i2f.i << 8) + uint32_t (*--b);
+    }
+
+    return double (i2f.f);
+
+  } else if (t == 7) {
+
+    union {
+      double d;
+      uint64_t i;
+    } i2f;
+
+    unsigned char *b = (unsigned char *) m_stream.get (sizeof (i2f.i));
+    if (! b) {
+      error (tl::translate ("Unexpected end-of-file"));
+    }
+    i2f.i = 0;
+    b += sizeof (i2f.i);
+    for (unsigned int i = 0; i < sizeof (i2f.i); ++i) {
+      i2f.i = (i2f.i << 8) + uint64_t (*--b);
+    }
+
+    return double (i2f.d);
+
+  } else {
+    error (tl::sprintf (tl::translate ("Invalid real type %d"), t));
+    return 0.0;
+  }
+}
+
+db::Coord
+OASISParser::get_ucoord (unsigned long grid)
+{
+  unsigned long long lx = 0;
+  get (lx);
+  lx *= grid;
+  if (lx > (unsigned long long) (std::numeric_limits <db::Coord>::max ())) {
+    warn (tl::translate ("Coordinate value overflow"));
+  }
+  return db::Coord (lx);
+}
+
+db::Coord
+OASISParser::get_coord (long grid)
+{
+  long long lx = 0;
+  get (lx);
+  lx *= grid;
+  if (lx < (long long) (std::numeric_limits <db::Coord>::min ()) ||
+      lx > (long long) (std::numeric_limits <db::Coord>::max ())) {
+    warn (tl::translate ("Coordinate value overflow"));
+  }
+  return db::Coord (lx);
+}
+
+db::Point
+OASISParser::get_2delta (long grid)
+{
+  unsigned long long l1 = 0;
+  get (l1);
+
+  long long lx = l1 >> 2;
+  lx *= grid;
+  if (lx > (long long) (std::numeric_limits <db::Coord>::max ())) {
+    warn (tl::translate ("Coordinate value overflow"));
+  }
+  db::Coord x = lx;
+
+  switch (l1 & 3) {
+  case 0:
+    return db::Point (x, 0);
+  case 1:
+    return db::Point (0, x);
+  case 2:
+    return db::Point (-x, 0);
+  case 3:
+  default:
+    return db::Point (0, -x);
+  }
+}
+
+db::Point
+OASISParser::get_3delta (long grid)
+{
+  unsigned long long l1 = 0;
+  get (l1);
+
+  long long lx = l1 >> 3;
+  lx *= grid;
+  if (lx > (long long) (std::numeric_limits <db::Coord>::max ())) {
+    warn (tl::translate ("Coordinate value overflow"));
+  }
+  db::Coord x = lx;
+
+  switch (l1 & 7) {
+  case 0:
+    return db::Point (x, 0);
+  case 1:
+    return db::Point (0, x);
+  case 2:
+    return db::Point (-x, 0);
+  case 3:
+    return db::Point (0, -x);
+  case 4:
+    return db::Point (x, x);
+  case 5:
+    return db::Point (-x, x);
+  case 6:
+    return db::Point (-x, -x);
+  case 7:
+  default:
+    return db::Point (x, -x);
+  }
+}
+
+db::Point
+OASISParser::get_gdelta (long grid)
+{
+  unsigned long long l1 = 0;
+  get (l1);
+
+  if ((l1 & 1) != 0) {
+
+    long long lx = ((l1 & 2) == 0 ? (long long) (l1 >> 2) : -(long long) (l1 >> 2));
+    lx *= grid;
+    if (lx < (long long) (std::numeric_limits <db::Coord>::min ()) ||
+        lx > (long long) (std::numeric_limits <db::Coord>::max ())) {
+      warn (tl::translate ("Coordinate value overflow"));
+    }
+
+    long long ly;
+    get (ly);
+    ly *= grid;
+    if (ly < (long long) (std::numeric_limits <db::Coord>::min ()) ||
+        ly > (long long) (std::numeric_limits <db::Coord>::max ())) {
+      warn (tl::translate ("Coordinate value overflow"));
+    }
+    
+    return db::Point (db::Coord (lx), db::Coord (ly));
+
+  } else {
+
+    long long lx = l1 >> 4;
+    lx *= grid;
+    if (lx > (long long) (std::numeric_limits <db::Coord>::max ())) {
+      warn (tl::translate ("Coordinate value overflow"));
+    }
+    db::Coord x = lx;
+
+    switch ((l1 >> 1) & 7) {
+    case 0:
+      return db::Point (x, 0);
+    case 1:
+      return db::Point (0, x);
+    case 2:
+      return db::Point (-x, 0);
+    case 3:
+      return db::Point (0, -x);
+    case 4:
+      return db::Point (x, x);
+    case 5:
+      return db::Point (-x, x);
+    case 6:
+      return db::Point (-x, -x);
+    case 7:
+    default:
+      return db::Point (x, -x);
+    }
+
+  }
+}
+
+
+void 
+OASISParser::error (const std::string &msg)
+{
+  throw OASISParserException (msg, m_stream.pos (), "UNKNOWN_CELL");
+}
+
+void 
+OASISParser::warn (const std::string &msg) 
+{
+  if (m_scout || ! mp_target) {
+    return;
+  }
+
+  mp_target->warn (msg, m_stream.pos ());
+}
+
+void
+OASISParser::do_trace (const std::string &msg)
+{
+  //  Inside CBLOCKs, the stream records the compressed bytes (see do_read_cblock)
+  size_t n = m_stream.n_recorded ();
+  size_t last_pos = m_stream.pos () - n;
+
+  mp_visitor->trace (last_pos, m_stream.recorded (), n, msg);
+
+  m_stream.reset_recording ();
+}
+
+static const char *cblock_msg = "CBLOCK (data will be expanded)";
+
+void
+OASISParser::start_range_in_cblock ()
+{
+  //  "from" is inside the CBLOCK whose header has just been read quietly: the range 
+  //  starts with the CBLOCK record, so the records inside it are delivered 
+  m_trace_from = 0;
+  mp_visitor = mp_target;
+  m_trace = m_want_trace;
+
+  mp_visitor->record (34, m_cblock_pos, false);
+  if (m_trace) {
+    //  the CBLOCK-info bytes recorded are traced by do_read_cblock
+    const char cblock_id = 34;
+    mp_visitor->trace (m_cblock_pos, &cblock_id, 1, cblock_msg);
+  }
+}
+
+void
+OASISParser::seek (size_t pos)
+{
+  m_cblock_pending = false;
+  m_stream.seek (pos);
+}
+
+void
+OASISParser::check_cblock_size ()
+{
+  m_cblock_pending = false;
+
+  //  the stream keeps the number of bytes delivered from the last compressed block
+  if (m_stream.inflated_pos () != m_cblock_uncomp_bytes) {
+    error (tl::sprintf (tl::translate ("CBLOCK uncompressed size mismatch (expected %lu bytes, got %lu)"), m_cblock_uncomp_bytes, m_stream.inflated_pos ()));
+  }
+}
+
+void
+OASISParser::do_read_cblock ()
+{
+  //  a CBLOCK may follow another one immediately
+  if (m_cblock_pending && ! m_stream.inflating ()) {
+    check_cblock_size ();
+  }
+
+  trace (cblock_msg);
+
+  //  the position of the CBLOCK record for the cell positions
+  m_cblock_pos = m_stream.pos () - 1;
+
+  //  while reading quietly up to the start of the byte range, the header is recorded
+  //  in case the range starts inside this CBLOCK
+  bool range_start_pending = m_range_active && m_trace_from > 0 && ! m_stream.inflating ();
+  if (range_start_pending && m_want_trace) {
+    m_stream.start_recording ();
+  }
+
+  unsigned int type = get_uint ();
+  if (type != 0) {
+    error (tl::sprintf (tl::translate ("Invalid CBLOCK compression type %d"), type));
+  }
+
+  size_t uncomp_bytes = 0, comp_bytes = 0;
+  get (uncomp_bytes);
+  get (comp_bytes);
+
+  if (range_start_pending) {
+    if (m_trace_from < m_stream.pos () + comp_bytes) {
+      start_range_in_cblock ();
+    } else {
+      m_stream.stop_recording ();
+    }
+  }
+
+  if (m_trace) {
+    trace ("cblock-info (type=" + tl::to_string (type) + ", uncomp-bytes=" + tl::to_string (uncomp_bytes) + ", comp_bytes=" + tl::to_string (comp_bytes) + ")");
+  }
+
+  mp_visitor->cblock (m_cblock_pos, comp_bytes, uncomp_bytes);
+
+  std::vector<char> inflated;
+  size_t raw_bytes = 0;
+
+  if (m_scout) {
+
+    //  register the CBLOCK for inflating and skip it
+    mp_prefetcher->add (m_stream.pos (), comp_bytes, uncomp_bytes);
+    if (! m_stream.get (comp_bytes, true)) {
+      error (tl::translate ("Unexpected end-of-file"));
+    }
+
+  } else if (mp_prefetcher && mp_prefetcher->fetch (m_stream.pos (), inflated, raw_bytes)) {
+
+    //  use the data inflated in the background
+    m_stream.inflate (inflated, raw_bytes);
+
+  } else {
+
+    //  put the stream into deflating mode - for tracing, the compressed bytes are
+    //  consumed as they are decoded, so they can be shown with the records
+    m_stream.inflate (m_want_trace);
+
+  }
+
+  if (! m_scout) {
+    m_cblock_pending = true;
+    m_cblock_uncomp_bytes = uncomp_bytes;
+  }
+}
+
+static const char magic_bytes[] = { "%SEMI-OASIS\015\012" };
+
+void 
+OASISParser::parse (OASISVisitor &visitor)
+{
+  mp_target = &visitor;
+  m_want_trace = ! m_scout && visitor.wants_trace ();
+  m_elements = ! m_scout && visitor.wants_elements ();
+
+  if (m_select) {
+
+    //  Only the selected cell is delivered - everything else is read quietly. 
+    //  The CBLOCK prefetcher is not used as the CBLOCKs are not read in file order.
+    mp_visitor = &m_null_visitor;
+    m_trace = false;
+    m_stream.stop_recording ();
+
+    if (m_stream.supports_seek () && do_parse_cell_at_offset ()) {
+      return;
+    }
+
+  } else if (m_range) {
+
+    //  The CBLOCK prefetcher is not used as the parser may jump
+    do_parse_byte_range ();
+    return;
+
+  } else {
+
+    mp_visitor = &visitor;
+
+    //  recording the bytes is only required for tracing
+    m_trace = m_want_trace;
+    if (m_trace) {
+      m_stream.start_recording ();
+    } else {
+      m_stream.stop_recording ();
+    }
+
+    //  while tracing, the CBLOCKs are inflated by the parser for the compressed bytes
+    if (m_threads > 1 && ! m_scout && ! m_trace && ! mp_prefetcher && mp_source->mapped_data ()) {
+      mp_prefetcher = new OASISCBlockPrefetcher (mp_source->mapped_data (), mp_source->mapped_size (), m_threads);
+    }
+
+  }
+
+  do_parse ();
+}
+
+/**
+ *  @brief A visitor remembering the position of the last record outside CBLOCKs
+ *
+ *  Warnings are not reported.
+ */
+class OASISBoundaryVisitor
+  : public OASISVisitor
+{
+public:
+  OASISBoundaryVisitor ()
+    : m_last (0), m_valid (false), m_count (0)
+  { }
+
+  virtual void warn (const std::string & /*msg*/, size_t /*pos*/) { }
+
+  virtual void record (unsigned int /*type*/, size_t pos, bool inflated)
+  {
+    ++m_count;
+    if (! inflated) {
+      m_last = pos;
+      m_valid = true;
+    }
+  }
+
+  bool valid () const
+  {
+    return m_valid;
+  }
+
+  size_t last () const
+  {
+    return m_last;
+  }
+
+  size_t count () const
+  {
+    return m_count;
+  }
+
+private:
+  size_t m_last;
+  bool m_valid;
+  size_t m_count;
+};
+
+void
+OASISParser::do_read_from (size_t pos, bool table_offsets_at_end)
+{
+  seek (pos);
+  reset_modal_variables ();
+
+  //  the position may be inside a cell - a top-level record terminates the cell right away
+  do_read_cell<OASISVisitorSink> ();
+  do_read_records (table_offsets_at_end);
+}
+
+void
+OASISParser::do_parse_byte_range ()
+{
+  m_range_active = true;
+  m_stop_at = m_range_to;
+  m_trace_from = 0;
+
+  if (m_range_from == 0 || ! m_stream.supports_seek ()) {
+
+    //  read quietly up to the first record at or after "from"
+    if (m_range_from > 0) {
+      mp_visitor = &m_null_visitor;
+      m_trace = false;
+      m_stream.stop_recording ();
+      m_trace_from = m_range_from;
+    } else {
+      mp_visitor = mp_target;
+      m_trace = m_want_trace;
+      if (m_trace) {
+        m_stream.start_recording ();
+      }
+    }
+
+    do_parse ();
+    check_range_delivered ();
+    return;
+
+  }
+
+  //  the START record is read quietly for the table flag
+  mp_visitor = &m_null_visitor;
+  m_trace = false;
+  m_stream.stop_recording ();
+
+  bool table_offsets_at_end = do_read_header ();
+  size_t header_end = m_stream.pos ();
+
+  if (m_range_from < header_end) {
+
+    seek (0);
+
+  } else {
+
+    size_t start = find_resync_position (header_end);
+
+    //  read quietly up to "from" to find the last record starting at or before "from" -
+    //  errors are reported when the records are read again
+    OASISBoundaryVisitor boundaries;
+    mp_visitor = &boundaries;
+    m_stop_at = m_range_from + 1;
+
+    try {
+      do_read_from (start, table_offsets_at_end);
+    } catch (tl::Exception &) {
+      //  the records are delivered up to the error
+    }
+
+    start = boundaries.valid () ? boundaries.last () : start;
+
+    //  the record found may start before "from" - tracing starts with the next record then
+    m_stop_at = m_range_to;
+    mp_visitor = &m_null_visitor;
+    m_trace_from = m_range_from;
+
+    do_read_from (start, table_offsets_at_end);
+    check_range_delivered ();
+    return;
+
+  }
+
+  mp_visitor = mp_target;
+  m_trace = m_want_trace;
+  if (m_trace) {
+    m_stream.start_recording ();
+  }
+
+  do_parse ();
+}
+
+void
+OASISParser::check_range_delivered ()
+{
+  //  tracing did not start: no record begins within the range
+  if (m_trace_from == 0) {
+    return;
+  } else if (m_range_to > 0) {
+    warn (tl::sprintf (tl::translate ("No record starts within the byte range from %lu to %lu"), m_range_from, m_range_to));
+  } else {
+    warn (tl::sprintf (tl::translate ("No record starts at or after position %lu"), m_range_from));
+  }
+}
+
+size_t
+OASISParser::find_resync_position (size_t start)
+{
+  //  the cell index provides a safe position
+  CellIndexEntry entry;
+  if (mp_index && mp_index->find_before (m_range_from, entry)) {
+    return std::max (start, size_t (entry.offset));
+  }
+
+  const char *data = mp_source->mapped_data ();
+  if (! data) {
+    return start;
+  }
+
+  //  beyond the end of the file, the probing starts from the last byte
+  size_t from = std::min (m_range_from, mp_source->mapped_size () - 1);
+
+  //  A candidate position must lead to a sequence of valid records. The probing parser
+  //  stops at the first record beginning after "from". A CBLOCK covering "from" is read
+  //  completely, so the probing parser sees the whole file.
+  const size_t min_records = 16;
+
+  //  Every candidate costs a partial parse up to "from", so the search is limited.
+  const size_t max_distance = 1 << 20;
+
+  tl::InputMemoryStream mem (data, mp_source->mapped_size ());
+  OASISParser probe (mem);
+
+  //  windows of increasing size in front of "from", each scanned from "from" downwards
+  size_t hi = from + 1;
+  for (size_t w = 4096; hi > start; w = std::min (w * 16, max_distance)) {
+
+    size_t lo = (from - start > w) ? from - w : start;
+
+    for (size_t p = hi; p-- > lo; ) {
+      unsigned char r = (unsigned char) data [p];
+      size_t count = 0;
+      if (r <= 34 && r != 1 /*START*/ && probe.probe_records (p, from + 1, count) && count >= min_records) {
+        return p;
+      }
+    }
+
+    if (lo > start && w == max_distance) {
+      throw tl::Exception (tl::sprintf (tl::translate ("No record sequence leading to position %lu found within %lu bytes in front of it - build a cell index with --build-index to dump from this position"), m_range_from, max_distance));
+    }
+
+    hi = lo;
+
+  }
+
+  return start;
+}
+
+bool
+OASISParser::probe_records (size_t pos, size_t stop_at, size_t &count)
+{
+  OASISBoundaryVisitor visitor;
+  mp_target = &visitor;
+  mp_visitor = &visitor;
+  m_trace = false;
+  m_want_trace = false;
+  m_elements = true;
+  m_stream.stop_recording ();
+
+  m_range_active = true;
+  m_stop_at = stop_at;
+  m_trace_from = 0;
+
+  //  the records must lead exactly to a record boundary at or after "from" - an error
+  //  inside a record which covers "from" (e.g. a bogus length running beyond the end
+  //  of the file) indicates a false start
+  bool ok = true;
+  try {
+    do_read_from (pos, false);
+  } catch (...) {
+    ok = false;
+  }
+
+  count = visitor.count ();
+  mp_target = 0;
+  mp_visitor = 0;
+
+  return ok;
+}
+
+/**
+ *  @brief A visitor collecting the cell positions for the cell index
+ */
+class OASISCellIndexBuilder
+  : public OASISVisitor
+{
+public:
+  OASISCellIndexBuilder (const OASISParser &parser)
+    : mp_parser (&parser)
+  { }
+
+  virtual void name (NameTable table, unsigned long id, const std::string &name)
+  {
+    if (table == CellNames) {
+      m_names [id] = name;
+    }
+  }
+
+  virtual bool wants_elements () const
+  {
+    return false;
+  }
+
+  virtual void begin_cell (const OASISName &cell)
+  {
+    CellIndexEntry entry;
+    entry.has_id = cell.by_id;
+    entry.id = cell.id;
+    entry.name = cell.name;
+
+    size_t offset = 0, inner_offset = 0;
+    bool in_cblock = false;
+    mp_parser->cell_position (offset, in_cblock, inner_offset);
+    entry.offset = offset;
+    entry.in_cblock = in_cblock;
+    entry.inner_offset = inner_offset;
+
+    m_entries.push_back (entry);
+  }
+
+  /**
+   *  @brief Resolves names and IDs through the CELLNAME table and fills the index
+   */
+  void fill (CellIndex &index)
+  {
+    std::map<std::string, unsigned long> ids;
+    for (std::map<unsigned long, std::string>::const_iterator n = m_names.begin (); n != m_names.end (); ++n) {
+      ids.insert (std::make_pair (n->second, n->first));
+    }
+
+    for (std::vector<CellIndexEntry>::iterator e = m_entries.begin (); e != m_entries.end (); ++e) {
+      if (e->has_id) {
+        std::map<unsigned long, std::string>::const_iterator n = m_names.find (e->id);
+        if (n != m_names.end ()) {
+          e->name = n->second;
+        }
+      } else {
+        std::map<std::string, unsigned long>::const_iterator i = ids.find (e->name);
+        if (i != ids.end ()) {
+          e->has_id = true;
+          e->id = i->second;
+        }
+      }
+      index.add (*e);
+    }
+  }
+
+private:
+  const OASISParser *mp_parser;
+  std::map<unsigned long, std::string> m_names;
+  std::vector<CellIndexEntry> m_entries;
+};
+
+void
+OASISParser::build_index (CellIndex &index)
+{
+  OASISCellIndexBuilder builder (*this);
+  parse (builder);
+  builder.fill (index);
+}
+
+/**
+ *  @brief A visitor which does not report warnings and skips the cell contents
+ */
+class OASISSilentVisitor
+  : public OASISVisitor
+{
+public:
+  virtual bool wants_elements () const { return false; }
+  virtual void warn (const std::string & /*msg*/, size_t /*pos*/) { }
+};
+
+/**
+ *  @brief A visitor which reports warnings only
+ */
+class OASISCheckVisitor
+  : public OASISVisitor
+{
+public:
+  virtual bool wants_elements () const { return false; }
+};
+
+void
+OASISParser::check ()
+{
+  OASISCheckVisitor visitor;
+  parse (visitor);
+}
+
+void
+OASISParser::scan_cells (std::vector<OASISResumePosition> &positions)
+{
+  OASISSilentVisitor visitor;
+
+  mp_positions = &positions;
+  try {
+    parse (visitor);
+  } catch (...) {
+    mp_positions = 0;
+    throw;
+  }
+  mp_positions = 0;
+}
+
+void
+OASISParser::parse_range (OASISVisitor &visitor, const OASISResumePosition *from, const OASISResumePosition *to)
+{
+  tl_assert (m_stream.supports_seek ());
+
+  mp_target = &visitor;
+  m_want_trace = ! m_scout && visitor.wants_trace ();
+  m_elements = ! m_scout && visitor.wants_elements ();
+  mp_stop = to;
+
+  try {
+
+    bool table_offsets_at_end = false;
+
+    if (from) {
+
+      //  the START record is read quietly for the table flag
+      mp_visitor = &m_null_visitor;
+      m_trace = false;
+      m_stream.stop_recording ();
+
+      seek (0);
+      table_offsets_at_end = do_read_header ();
+
+      seek (from->offset);
+      for (unsigned int i = 0; i < sizeof (m_next_id) / sizeof (m_next_id [0]); ++i) {
+        m_next_id [i] = from->next_id [i];
+      }
+
+      if (from->in_cblock) {
+        if (get_byte () != 34) {
+          error (tl::translate ("CBLOCK expected"));
+        }
+        do_read_cblock ();
+        skip_inflated (from->inner_offset);
+      }
+
+    }
+
+    mp_visitor = &visitor;
+
+    //  recording the bytes is only required for tracing
+    m_trace = m_want_trace;
+    if (m_trace) {
+      m_stream.start_recording ();
+    } else {
+      m_stream.stop_recording ();
+    }
+
+    if (from) {
+      do_read_records (table_offsets_at_end);
+    } else {
+      do_parse ();
+    }
+
+  } catch (...) {
+    mp_stop = 0;
+    throw;
+  }
+
+  mp_stop = 0;
+}
+
+bool
+OASISParser::locate_cell (size_t &offset)
+{
+  //  START record: the table offsets are either here or in the END record
+  seek (0);
+
+  const char *mb = m_stream.get (sizeof (magic_bytes) - 1);
+  if (! mb || strncmp (mb, magic_bytes, sizeof (magic_bytes) - 1) != 0) {
+    return false;
+  }
+  if (get_byte () != 1) {
+    return false;
+  }
+
+  get_str ();
+  get_real ();
+
+  bool table_offsets_at_end = get_uint ();
+  if (table_offsets_at_end) {
+    //  the END record is always 256 bytes long
+    size_t size = mp_source->mapped_size ();
+    if (size < 256) {
+      return false;
+    }
+    seek (size - 256);
+    if (get_byte () != 2) {
+      return false;
+    }
+  }
+
+  //  pairs of strict flag and offset: CELLNAME, TEXTSTRING, PROPNAME, PROPSTRING, LAYERNAME, XNAME
+  unsigned long tables [12];
+  for (unsigned int i = 0; i < 12; ++i) {
+    tables [i] = get_ulong ();
+  }
+
+  if (tables [1] == 0) {
+    return false;
+  }
+
+  //  the PROPNAME table gives the ID of S_CELL_OFFSET
+  if (tables [5] != 0) {
+
+    seek (tables [5]);
+
+    while (true) {
+      unsigned char r = get_byte ();
+      if (r == 7 || r == 8) {
+        do_read_name (r, OASISVisitor::PropNames, "PROPNAME");
+      } else if (r == 34) {
+        do_read_cblock ();
+      } else if (r != 0) {
+        break;
+      }
+    }
+
+  }
+
+  //  the S_CELL_OFFSET property follows the CELLNAME record
+  seek (tables [1]);
+
+  bool in_selected = false;
+
+  while (true) {
+
+    unsigned char r = get_byte ();
+
+    if (r == 3 || r == 4) {
+
+      unsigned long id = do_read_name (r, OASISVisitor::CellNames, "CELLNAME");
+      in_selected = (m_select_id_valid && id == m_select_id);
+
+    } else if (r == 28 || r == 29) {
+
+      if (r == 28) {
+        read_properties<OASISNullSink> ();
+      }
+
+      const OASISName &pn = m_mm_last_property_name;
+      bool is_cell_offset = pn.by_id ? (m_cell_offset_propname_valid && pn.id == m_cell_offset_propname_id) : (pn.name == "S_CELL_OFFSET");
+
+      if (in_selected && is_cell_offset && m_mm_last_value_list.size () == 1 && m_mm_last_value_list.front ().type == 8) {
+        offset = m_mm_last_value_list.front ().value.to_ulong ();
+        return offset > 0;
+      }
+
+    } else if (r == 34) {
+      do_read_cblock ();
+    } else if (r != 0) {
+      break;
+    }
+
+  }
+
+  return false;
+}
+
+void
+OASISParser::skip_inflated (size_t n)
+{
+  while (n > 0) {
+    size_t c = std::min (n, size_t (16384));
+    if (! m_stream.get (c)) {
+      error (tl::translate ("Unexpected end-of-file"));
+    }
+    n -= c;
+  }
+}
+
+bool
+OASISParser::lookup_cell (size_t &offset, size_t &inner_offset)
+{
+  CellIndexEntry entry;
+  if (! mp_index) {
+    return false;
+  } else if (m_select_name_valid ? ! mp_index->find (m_select_name, entry) : ! mp_index->find_id (m_select_id, entry)) {
+    return false;
+  }
+
+  //  the index also resolves the name and ID of the cell
+  if (entry.has_id) {
+    m_select_id = entry.id;
+    m_select_id_valid = true;
+  }
+  if (! entry.name.empty ()) {
+    m_select_name = entry.name;
+    m_select_name_valid = true;
+  }
+
+  offset = size_t (entry.offset);
+  inner_offset = entry.in_cblock ? size_t (entry.inner_offset) : 0;
+  return true;
+}
+
+bool
+OASISParser::do_parse_cell_at_offset ()
+{
+  OASISName cell;
+
+  try {
+
+    size_t offset = 0, inner_offset = 0;
+    if (lookup_cell (offset, inner_offset) || locate_cell (offset)) {
+
+      seek (offset);
+
+      //  the cell may be inside a CBLOCK
+      unsigned char r = get_byte ();
+      if (r == 34) {
+
+        do_read_cblock ();
+        skip_inflated (inner_offset);
+
+      } else {
+        m_stream.unget (1);
+      }
+
+      if (m_want_trace) {
+        m_stream.start_recording ();
+      }
+
+      r = get_byte ();
+      if (r == 13) {
+        cell.by_id = true;
+        get (cell.id);
+      } else if (r == 14) {
+        get_str (cell.name);
+      }
+
+    }
+
+  } catch (tl::Exception &) {
+    //  fall back to reading the file sequentially
+  }
+
+  if (cell.by_id || ! cell.name.empty ()) {
+    if (is_selected (cell)) {
+      reset_modal_variables ();
+      do_read_selected_cell (cell);
+      return true;
+    }
+  }
+
+  //  start again from the beginning
+  m_stream.stop_recording ();
+  seek (0);
+  for (unsigned int i = 0; i < sizeof (m_next_id) / sizeof (m_next_id [0]); ++i) {
+    m_next_id [i] = 0;
+  }
+  reset_modal_variables ();
+
+  return false;
+}
+
+bool
+OASISParser::is_selected (const OASISName &cell) const
+{
+  if (cell.by_id) {
+    return m_select_id_valid && cell.id == m_select_id;
+  } else {
+    return m_select_name_valid && cell.name == m_select_name;
+  }
+}
+
+void
+OASISParser::trace_cell (const OASISName &cell)
+{
+  if (m_trace) {
+    if (cell.by_id) {
+      trace ("CELL (" + tl::to_string (cell.id) + ")");
+    } else {
+      trace ("CELL (\"" + cell.name + "\")");
+    }
+  }
+}
+
+void
+OASISParser::do_read_selected_cell (const OASISName &cell)
+{
+  mp_visitor = mp_target;
+  m_trace = m_want_trace;
+
+  trace_cell (cell);
+
+  mp_visitor->begin_cell (cell);
+  do_read_cell<OASISVisitorSink> ();
+  mp_visitor->end_cell ();
+}
+
+void 
+OASISParser::do_parse ()
+{
+  bool table_offsets_at_end = do_read_header ();
+  do_read_records (table_offsets_at_end);
+}
+
+bool
+OASISParser::do_read_header ()
+{
+  unsigned char r;
+  char *mb;
+
+  //  read magic bytes
+  mb = (char *) m_stream.get (sizeof (magic_bytes) - 1);
+  if (! mb) {
+    error (tl::translate ("File too short"));
+    return false;
+  }
+  if (strncmp (mb, magic_bytes, sizeof (magic_bytes) - 1) != 0) {
+    error (tl::translate ("Format error (missing magic bytes)"));
+  }
+
+  trace ("magic bytes");
+
+  //  read first record
+  r = get_byte ();
+  if (r != 1) {
+    error (tl::translate ("Format error (START record expected)"));
+  }
+
+  report_record (r);
+  trace ("START");
+
+  std::string v = get_str ();
+  if (v != "1.0") {
+    error (tl::sprintf (tl::translate ("Format error (only version 1.0 is supported, file has version %s)"), v));
+  }
+
+  if (m_trace) {
+    trace ("version (\"" + v + "\")");
+  }
+
+  double res = get_real ();
+  if (res < 1e-6) {
+    error (tl::sprintf (tl::translate ("Invalid resolution of %g"), res));
+  }
+
+  if (m_trace) {
+    trace ("resolution (" + tl::to_string (res) + ")");
+  }
+
+  mp_visitor->begin_file (v, res);
+
+  //  read over table offsets if required
+  bool table_offsets_at_end = get_uint ();
+  if (m_trace) {
+    trace ("table flag (" + std::string (table_offsets_at_end ? "at end" : "here") + ")");
+  }
+
+  if (! table_offsets_at_end) {
+    for (unsigned int i = 0; i < 12; ++i) {
+      unsigned long t = get_ulong ();
+      if (m_trace) {
+        trace ("tables entry (" + tl::to_string (t) + ")");
+      }
+    }
+  }
+
+  return table_offsets_at_end;
+}
+
+void
+OASISParser::do_read_records (bool table_offsets_at_end)
+{
+  unsigned char r;
+  char *mb;
+
+  //  read next record
+  while (true) {
+
+    //  when looking for the selected cell, only the CELL record needs to be recorded
+    if (m_select && m_want_trace) {
+      m_stream.start_recording ();
+    }
+
+    r = get_byte ();
+    if (! enter_record ()) {
+      return;
+    }
+
+    if (r == 13 || r == 14 /*CELL*/) {
+
+      //  remember where the cell starts
+      m_cell_in_cblock = m_stream.inflating ();
+      if (m_cell_in_cblock) {
+        m_cell_offset = m_cblock_pos;
+        m_cell_inner_offset = m_stream.inflated_pos () - 1;
+      } else {
+        m_cell_offset = m_stream.pos () - 1;
+        m_cell_inner_offset = 0;
+      }
+
+      //  stop at the end of the range
+      if (mp_stop && mp_stop->offset == m_cell_offset && mp_stop->in_cblock == m_cell_in_cblock && mp_stop->inner_offset == m_cell_inner_offset) {
+        return;
+      }
+
+    }
+
+    report_record (r);
+
+    if (r == 0 /*PAD*/) {
+
+      trace ("PAD");
+
+    } else if (r == 2 /*END*/) {
+
+      trace ("END");
+
+      if (table_offsets_at_end) {
+        for (unsigned int i = 0; i < 12; ++i) {
+          unsigned long t = get_ulong ();
+          if (m_trace) {
+            trace ("tables entry (" + tl::to_string (t) + ")");
+          }
+        }
+      }
+
+      std::string padding = get_str ();
+      if (m_trace) {
+        trace ("padding string (\"" + padding + "\")");
+      }
+
+      unsigned int vs = get_uint ();
+      if (m_trace) {
+        trace ("validation scheme (" + tl::to_string (vs) + ")");
+      }
+
+      if (vs == 1 || vs == 2) {
+        for (unsigned int i = 0; i < 4; ++i) {
+          get_byte ();
+        }
+        trace ("validation signature");
+      }
+
+      break;
+
+    } else if (r == 3 || r == 4 /*CELLNAME*/) {
+
+      do_read_name (r, OASISVisitor::CellNames, "CELLNAME");
+
+    } else if (r == 5 || r == 6 /*TEXTSTRING*/) {
+
+      do_read_name (r, OASISVisitor::TextStrings, "TEXTSTRING");
+
+    } else if (r == 7 || r == 8 /*PROPNAME*/) {
+
+      do_read_name (r, OASISVisitor::PropNames, "PROPNAME");
+
+    } else if (r == 9 || r == 10 /*PROPSTRING*/) {
+
+      do_read_name (r, OASISVisitor::PropStrings, "PROPSTRING");
+
+    } else if (r == 11 || r == 12 /*LAYERNAME*/) {
+
+      //  read a layer name 
+      std::string name = get_str ();
+
+      unsigned int dt1 = 0, dt2 = std::numeric_limits<unsigned int>::max () - 1;
+      unsigned int l1 = 0, l2 = std::numeric_limits<unsigned int>::max () - 1;
+      unsigned int it;
+
+      it = get_uint ();
+      if (it == 0) {
+        //  keep limits
+      } else if (it == 1) {
+        l2 = get_uint ();
+      } else if (it == 2) {
+        l1 = get_uint ();
+      } else if (it == 3) {
+        l1 = get_uint ();
+        l2 = l1;
+      } else if (it == 4) {
+        l1 = get_uint ();
+        l2 = get_uint ();
+      } else {
+        error (tl::translate ("Invalid LAYERNAME interval mode (layer)"));
+      }
+
+      it = get_uint ();
+      if (it == 0) {
+        //  keep limits
+      } else if (it == 1) {
+        dt2 = get_uint ();
+      } else if (it == 2) {
+        dt1 = get_uint ();
+      } else if (it == 3) {
+        dt1 = get_uint ();
+        dt2 = dt1;
+      } else if (it == 4) {
+        dt1 = get_uint ();
+        dt2 = get_uint ();
+      } else {
+        error (tl::translate ("Invalid LAYERNAME interval mode (datatype)"));
+      }
+
+      //  and the associated id
+      if (m_trace) {
+        trace ("LAYERNAME (\"" + name + "\", layers=" + tl::to_string (l1) + ".." + tl::to_string (l2) + ", datatypes=" + tl::to_string (dt1) + ".." + tl::to_string (dt2) + ")");
+      }
+
+      mp_visitor->layer_name (r == 12, name, l1, l2, dt1, dt2);
+      
+    } else if (r == 28 || r == 29 /*PROPERTY*/) {
+
+      if (r == 28) {
+        read_properties<OASISVisitorSink> ();
+      } else {
+        trace ("PROPERTY (repeat)");
+        mp_visitor->property (m_mm_last_property_name, m_mm_last_value_list);
+      }
+
+    } else if (r == 30 || r == 31 /*XNAME*/) {
+
+      trace ("XNAME");
+
+      //  read a XNAME: it is simply ignored
+      get_ulong ();
+      get_str ();
+      if (r == 31) {
+        get_ulong ();
+      }
+
+      trace ("data"); //  TODO: refine
+
+    } else if (r == 13 || r == 14 /*CELL*/) {
+
+      if (mp_positions) {
+        mp_positions->push_back (OASISResumePosition ());
+        OASISResumePosition &p = mp_positions->back ();
+        p.offset = m_cell_offset;
+        p.in_cblock = m_cell_in_cblock;
+        p.inner_offset = m_cell_inner_offset;
+        for (unsigned int i = 0; i < sizeof (m_next_id) / sizeof (m_next_id [0]); ++i) {
+          p.next_id [i] = m_next_id [i];
+        }
+      }
+
+      OASISName cell;
+
+      //  read a cell
+      if (r == 13) {
+        cell.by_id = true;
+        get (cell.id);
+      } else {
+        get_str (cell.name);
+      }
+
+      reset_modal_variables ();
+
+      if (! m_select) {
+
+        trace_cell (cell);
+
+        mp_visitor->begin_cell (cell);
+        if (m_elements) {
+          do_read_cell<OASISVisitorSink> ();
+        } else {
+          do_read_cell<OASISNullSink> ();
+        }
+        mp_visitor->end_cell ();
+
+      } else if (is_selected (cell)) {
+
+        do_read_selected_cell (cell);
+        return;
+
+      } else {
+
+        //  read over this cell
+        m_stream.stop_recording ();
+        do_read_cell<OASISNullSink> ();
+
+      }
+
+    } else if (r == 34 /*CBLOCK*/) {
+
+      do_read_cblock ();
+
+    } else {
+      error (tl::sprintf (tl::translate ("Invalid record type on global level %d"), int (r)));
+    }
+
+  }
+
+  if (m_select) {
+    if (m_select_name_valid) {
+      error (tl::sprintf (tl::translate ("Cell not found: %s"), m_select_name));
+    } else {
+      error (tl::sprintf (tl::translate ("Cell not found: ID %ld"), m_select_id));
+    }
+  }
+
+  trace ("tail");
+
+  //  check if there are no more bytes
+  mb = (char *) m_stream.get (254);
+  if (mb) {
+    error (tl::translate ("Format error (too many bytes after END record)"));
+  }
+
+  mp_visitor->end_file (m_stream.pos ());
+}
+
+unsigned long
+OASISParser::do_read_name (unsigned char r, OASISVisitor::NameTable table, const char *what)
+{
+  //  read a name
+  std::string name = get_str ();
+
+  //  and the associated id - odd record types use implicit IDs
+  unsigned long id = 0;
+  if ((r % 2) != 0) {
+    id = m_next_id [table]++;
+    if (m_trace) {
+      trace (std::string (what) + " (\"" + name + "\")");
+    }
+  } else {
+    get (id);
+    if (m_trace) {
+      trace (std::string (what) + " (\"" + name + "\", id=" + tl::to_string (id) + ")");
+    }
+  }
+
+  //  resolve the selected cell's ID or name and the S_CELL_OFFSET property name
+  if (table == OASISVisitor::CellNames && m_select) {
+    if (m_select_name_valid && ! m_select_id_valid && name == m_select_name) {
+      m_select_id = id;
+      m_select_id_valid = true;
+    } else if (m_select_id_valid && ! m_select_name_valid && id == m_select_id) {
+      m_select_name = name;
+      m_select_name_valid = true;
+    }
+  } else if (table == OASISVisitor::PropNames && name == "S_CELL_OFFSET") {
+    m_cell_offset_propname_id = id;
+    m_cell_offset_propname_valid = true;
+  }
+
+  mp_visitor->name (table, id, name);
+
+  return id;
+}
+
+template <class Sink>
+void
+OASISParser::read_element_properties ()
+{
+  while (true) {
+
+    unsigned char m = get_byte ();
+    if (m == 28 || m == 29) {
+      //  the properties are records of their own for the byte range
+      if (! enter_record ()) {
+        break;
+      }
+      report_record<Sink> (m);
+    }
+
+    if (m == 28) {
+      read_properties<Sink> ();
+    } else if (m != 29) {
+      m_stream.unget (1);
+      break;
+    } else {
+      trace<Sink> ("PROPERTY (repeat)");
+      if (Sink::enabled) {
+        mp_visitor->property (m_mm_last_property_name, m_mm_last_value_list);
+      }
+    }
+
+  } 
+}
+
+template <class Sink>
+void 
+OASISParser::read_properties ()
+{
+  unsigned char m = get_byte ();
+
+  if (m & 0x04) {
+    if (m & 0x02) {
+      m_mm_last_property_name.by_id = true;
+      m_mm_last_property_name.name.clear ();
+      get (m_mm_last_property_name.id);
+      if (tracing<Sink> ()) {
+        trace<Sink> ("PROPERTY (id=" + tl::to_string (m_mm_last_property_name.id) + ")");
+      }
+    } else {
+      m_mm_last_property_name.by_id = false;
+      m_mm_last_property_name.id = 0;
+      get_str (m_mm_last_property_name.name);
+      if (tracing<Sink> ()) {
+        trace<Sink> ("PROPERTY (name=" + m_mm_last_property_name.name + ")");
+      }
+    }
+  } else {
+    trace<Sink> ("PROPERTY (same id)");
+  }
+
+  if (! (m & 0x08)) {
+
+    unsigned long n = ((unsigned long) (m >> 4)) & 0x0f;
+    if (n == 15) {
+      get (n);
+    }
+
+    m_mm_last_value_list.clear ();
+
+    int index = 0;
+    while (n > 0) {
+
+      m_mm_last_value_list.push_back (OASISPropertyValue ());
+      OASISPropertyValue &pv = m_mm_last_value_list.back ();
+
+      unsigned char t = get_byte ();
+      pv.type = t;
+
+      if (t < 8) {
+
+        m_stream.unget (1);
+        double v = get_real ();
+        pv.value = v;
+        if (tracing<Sink> ()) {
+          trace<Sink> (std::string ("value[") + tl::to_string (index) + "]=" + tl::to_string(v) + " (type " + tl::to_string (int (t)) + ")");
+        }
+
+      } else if (t == 8) {
+
+        unsigned long l;
+        get (l);
+        pv.value = l;
+        if (tracing<Sink> ()) {
+          trace<Sink> (std::string ("value[") + tl::to_string (index) + "]=" + tl::to_string(l) + " (type " + tl::to_string (int (t)) + ")");
+        }
+
+      } else if (t == 9) {
+
+        long l;
+        get (l);
+        pv.value = l;
+        if (tracing<Sink> ()) {
+          trace<Sink> (std::string ("value[") + tl::to_string (index) + "]=" + tl::to_string(l) + " (type " + tl::to_string (int (t)) + ")");
+        }
+
+      } else if (t == 10 || t == 11 || t == 12) {
+
+        std::string name;
+        get_str (name);
+        if (tracing<Sink> ()) {
+          trace<Sink> (std::string ("value[") + tl::to_string (index) + "]=" + name + " (type " + tl::to_string (int (t)) + ")");
+        }
+        pv.value = name;
+
+      } else if (t == 13 || t == 14 || t == 15) {
+
+        unsigned long id;
+        get (id);
+        pv.value = id;
+        if (tracing<Sink> ()) {
+          trace<Sink> (std::string ("value[") + tl::to_string (index) + "]=" + tl::to_string(id) + " (propstring-ref, type " + tl::to_string (int (t)) + ")");
+        }
+
+      } else {
+        error (tl::sprintf (tl::translate ("Invalid property value type %d"), int (t)));
+      }
+
+      --n;
+      ++index;
+
+    }
+
+  }
+
+  if (Sink::enabled) {
+    mp_visitor->property (m_mm_last_property_name, m_mm_last_value_list);
+  }
+}
+
+/**
+ *  @brief Turns a sequence of deltas into absolute points (in-place prefix sum)
+ */
+static void
+accumulate_points (std::vector<db::Point> &pts)
+{
+  db::Coord x = 0, y = 0;
+  for (std::vector<db::Point>::iterator p = pts.begin (); p != pts.end (); ++p) {
+    x += p->x ();
+    y += p->y ();
+    *p = db::Point (x, y);
+  }
+}
+
+template <class Sink>
+void 
+OASISParser::read_pointlist (std::vector<db::Point> &points, bool for_polygon)
+{
+  unsigned int type = get_uint ();
+
+  if (tracing<Sink> ()) {
+    trace<Sink> ("pointlist (type=" + tl::to_string (type) + ")");
+  }
+  
+  unsigned long n = 0;
+  get (n);
+  if (n == 0) {
+    error (tl::translate ("Invalid point list: length is zero").c_str ());
+  }
+
+  if (type > 5) {
+    error (tl::sprintf (tl::translate ("Invalid point list type %d"), type));
+  }
+
+  //  Stage 1: decode the deltas and remember where the bytes of each one end
+  //  (the first point is the origin)
+
+  points.clear ();
+  points.push_back (db::Point ());
+  m_point_ends.clear ();
+
+  try {
+
+    for (unsigned long i = 0; i < n; ++i) {
+
+      if (type == 0 || type == 1) {
+        db::Coord d = get_coord ();
+        if ((i % 2 == 0) == (type == 0)) {
+          points.push_back (db::Point (d, 0));
+        } else {
+          points.push_back (db::Point (0, d));
+        }
+      } else if (type == 2) {
+        points.push_back (get_2delta ());
+      } else if (type == 3) {
+        points.push_back (get_3delta ());
+      } else {
+        points.push_back (get_gdelta ());
+      }
+
+      if (tracing<Sink> ()) {
+        m_point_ends.push_back (m_stream.n_recorded ());
+      }
+
+    }
+
+  } catch (...) {
+    //  show the points read so far before reporting the error
+    if (tracing<Sink> ()) {
+      if (type == 5) {
+        accumulate_points (points);
+      }
+      accumulate_points (points);
+      trace_points (points);
+    }
+    throw;
+  }
+
+  //  Stage 2: accumulate the deltas - double deltas need two passes
+
+  if (type == 5) {
+    accumulate_points (points);
+  }
+  accumulate_points (points);
+
+  //  Stage 3: format one line per point
+
+  if (tracing<Sink> ()) {
+    trace_points (points);
+  }
+
+  //  for polygons, type 0 and 1 lists imply a last point
+  if (for_polygon && type <= 1) {
+    bool last_h = (((n - 1) % 2 == 0) == (type == 0));
+    db::Point last = points.back ();
+    if (last_h) {
+      points.push_back (db::Point (last.x (), 0));
+    } else {
+      points.push_back (db::Point (0, last.y ()));
+    }
+  }
+}
+
+void
+OASISParser::trace_points (const std::vector<db::Point> &points)
+{
+  size_t first_pos = m_stream.pos () - m_stream.n_recorded ();
+  const char *rec = m_stream.recorded ();
+
+  size_t from = 0;
+  for (size_t i = 0; i < m_point_ends.size (); ++i) {
+    size_t to = m_point_ends [i];
+    mp_visitor->trace (first_pos + from, rec + from, to - from, "  xy=" + points [i + 1].to_string ());
+    from = to;
+  }
+
+  m_stream.reset_recording ();
+}
+
+template <class Sink>
+void
+OASISParser::read_repetition ()
+{
+  unsigned int type = get_uint ();
+  if (tracing<Sink> ()) {
+    trace<Sink> ("repetition (type=" + tl::to_string (type) + ")");
+  }
+  
+  if (type == 0) {
+    
+    //  reuse modal variable
+    return;
+
+  }
+
+  OASISRepetition &rep = m_mm_repetition;
+  rep = OASISRepetition ();
+  rep.type = type;
+
+  if (type == 1) {
+
+    unsigned long nx = 0, ny = 0;
+    get (nx); 
+    trace<Sink> ("  nx=", nx);
+    get (ny);
+    trace<Sink> ("  ny=", ny);
+
+    db::Coord dx = get_ucoord ();
+    trace<Sink> ("  dx=", dx);
+    db::Coord dy = get_ucoord ();
+    trace<Sink> ("  dy=", dy);
+
+    rep.na = nx + 2;
+    rep.nb = ny + 2;
+    rep.a = db::Point (dx, 0);
+    rep.b = db::Point (0, dy);
+
+  } else if (type == 2) {
+
+    unsigned long nx = 0;
+    get (nx); 
+    trace<Sink> ("  nx=", nx);
+
+    db::Coord dx = get_ucoord ();
+    trace<Sink> ("  dx=", dx);
+
+    rep.na = nx + 2;
+    rep.a = db::Point (dx, 0);
+
+  } else if (type == 3) {
+
+    unsigned long ny = 0;
+    get (ny);
+    trace<Sink> ("  ny=", ny);
+
+    db::Coord dy = get_ucoord ();
+    trace<Sink> ("  dy=", dy);
+
+    rep.na = ny + 2;
+    rep.a = db::Point (0, dy);
+
+  } else if (type == 4 || type == 5) {
+    
+    unsigned long n = 0;
+    get (n);
+    trace<Sink> ("  n=", n);
+
+    unsigned long lgrid = 1;
+    if (type == 5) {
+      get (lgrid);
+      trace<Sink> ("  grid=", lgrid);
+    }
+
+    rep.offsets.push_back (db::Point ());
+
+    db::Coord x = 0;
+    for (unsigned long i = 0; i <= n; ++i) {
+      x += get_ucoord (lgrid);
+      trace<Sink> ("  x=", x);
+      rep.offsets.push_back (db::Point (x, 0));
+    }
+
+  } else if (type == 6 || type == 7) {
+    
+    unsigned long n = 0;
+    get (n);
+    trace<Sink> ("  n=", n);
+
+    unsigned long lgrid = 1;
+    if (type == 7) {
+      get (lgrid);
+      trace<Sink> ("  grid=", lgrid);
+    }
+
+    rep.offsets.push_back (db::Point ());
+
+    db::Coord y = 0;
+    for (unsigned long i = 0; i <= n; ++i) {
+      y += get_ucoord (lgrid);
+      trace<Sink> ("  y=", y);
+      rep.offsets.push_back (db::Point (0, y));
+    }
+
+  } else if (type == 8) {
+
+    unsigned long n = 0, m = 0;
+
+    get (n); 
+    trace<Sink> ("  n=", n);
+    get (m);
+    trace<Sink> ("  m=", m);
+    db::Point dn = get_gdelta (); 
+    trace<Sink> ("  dn=", dn);
+    db::Point dm = get_gdelta (); 
+    trace<Sink> ("  dm=", dm);
+
+    rep.na = n + 2;
+    rep.nb = m + 2;
+    rep.a = dn;
+    rep.b = dm;
+
+  } else if (type == 9) {
+
+    unsigned long n = 0;
+    get (n); 
+    trace<Sink> ("  n=", n);
+    db::Point dn = get_gdelta (); 
+    trace<Sink> ("  dn=", dn);
+
+    rep.na = n + 2;
+    rep.a = dn;
+
+  } else if (type == 10 || type == 11) {
+
+    unsigned long n = 0;
+    get (n);
+    trace<Sink> ("  n=", n);
+
+    unsigned long grid = 1;
+    if (type == 11) {
+      get (grid);
+      trace<Sink> ("  grid=", grid);
+    }
+
+    rep.offsets.push_back (db::Point ());
+
+    db::Point p;
+    for (unsigned long i = 0; i <= n; ++i) {
+      p += get_gdelta (grid);
+      trace<Sink> ("  xy=", p);
+      rep.offsets.push_back (p);
+    }
+
+  } else {
+    error (tl::sprintf (tl::translate ("Invalid repetition type %d"), type));
+  }
+}
+
+template <class Sink>
+db::Coord
+OASISParser::read_x (unsigned char m, unsigned char mask, db::Coord &mm_x)
+{
+  if (m & mask) {
+    db::Coord x;
+    get (x);
+    trace<Sink> ("x=", x);
+    if (m_xy_absolute) {
+      mm_x = x;
+    } else {
+      mm_x += x;
+    }
+  }
+  return mm_x;
+}
+
+template <class Sink>
+db::Coord
+OASISParser::read_y (unsigned char m, unsigned char mask, db::Coord &mm_y)
+{
+  if (m & mask) {
+    db::Coord y;
+    get (y);
+    trace<Sink> ("y=", y);
+    if (m_xy_absolute) {
+      mm_y = y;
+    } else {
+      mm_y += y;
+    }
+  }
+  return mm_y;
+}
+
+template <class Sink>
+void 
+OASISParser::do_read_placement (unsigned int r)
+{
+  unsigned char m = get_byte ();
+  trace<Sink> ("PLACEMENT");
+
+  //  locate cell
+  if (m & 0x80) {
+
+    if (m & 0x40) {
+
+      //  cell by id
+      m_mm_placement_cell.by_id = true;
+      m_mm_placement_cell.name.clear ();
+      get (m_mm_placement_cell.id);
+
+      trace<Sink> ("id=", m_mm_placement_cell.id);
+
+    } else {
+
+      //  cell by name
+      m_mm_placement_cell.by_id = false;
+      m_mm_placement_cell.id = 0;
+      get_str (m_mm_placement_cell.name);
+      trace<Sink> ("name=", m_mm_placement_cell.name);
+
+    }
+
+  } 
+
+  double mag = 1.0;
+  double angle_deg = 0.0;
+
+  if (r == 18) {
+
+    if (m & 0x04) {
+      mag = get_real ();
+      trace<Sink> ("mag=", mag);
+    }
+
+    if (m & 0x02) {
+      angle_deg = get_real ();
+      trace<Sink> ("angle=", angle_deg);
+    }
+
+  } else {
+    angle_deg = ((m >> 1) & 3) * 90.0;
+  }
+      
+  bool mirror = (m & 0x01) != 0;
+
+  db::Coord x = read_x<Sink> (m, 0x20, m_mm_placement_x);
+  db::Coord y = read_y<Sink> (m, 0x10, m_mm_placement_y);
+
+  const OASISRepetition *rep = 0;
+  if (m & 0x8) {
+    read_repetition<Sink> ();
+    rep = &m_mm_repetition;
+  } 
+
+  if (Sink::enabled) {
+    mp_visitor->placement (m_mm_placement_cell, db::Point (x, y), mag, angle_deg, mirror, rep);
+  }
+
+  read_element_properties<Sink> ();
+}
+
+template <class Sink>
+void 
+OASISParser::do_read_text ()
+{
+  unsigned char m = get_byte ();
+
+  trace<Sink> ("TEXT");
+
+  if (m & 0x40) {
+    if (m & 0x20) {
+      m_mm_text_string.by_id = true;
+      m_mm_text_string.name.clear ();
+      get (m_mm_text_string.id);
+      trace<Sink> ("id=", m_mm_text_string.id);
+    } else {
+      m_mm_text_string.by_id = false;
+      m_mm_text_string.id = 0;
+      get_str (m_mm_text_string.name);
+      trace<Sink> ("Text=", m_mm_text_string.name);
+    }
+  } 
+
+  if (m & 0x1) {
+    m_mm_textlayer = get_uint ();
+    trace<Sink> ("layer=", m_mm_textlayer);
+  }
+
+  if (m & 0x2) {
+    m_mm_texttype = get_uint ();
+    trace<Sink> ("texttype=", m_mm_texttype);
+  }
+
+  db::Coord x = read_x<Sink> (m, 0x10, m_mm_text_x);
+  db::Coord y = read_y<Sink> (m, 0x8, m_mm_text_y);
+
+  const OASISRepetition *rep = 0;
+  if (m & 0x4) {
+    read_repetition<Sink> ();
+    rep = &m_mm_repetition;
+  }
+
+  if (Sink::enabled) {
+    mp_visitor->text (m_mm_text_string, m_mm_textlayer, m_mm_texttype, db::Point (x, y), rep);
+  }
+
+  read_element_properties<Sink> ();
+}
+
+template <class Sink>
+void 
+OASISParser::do_read_rectangle ()
+{
+  unsigned char m = get_byte ();
+
+  trace<Sink> ("RECTANGLE");
+
+  if (m & 0x1) {
+    m_mm_layer = get_uint ();
+    trace<Sink> ("layer=", m_mm_layer);
+  }
+
+  if (m & 0x2) {
+    m_mm_datatype = get_uint ();
+    trace<Sink> ("datatype=", m_mm_datatype);
+  }
+
+  if (m & 0x40) {
+    m_mm_geometry_w = get_ucoord ();
+    trace<Sink> ("width=", m_mm_geometry_w);
+  } 
+  if (m & 0x80) {
+    //  square
+    m_mm_geometry_h = m_mm_geometry_w;
+  } else {
+    if (m & 0x20) {
+      m_mm_geometry_h = get_ucoord ();
+      trace<Sink> ("height=", m_mm_geometry_h);
+    } 
+  }
+
+  db::Coord x = read_x<Sink> (m, 0x10, m_mm_geometry_x);
+  db::Coord y = read_y<Sink> (m, 0x8, m_mm_geometry_y);
+
+  const OASISRepetition *rep = 0;
+  if (m & 0x4) {
+    read_repetition<Sink> ();
+    rep = &m_mm_repetition;
+  }
+
+  if (Sink::enabled) {
+    mp_visitor->rectangle (m_mm_layer, m_mm_datatype, db::Point (x, y), m_mm_geometry_w, m_mm_geometry_h, rep);
+  }
+
+  read_element_properties<Sink> ();
+}
+
+template <class Sink>
+void  
+OASISParser::do_read_polygon ()
+{
+  unsigned char m = get_byte ();
+  trace<Sink> ("POLYGON");
+
+  if (m & 0x1) {
+    m_mm_layer = get_uint ();
+    trace<Sink> ("layer=", m_mm_layer);
+  }
+
+  if (m & 0x2) {
+    m_mm_datatype = get_uint ();
+    trace<Sink> ("datatype=", m_mm_datatype);
+  }
+
+  if (m & 0x20) {
+    read_pointlist<Sink> (m_mm_polygon_point_list, true);
+  }
+
+  db::Coord x = read_x<Sink> (m, 0x10, m_mm_geometry_x);
+  db::Coord y = read_y<Sink> (m, 0x8, m_mm_geometry_y);
+
+  const OASISRepetition *rep = 0;
+  if (m & 0x4) {
+    read_repetition<Sink> ();
+    rep = &m_mm_repetition;
+  }
+
+  const std::vector<db::Point> &pts = m_mm_polygon_point_list;
+  if (Sink::enabled) {
+    mp_visitor->polygon (m_mm_layer, m_mm_datatype, db::Point (x, y), pts.empty () ? 0 : &pts.front (), pts.size (), rep);
+  }
+
+  read_element_properties<Sink> ();
+}
+
+template <class Sink>
+void  
+OASISParser::do_read_path ()
+{
+  unsigned char m = get_byte ();
+  trace<Sink> ("PATH");
+
+  if (m & 0x1) {
+    m_mm_layer = get_uint ();
+    trace<Sink> ("layer=", m_mm_layer);
+  }
+
+  if (m & 0x2) {
+    m_mm_datatype = get_uint ();
+    trace<Sink> ("datatype=", m_mm_datatype);
+  }
+
+  if (m & 0x40) {
+    m_mm_path_halfwidth = get_ucoord ();
+    trace<Sink> ("half_width=", m_mm_path_halfwidth);
+  }
+
+  if (m & 0x80) {
+
+    unsigned int e = get_uint ();
+    if (tracing<Sink> ()) {
+      trace<Sink> ("extensions (type=" + tl::to_string (e) + ")");
+    }
+
+    if ((e & 0x0c) == 0x04) {
+      m_mm_path_start_extension = 0;
+    } else if ((e & 0x0c) == 0x08) {
+      m_mm_path_start_extension = m_mm_path_halfwidth;
+    } else if ((e & 0x0c) == 0x0c) {
+      m_mm_path_start_extension = get_coord ();
+      trace<Sink> ("  e1=", m_mm_path_start_extension);
+    }
+
+    if ((e & 0x03) == 0x01) {
+      m_mm_path_end_extension = 0;
+    } else if ((e & 0x03) == 0x02) {
+      m_mm_path_end_extension = m_mm_path_halfwidth;
+    } else if ((e & 0x03) == 0x03) {
+      m_mm_path_end_extension = get_coord ();
+      trace<Sink> ("  e2=", m_mm_path_end_extension);
+    }
+
+  }
+
+  if (m & 0x20) {
+    read_pointlist<Sink> (m_mm_path_point_list, false);
+  }
+
+  db::Coord x = read_x<Sink> (m, 0x10, m_mm_geometry_x);
+  db::Coord y = read_y<Sink> (m, 0x8, m_mm_geometry_y);
+
+  const OASISRepetition *rep = 0;
+  if (m & 0x4) {
+    read_repetition<Sink> ();
+    rep = &m_mm_repetition;
+  }
+
+  const std::vector<db::Point> &pts = m_mm_path_point_list;
+  if (Sink::enabled) {
+    mp_visitor->path (m_mm_layer, m_mm_datatype, m_mm_path_halfwidth, m_mm_path_start_extension, m_mm_path_end_extension, 
+                      db::Point (x, y), pts.empty () ? 0 : &pts.front (), pts.size (), rep);
+  }
+
+  read_element_properties<Sink> ();
+}
+
+template <class Sink>
+void  
+OASISParser::do_read_trapezoid (unsigned char r)
+{
+  unsigned char m = get_byte ();
+  trace<Sink> ("TRAPEZOID");
+
+  if (m & 0x1) {
+    m_mm_layer = get_uint ();
+    trace<Sink> ("layer=", m_mm_layer);
+  }
+
+  if (m & 0x2) {
+    m_mm_datatype = get_uint ();
+    trace<Sink> ("datatype=", m_mm_datatype);
+  }
+
+  if (m & 0x40) {
+    m_mm_geometry_w = get_ucoord ();
+    trace<Sink> ("w=", m_mm_geometry_w);
+  }
+
+  if (m & 0x20) {
+    m_mm_geometry_h = get_ucoord ();
+    trace<Sink> ("h=", m_mm_geometry_h);
+  }
+
+  db::Coord a = 0, b = 0;
+  if (r == 23 || r == 24) {
+    a = get_coord ();
+    trace<Sink> ("a=", a);
+  }
+  if (r == 23 || r == 25) {
+    b = get_coord ();
+    trace<Sink> ("b=", b);
+  }
+
+  db::Coord x = read_x<Sink> (m, 0x10, m_mm_geometry_x);
+  db::Coord y = read_y<Sink> (m, 0x8, m_mm_geometry_y);
+
+  const OASISRepetition *rep = 0;
+  if (m & 0x4) {
+    read_repetition<Sink> ();
+    rep = &m_mm_repetition;
+  }
+
+  if (Sink::enabled) {
+    mp_visitor->trapezoid (m_mm_layer, m_mm_datatype, db::Point (x, y), m_mm_geometry_w, m_mm_geometry_h, a, b, (m & 0x80) != 0, rep);
+  }
+
+  read_element_properties<Sink> ();
+}
+
+template <class Sink>
+void  
+OASISParser::do_read_ctrapezoid ()
+{
+  unsigned char m = get_byte ();
+  trace<Sink> ("CTRAPEZOID");
+
+  if (m & 0x1) {
+    m_mm_layer = get_uint ();
+    trace<Sink> ("layer=", m_mm_layer);
+  }
+
+  if (m & 0x2) {
+    m_mm_datatype = get_uint ();
+    trace<Sink> ("datatype=", m_mm_datatype);
+  }
+
+  if (m & 0x80) {
+    m_mm_ctrapezoid_type = get_uint ();
+    trace<Sink> ("type=(", m_mm_ctrapezoid_type);
+  }
+
+  if (m & 0x40) {
+    m_mm_geometry_w = get_ucoord ();
+    trace<Sink> ("w=", m_mm_geometry_w);
+  }
+
+  if (m & 0x20) {
+    m_mm_geometry_h = get_ucoord ();
+    trace<Sink> ("h=", m_mm_geometry_h);
+  }
+
+  db::Coord x = read_x<Sink> (m, 0x10, m_mm_geometry_x);
+  db::Coord y = read_y<Sink> (m, 0x8, m_mm_geometry_y);
+
+  const OASISRepetition *rep = 0;
+  if (m & 0x4) {
+    read_repetition<Sink> ();
+    rep = &m_mm_repetition;
+  }
+
+  if (Sink::enabled) {
+    mp_visitor->ctrapezoid (m_mm_layer, m_mm_datatype, m_mm_ctrapezoid_type, db::Point (x, y), m_mm_geometry_w, m_mm_geometry_h, rep);
+  }
+
+  read_element_properties<Sink> ();
+}
+
+template <class Sink>
+void  
+OASISParser::do_read_circle ()
+{
+  unsigned char m = get_byte ();
+  trace<Sink> ("CIRCLE");
+
+  if (m & 0x1) {
+    m_mm_layer = get_uint ();
+    trace<Sink> ("layer=", m_mm_layer);
+  }
+
+  if (m & 0x2) {
+    m_mm_datatype = get_uint ();
+    trace<Sink> ("datatype=", m_mm_datatype);
+  }
+
+  if (m & 0x20) {
+    m_mm_circle_radius = get_ucoord ();
+    trace<Sink> ("r=", m_mm_circle_radius);
+  }
+
+  db::Coord x = read_x<Sink> (m, 0x10, m_mm_geometry_x);
+  db::Coord y = read_y<Sink> (m, 0x8, m_mm_geometry_y);
+
+  const OASISRepetition *rep = 0;
+  if (m & 0x4) {
+    read_repetition<Sink> ();
+    rep = &m_mm_repetition;
+  }
+
+  if (Sink::enabled) {
+    mp_visitor->circle (m_mm_layer, m_mm_datatype, db::Point (x, y), m_mm_circle_radius, rep);
+  }
+
+  read_element_properties<Sink> ();
+}
+
+template <class Sink>
+void 
+OASISParser::do_read_cell ()
+{
+  //  read next record
+  while (true) {
+
+    unsigned char r = get_byte ();
+
+    //  any other record or the end of the byte range terminates the cell
+    if (! enter_record ()) {
+      break;
+    } else if (r != 0 && (r < 15 || r > 34)) {
+      //  put the byte back into the stream
+      m_stream.unget (1);
+      break;
+    }
+
+    report_record<Sink> (r);
+
+    if (r == 0 /*PAD*/) {
+
+      //  simply skip.
+
+    } else if (r == 15 /*XYABSOLUTE*/) {
+
+      //  switch to absolute mode
+      m_xy_absolute = true;
+      trace<Sink> ("XYABSOLUTE");
+
+    } else if (r == 16 /*XYRELATIVE*/) {
+
+      //  switch to relative mode
+      m_xy_absolute = false;
+      trace<Sink> ("XYRELATIVE");
+
+    } else if (r == 17 || r == 18 /*PLACEMENT*/) {
+
+      do_read_placement<Sink> (r);
+
+    } else if (r == 19 /*TEXT*/) {
+
+      do_read_text<Sink> ();
+
+    } else if (r == 20 /*RECTANGLE*/) {
+
+      do_read_rectangle<Sink> ();
+
+    } else if (r == 21 /*POLYGON*/) {
+
+      do_read_polygon<Sink> ();
+
+    } else if (r == 22 /*PATH*/) {
+
+      do_read_path<Sink> ();
+
+    } else if (r == 23 || r == 24 || r == 25 /*TRAPEZOID*/) {
+
+      do_read_trapezoid<Sink> (r);
+
+    } else if (r == 26 /*CTRAPEZOID*/) {
+
+      do_read_ctrapezoid<Sink> ();
+
+    } else if (r == 27 /*CIRCLE*/) {
+
+      do_read_circle<Sink> ();
+
+    } else if (r == 28 || r == 29 /*PROPERTY*/) {
+
+      if (r == 28) {
+        read_properties<Sink> ();
+      } else {
+        trace<Sink> ("PROPERTY (repeat)");
+        if (Sink::enabled) {
+          mp_visitor->property (m_mm_last_property_name, m_mm_last_value_list);
+        }
+      }
+
+    } else if (r == 32 /*XELEMENT*/) {
+
+      //  read over
+      get_ulong ();
+      get_str ();
+      trace<Sink> ("XELEMENT");
+
+    } else if (r == 33 /*XGEOMETRY*/) {
+
+      //  read over.
+
+      unsigned char m = get_byte ();
+      trace<Sink> ("XGEOMTERY");
+
+      unsigned int a = get_uint ();
+      trace<Sink> ("attribute=", a);
+
+      if (m & 0x1) {
+        m_mm_layer = get_uint ();
+        trace<Sink> ("layer=", m_mm_layer);
+      }
+
+      if (m & 0x2) {
+        m_mm_datatype = get_uint ();
+        trace<Sink> ("datatype=", m_mm_datatype);
+      }
+
+      //  data payload:
+      get_str ();
+      trace<Sink> ("data");
+
+      read_x<Sink> (m, 0x10, m_mm_geometry_x);
+      read_y<Sink> (m, 0x8, m_mm_geometry_y);
+
+      if (m & 0x4) {
+        read_repetition<Sink> ();
+      }
+
+    } else if (r == 34 /*CBLOCK*/) {
+
+      do_read_cblock ();
+
+    }
+
+  }
+}
+
+}
+
@@ -0,0 +1,684 @@
+/*
+
+  KLayout Layout Viewer
+  Copyright (C) 2013-2018 Matthias Koefferlein
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+
+
+#ifndef HDR_dbOASISParser
+#define HDR_dbOASISParser
+
+#include "tlException.h"
+#include "tlStream.h"
+#include "tlString.h"
+#include "tlVariant.h"
+#include "dbTypes.h"
+#include "dbPoint.h"
+#include "dbCellIndex.h"
+
+#include <vector>
+#include <string>
+
+namespace db
+{
+
+class OASISCBlockPrefetcher;
+
+/**
+ *  @brief Generic base class of OASIS parser exceptions
+ */
+class KLAYOUT_DLL OASISParserException
+  : public tl::Exception
+{
+public:
+  OASISParserException (const std::string &msg, size_t p, const std::string &cell)
+    : tl::Exception (tl::sprintf (tl::translate ("%s (position=%ld, cell=%s)"), msg, p, cell))
+  { }
+};
+
+/**
+ *  @brief A reference to a name: either the name itself or the ID of a name table entry
+ */
+struct OASISName
+{
+  OASISName ()
+    : by_id (false), id (0)
+  { }
+
+  bool by_id;
+  unsigned long id;
+  std::string name;
+};
+
+/**
+ *  @brief A repetition
+ *
+ *  Regular repetitions (types 1, 2, 3, 8 and 9) are given by two displacement
+ *  vectors "a" and "b" and the counts "na" and "nb". Irregular ones (types 4 to 7,
+ *  10 and 11) are given by the list of displacements, starting with (0, 0).
+ */
+struct OASISRepetition
+{
+  OASISRepetition ()
+    : type (0), na (1), nb (1)
+  { }
+
+  /**
+   *  @brief Gets a value indicating whether the repetition is a regular one
+   */
+  bool is_regular () const
+  {
+    return offsets.empty ();
+  }
+
+  /**
+   *  @brief Gets the number of instances the repetition produces
+   */
+  size_t size () const
+  {
+    return is_regular () ? size_t (na) * size_t (nb) : offsets.size ();
+  }
+
+  unsigned int type;
+  unsigned long na, nb;
+  db::Point a, b;
+  std::vector<db::Point> offsets;
+};
+
+/**
+ *  @brief A property value
+ *
+ *  "type" is the OASIS value type (0..15). Values of type 13 to 15 are references
+ *  to PROPSTRING entries. For those, "value" is the ID.
+ */
+struct OASISPropertyValue
+{
+  OASISPropertyValue ()
+    : type (0)
+  { }
+
+  unsigned int type;
+  tl::Variant value;
+};
+
+/**
+ *  @brief The receiver of the parser's events
+ *
+ *  The parser resolves the modal variables and delivers the records with their
+ *  effective values. Positions are absolute, even in XYRELATIVE mode. Point lists
+ *  are relative to the position and include the first point (0, 0) and - for
+ *  polygons given by point list types 0 and 1 - the implicit last point.
+ *  "rep" is 0 if the element has no repetition.
+ *
+ *  The default implementations do nothing.
+ */
+class KLAYOUT_DLL OASISVisitor
+{
+public:
+  /**
+   *  @brief Identifies the name tables
+   */
+  enum NameTable { CellNames, TextStrings, PropNames, PropStrings };
+
+  /**
+   *  @brief Destructor
+   */
+  virtual ~OASISVisitor () { }
+
+  /**
+   *  @brief Returns true, if the visitor wants to receive "trace" events
+   *
+   *  Tracing is expensive as every field is formatted and the bytes are recorded.
+   */
+  virtual bool wants_trace () const { return false; }
+
+  /**
+   *  @brief Returns true, if the visitor wants to receive the events for the records inside cells
+   *
+   *  If false, the contents of the cells are decoded and validated only. This
+   *  path is instantiated with OASISNullSink, so no event is delivered and no 
+   *  field is formatted. The cell, name table and file level events are still 
+   *  delivered.
+   */
+  virtual bool wants_elements () const { return true; }
+
+  /**
+   *  @brief Delivers a field of the file with the bytes it was read from
+   *
+   *  "pos" is the position of the first byte. Inside CBLOCKs, the bytes are the
+   *  compressed ones which were consumed for decoding the field.
+   */
+  virtual void trace (size_t /*pos*/, const char * /*data*/, size_t /*n*/, const std::string & /*msg*/) { }
+
+  /**
+   *  @brief Reports a warning
+   *
+   *  The default implementation prints the warning to std::cerr.
+   */
+  virtual void warn (const std::string &msg, size_t pos);
+
+  virtual void begin_file (const std::string & /*version*/, double /*resolution*/) { }
+
+  /**
+   *  @brief Reports the end of the file
+   *
+   *  "pos" is the file position after the END record.
+   */
+  virtual void end_file (size_t /*pos*/) { }
+
+  /**
+   *  @brief Reports the start of a record
+   *
+   *  "type" is the record type and "pos" the position of the record type byte.
+   *  If "inflated" is true, the record is inside a CBLOCK and "pos" is the offset 
+   *  inside the uncompressed data. A record extends up to the next record of the 
+   *  same kind, the end of the CBLOCK or the end of the file.
+   *  This event is cheap and delivered without tracing.
+   */
+  virtual void record (unsigned int /*type*/, size_t /*pos*/, bool /*inflated*/) { }
+
+  /**
+   *  @brief Reports a CBLOCK
+   *
+   *  "pos" is the position of the CBLOCK record. The records inside the CBLOCK
+   *  follow with "inflated" set to true.
+   */
+  virtual void cblock (size_t /*pos*/, size_t /*comp_bytes*/, size_t /*uncomp_bytes*/) { }
+
+  /**
+   *  @brief A name table entry (CELLNAME, TEXTSTRING, PROPNAME, PROPSTRING)
+   *
+   *  Implicit IDs are resolved.
+   */
+  virtual void name (NameTable /*table*/, unsigned long /*id*/, const std::string & /*name*/) { }
+
+  /**
+   *  @brief A LAYERNAME entry (for geometry or texts)
+   */
+  virtual void layer_name (bool /*for_text*/, const std::string & /*name*/, unsigned int /*l1*/, unsigned int /*l2*/, unsigned int /*dt1*/, unsigned int /*dt2*/) { }
+
+  virtual void begin_cell (const OASISName & /*cell*/) { }
+  virtual void end_cell () { }
+
+  virtual void placement (const OASISName & /*cell*/, const db::Point & /*pos*/, double /*mag*/, double /*angle*/, bool /*mirror*/, const OASISRepetition * /*rep*/) { }
+  virtual void text (const OASISName & /*string*/, unsigned int /*layer*/, unsigned int /*texttype*/, const db::Point & /*pos*/, const OASISRepetition * /*rep*/) { }
+  virtual void rectangle (unsigned int /*layer*/, unsigned int /*datatype*/, const db::Point & /*pos*/, db::Coord /*w*/, db::Coord /*h*/, const OASISRepetition * /*rep*/) { }
+  virtual void polygon (unsigned int /*layer*/, unsigned int /*datatype*/, const db::Point & /*pos*/, const db::Point * /*points*/, size_t /*n*/, const OASISRepetition * /*rep*/) { }
+  virtual void path (unsigned int /*layer*/, unsigned int /*datatype*/, db::Coord /*half_width*/, db::Coord /*bgn_ext*/, db::Coord /*end_ext*/, const db::Point & /*pos*/, const db::Point * /*points*/, size_t /*n*/, const OASISRepetition * /*rep*/) { }
+  virtual void trapezoid (unsigned int /*layer*/, unsigned int /*datatype*/, const db::Point & /*pos*/, db::Coord /*w*/, db::Coord /*h*/, db::Coord /*a*/, db::Coord /*b*/, bool /*vertical*/, const OASISRepetition * /*rep*/) { }
+  virtual void ctrapezoid (unsigned int /*layer*/, unsigned int /*datatype*/, unsigned int /*type*/, const db::Point & /*pos*/, db::Coord /*w*/, db::Coord /*h*/, const OASISRepetition * /*rep*/) { }
+  virtual void circle (unsigned int /*layer*/, unsigned int /*datatype*/, const db::Point & /*pos*/, db::Coord /*r*/, const OASISRepetition * /*rep*/) { }
+
+  /**
+   *  @brief A property attached to the preceding element, cell or file
+   */
+  virtual void property (const OASISName & /*name*/, const std::vector<OASISPropertyValue> & /*values*/) { }
+};
+
+/**
+ *  @brief A position from which the parser can resume reading
+ *
+ *  These positions are taken at the CELL records (see OASISParser::scan_cells).
+ *  "offset", "in_cblock" and "inner_offset" have the same meaning as in CellIndexEntry.
+ *  "next_id" holds the counters for the implicit IDs of the name tables.
+ */
+struct OASISResumePosition
+{
+  OASISResumePosition ()
+    : offset (0), in_cblock (false), inner_offset (0)
+  {
+    for (unsigned int i = 0; i < sizeof (next_id) / sizeof (next_id [0]); ++i) {
+      next_id [i] = 0;
+    }
+  }
+
+  size_t offset;
+  bool in_cblock;
+  size_t inner_offset;
+  unsigned long next_id [4];
+};
+
+/**
+ *  @brief The sink policy of the cell content decoder delivering the events to the visitor
+ *
+ *  The decoder for the records inside cells is a template on the sink policy. 
+ *  With OASISVisitorSink, the events are delivered to the visitor and the fields
+ *  are traced if the visitor asks for that.
+ */
+struct OASISVisitorSink
+{
+  static const bool enabled = true;
+};
+
+/**
+ *  @brief The sink policy of the cell content decoder which discards everything
+ *
+ *  With this policy, the event delivery and the tracing code compile away. The
+ *  records are still decoded and validated as they are by the dumper.
+ */
+struct OASISNullSink
+{
+  static const bool enabled = false;
+};
+
+/**
+ *  @brief The OASIS parser
+ *
+ *  The parser reads an OASIS file and delivers the records to a OASISVisitor.
+ */
+class KLAYOUT_DLL OASISParser
+{
+public:
+  /**
+   *  @brief Construct a parser object
+   *
+   *  @param s The stream delegate from which to read stream data from
+   */
+  OASISParser (tl::InputStreamBase &s);
+
+  /**
+   *  @brief Destructor
+   */
+  ~OASISParser ();
+
+  /**
+   *  @brief Set the number of threads used for inflating CBLOCKs
+   *
+   *  With more than one thread, the CBLOCKs are located ahead of the parser
+   *  and inflated in the background. This requires an input which provides
+   *  the file as a memory block (see tl::InputStreamBase::mapped_data).
+   *  Otherwise and while tracing, the CBLOCKs are inflated in the parser's thread.
+   */
+  void set_threads (unsigned int n)
+  {
+    m_threads = n;
+  }
+
+  /**
+   *  @brief Restricts the parser to the cell with the given name
+   *
+   *  With a cell selected, "parse" delivers the events of this cell only. If the
+   *  input supports random access, the parser locates the cell's record through the
+   *  CELLNAME table and the S_CELL_OFFSET properties. Otherwise or if this information
+   *  is not available, the parser reads over the records in front of the cell.
+   */
+  void select_cell (const std::string &name);
+
+  /**
+   *  @brief Restricts the parser to the cell with the given CELLNAME ID
+   *
+   *  See "select_cell" for details.
+   */
+  void select_cell_id (unsigned long id);
+
+  /**
+   *  @brief Sets a cell index to locate the selected cell
+   *
+   *  If an index is given, the selected cell is looked up there first. The parser
+   *  does not take ownership of the index.
+   */
+  void set_index (const CellIndex *index)
+  {
+    mp_index = index;
+  }
+
+  /**
+   *  @brief Restricts the parser to a range of file offsets
+   *
+   *  With a byte range, "parse" delivers the records starting from the first record
+   *  which begins at or after "from" up to the first record beginning at or after 
+   *  "to" (exclusive). "to" is 0 for reading to the end of the file. Records inside
+   *  CBLOCKs are delivered along with their CBLOCK. If "from" is inside a CBLOCK,
+   *  the range starts with this CBLOCK.
+   *
+   *  If the input supports random access, the parser jumps close to "from": it 
+   *  starts at the last cell before "from" if a cell index is given (see "set_index").
+   *  Otherwise, it probes the bytes in front of "from" (nearest first) for a position
+   *  from which a sequence of valid records leads to "from". The search is limited to
+   *  1 MB in front of "from" - beyond that, an error is reported and a cell index is required.
+   *  From the position found, it reads quietly up to "from". Without random access,
+   *  the file is read quietly up to the first record at or after "from".
+   */
+  void set_byte_range (size_t from, size_t to)
+  {
+    m_range = true;
+    m_range_from = from;
+    m_range_to = to;
+  }
+
+  /**
+   *  @brief Parses the file and delivers the events to the given visitor
+   */
+  void parse (OASISVisitor &visitor);
+
+  /**
+   *  @brief Reads and validates the file without delivering the cell contents
+   *
+   *  The cell contents are decoded with OASISNullSink, so this is the fastest way
+   *  of reading the whole file. Errors are reported as exceptions, warnings are
+   *  printed to std::cerr.
+   */
+  void check ();
+
+  /**
+   *  @brief Parses the file and collects the positions of the cells into the given index
+   */
+  void build_index (CellIndex &index);
+
+  /**
+   *  @brief Parses the file quietly and collects the positions of the CELL records
+   *
+   *  The positions can be used to parse the file in parts with "parse_range".
+   *  Warnings are not reported.
+   */
+  void scan_cells (std::vector<OASISResumePosition> &positions);
+
+  /**
+   *  @brief Parses a part of the file
+   *
+   *  Parsing starts at the CELL record given by "from" or at the beginning of the
+   *  file if "from" is null. It stops in front of the CELL record given by "to" or at
+   *  the end of the file if "to" is null. The visitor receives the events of this
+   *  part only. Parsing a part requires an input which provides the file as a memory
+   *  block (see tl::InputStreamBase::mapped_data).
+   */
+  void parse_range (OASISVisitor &visitor, const OASISResumePosition *from, const OASISResumePosition *to);
+
+  /**
+   *  @brief Gets the position of the current cell's CELL record
+   *
+   *  This information is valid from OASISVisitor::begin_cell on. See CellIndexEntry
+   *  for the meaning of the values.
+   */
+  void cell_position (size_t &offset, bool &in_cblock, size_t &inner_offset) const
+  {
+    offset = m_cell_offset;
+    in_cblock = m_cell_in_cblock;
+    inner_offset = m_cell_inner_offset;
+  }
+
+  /**
+   *  @brief Issue an error with positional informations
+   */
+  void error (const std::string &txt);
+
+  /**
+   *  @brief Issue a warning with positional informations
+   */
+  void warn (const std::string &txt);
+
+private:
+  friend class OASISCBlockPrefetcher;
+
+  tl::InputStreamBase *mp_source;
+  tl::InputStream m_stream;
+  OASISVisitor *mp_visitor;
+  OASISVisitor *mp_target;
+  OASISVisitor m_null_visitor;
+  bool m_trace;
+  bool m_want_trace;
+  bool m_elements;
+  unsigned int m_threads;
+  OASISCBlockPrefetcher *mp_prefetcher;
+  bool m_scout;
+  std::vector<size_t> m_point_ends;
+  unsigned long m_next_id [4];
+
+  //  cell selection
+  bool m_select;
+  bool m_select_name_valid, m_select_id_valid;
+  std::string m_select_name;
+  unsigned long m_select_id;
+  bool m_cell_offset_propname_valid;
+  unsigned long m_cell_offset_propname_id;
+  const CellIndex *mp_index;
+
+  //  the CBLOCK being read: its uncompressed size is checked when it ends
+  bool m_cblock_pending;
+  size_t m_cblock_uncomp_bytes;
+
+  //  position of the current cell
+  size_t m_cblock_pos;
+  size_t m_cell_offset;
+  bool m_cell_in_cblock;
+  size_t m_cell_inner_offset;
+
+  //  cell positions for scan_cells and parse_range
+  std::vector<OASISResumePosition> *mp_positions;
+  const OASISResumePosition *mp_stop;
+  bool m_range;
+  size_t m_range_from, m_range_to;
+  bool m_range_active;
+  size_t m_stop_at, m_trace_from;
+
+  //  modal variables
+  bool m_xy_absolute;
+  OASISRepetition m_mm_repetition;
+  OASISName m_mm_placement_cell;
+  db::Coord m_mm_placement_x, m_mm_placement_y;
+  unsigned int m_mm_layer, m_mm_datatype;
+  unsigned int m_mm_textlayer, m_mm_texttype;
+  db::Coord m_mm_text_x, m_mm_text_y;
+  OASISName m_mm_text_string;
+  db::Coord m_mm_geometry_x, m_mm_geometry_y;
+  db::Coord m_mm_geometry_w, m_mm_geometry_h;
+  std::vector<db::Point> m_mm_polygon_point_list;
+  std::vector<db::Point> m_mm_path_point_list;
+  db::Coord m_mm_path_halfwidth;
+  db::Coord m_mm_path_start_extension, m_mm_path_end_extension;
+  unsigned int m_mm_ctrapezoid_type;
+  db::Coord m_mm_circle_radius;
+  OASISName m_mm_last_property_name;
+  std::vector<OASISPropertyValue> m_mm_last_value_list;
+
+  void reset_modal_variables ();
+
+  void do_parse ();
+  bool do_read_header ();
+  void do_read_records (bool table_offsets_at_end);
+  void do_read_from (size_t pos, bool table_offsets_at_end);
+  void do_parse_byte_range ();
+  void check_range_delivered ();
+  size_t find_resync_position (size_t start);
+  bool probe_records (size_t pos, size_t stop_at, size_t &count);
+  void skip_inflated (size_t n);
+  bool do_parse_cell_at_offset ();
+  bool locate_cell (size_t &offset);
+  bool lookup_cell (size_t &offset, size_t &inner_offset);
+  bool is_selected (const OASISName &cell) const;
+  void do_read_selected_cell (const OASISName &cell);
+  void trace_cell (const OASISName &cell);
+  unsigned long do_read_name (unsigned char r, OASISVisitor::NameTable table, const char *what);
+  void do_read_cblock ();
+  void start_range_in_cblock ();
+  void check_cblock_size ();
+  void seek (size_t pos);
+
+  //  the cell content decoder, instantiated for OASISVisitorSink and OASISNullSink
+  template <class Sink> void do_read_cell ();
+  template <class Sink> void do_read_placement (unsigned int r);
+  template <class Sink> void do_read_text ();
+  template <class Sink> void do_read_rectangle ();
+  template <class Sink> void do_read_polygon ();
+  template <class Sink> void do_read_path ();
+  template <class Sink> void do_read_trapezoid (unsigned char r);
+  template <class Sink> void do_read_ctrapezoid ();
+  template <class Sink> void do_read_circle ();
+
+  template <class Sink> void read_repetition ();
+  template <class Sink> void read_pointlist (std::vector<db::Point> &points, bool for_polygon);
+  void trace_points (const std::vector<db::Point> &points);
+  template <class Sink> void read_properties ();
+  template <class Sink> void read_element_properties ();
+
+  template <class Sink> db::Coord read_x (unsigned char m, unsigned char mask, db::Coord &mm_x);
+  template <class Sink> db::Coord read_y (unsigned char m, unsigned char mask, db::Coord &mm_y);
+
+  void do_trace (const std::string &msg);
+
+  /**
+   *  @brief Applies the byte range after the record type byte has been read
+   *
+   *  Returns false if the record starts at or after the end of the range. In 
+   *  that case, the record type byte is put back.
+   */
+  bool enter_record ()
+  {
+    if (m_cblock_pending && ! m_stream.inflating ()) {
+      check_cblock_size ();
+    }
+
+    if (! m_range_active || m_stream.inflating ()) {
+      return true;
+    }
+
+    size_t pos = m_stream.pos () - 1;
+    if (m_stop_at > 0 && pos >= m_stop_at) {
+      m_stream.unget (1);
+      return false;
+    }
+
+    if (m_trace_from > 0 && pos >= m_trace_from) {
+      //  start tracing with this record
+      m_trace_from = 0;
+      mp_visitor = mp_target;
+      m_trace = m_want_trace;
+      if (m_trace) {
+        m_stream.unget (1);
+        m_stream.start_recording ();
+        m_stream.get (1);
+      }
+    }
+
+    return true;
+  }
+
+  /**
+   *  @brief Reports the record whose type byte "r" has just been read
+   */
+  template <class Sink = OASISVisitorSink>
+  void report_record (unsigned char r)
+  {
+    if (! Sink::enabled) {
+      //  nothing to report
+    } else if (m_stream.inflating ()) {
+      mp_visitor->record (r, m_stream.inflated_pos () - 1, true);
+    } else {
+      mp_visitor->record (r, m_stream.pos () - 1, false);
+    }
+  }
+
+  template <class Sink>
+  bool tracing () const
+  {
+    return Sink::enabled && m_trace;
+  }
+
+  template <class Sink = OASISVisitorSink>
+  void trace (const char *msg)
+  {
+    if (tracing<Sink> ()) {
+      do_trace (std::string (msg));
+    }
+  }
+
+  template <class Sink = OASISVisitorSink>
+  void trace (const std::string &msg)
+  {
+    if (tracing<Sink> ()) {
+      do_trace (msg);
+    }
+  }
+
+  template <class Sink = OASISVisitorSink, class T>
+  void trace (const char *label, const T &value)
+  {
+    if (tracing<Sink> ()) {
+      do_trace (label + tl::to_string (value));
+    }
+  }
+
+  unsigned char get_byte ()
+  {
+    unsigned char *b = (unsigned char *) m_stream.get (1);
+    if (! b) {
+      error (tl::translate ("Unexpected end-of-file"));
+      return 0;
+    } else {
+      return *b;
+    }
+  }
+
+  template <class T> T get_unsigned (const char *overflow_msg);
+  long long get_long_long ();
+  unsigned long long get_ulong_long ();
+  long get_long ();
+  unsigned long get_ulong ();
+  int get_int ();
+  unsigned int get_uint ();
+
+  void get (long long &l)
+  {
+    l = get_long_long ();
+  }
+
+  void get (unsigned long long &l)
+  {
+    l = get_ulong_long ();
+  }
+
+  void get (long &l)
+  {
+    l = get_long ();
+  }
+
+  void get (unsigned long &l)
+  {
+    l = get_ulong ();
+  }
+
+  void get (int &l)
+  {
+    l = get_int ();
+  }
+
+  void get (unsigned int &l)
+  {
+    l = get_uint ();
+  }
+
+  void get (double &d)
+  {
+    d = get_real ();
+  }
+
+  std::string get_str ();
+  void get_str (std::string &s);
+  double get_real ();
+  db::Point get_gdelta (long grid = 1);
+  db::Point get_3delta (long grid = 1);
+  db::Point get_2delta (long grid = 1);
+  db::Coord get_coord (long grid = 1);
+  db::Coord get_ucoord (unsigned long grid = 1);
+};
+
+}
+
+#endif
+
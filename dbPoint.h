@@ -71,6 +71,18 @@ public:
    */
   point (const point<C> &d) : m_x (d.x ()), m_y (d.y ()) { }
 
+  /**
+   *  @brief Assignment
+   *
+   *  @param d The source from which to take the data
+   */
+  point<C> &operator= (const point<C> &d)
+  {
+    m_x = d.x ();
+    m_y = d.y ();
+    return *this;
+  }
+
   /**
    *  @brief The copy constructor that converts also
    *
@@ -21,8 +21,11 @@
 
 
 #include "dbGDS2Dumper.h"
+#include "tlBatch.h"
 
 #include <iostream>
+#include <memory>
+#include <limits>
 
 const char *version = "0.1";
 
@@ -34,11 +37,26 @@ void syntax ()
   std::cout << 
     "dump_gds2 - An GDS2 file disassembly tool" << std::endl <<
     std::endl <<
-    "Usage: dump_gds2 [options] [GDS2 file]" << std::endl <<
+    "Usage: dump_gds2 [options] [GDS2 file] ..." << std::endl <<
+    std::endl <<
+    "With more than one file, the files are processed in parallel (see -j). \"@<file>\"" << std::endl <<
+    "reads the file names from the given file, one per line." << std::endl <<
     std::endl <<
     "Options:" << std::endl <<
     "  -n <width>     number of bytes to print per line" << std::endl <<
     "  -s             short: abbreviate hex dump with more than \"width\" bytes" << std::endl <<
+    "  -o <file>      write the dump to the given file instead of stdout" << std::endl <<
+    "  -j <threads>   number of threads for formatting the records or for processing files" << std::endl <<
+    "  --output-suffix <suffix>" << std::endl <<
+    "                 write the output for each file to the file name plus suffix" << std::endl <<
+    "  --cell <name>  dump only the structure with the given name" << std::endl <<
+    "  --build-index  write a cell index file for faster --cell lookups instead of dumping" << std::endl <<
+    "  --stats        print record counts and bytes per record type and structure instead of dumping" << std::endl <<
+    "  --scan         list the structures with offsets, sizes and element counts instead of dumping" << std::endl <<
+    "  --check        validate the record sequence against the GDS2 syntax without dumping" << std::endl <<
+    "  --hierarchy    print the structure hierarchy with flattened instance counts instead of dumping" << std::endl <<
+    "  --from <pos>   start dumping at the first record at or after the given file offset" << std::endl <<
+    "  --to <pos>     stop dumping before the first record at or after the given file offset" << std::endl <<
     std::endl <<
     "Version " << version << std::endl <<
     std::endl <<
@@ -46,6 +64,111 @@ void syntax ()
     "Distributed under GPL V2 or later" << std::endl;
 }
 
+/**
+ *  @brief The options for processing a file
+ */
+struct Options
+{
+  Options ()
+    : short_mode (false), width (8), threads (1), has_cell_name (false),
+      build_index (false), stats (false), scan (false), hierarchy (false), check (false),
+      from (0), to (std::numeric_limits<size_t>::max ()), has_range (false)
+  { }
+
+  bool short_mode;
+  int width;
+  int threads;
+  std::string cell_name;
+  bool has_cell_name;
+  bool build_index;
+  bool stats;
+  bool scan;
+  bool hierarchy;
+  bool check;
+  size_t from, to;
+  bool has_range;
+};
+
+/**
+ *  @brief Processes one file
+ */
+static void process_file (const std::string &input, const Options &opt, tl::OutputStream &out)
+{
+  std::unique_ptr<tl::InputStreamBase> file (tl::open_input_file (input));
+
+  if (opt.check) {
+
+    db::GDS2Dumper dumper (*file);
+    dumper.check ();
+
+    out.put (input + ": OK\n");
+    return;
+
+  }
+
+  if (opt.build_index) {
+
+    db::GDS2Dumper dumper (*file);
+
+    db::CellIndex index;
+    dumper.build_index (index);
+    index.write (input);
+
+    out.put (db::CellIndex::sidecar_path (input) + ": " + tl::to_string (index.size ()) + " cells\n");
+    return;
+
+  }
+
+  //  an up-to-date cell index speeds up locating the structure
+  db::CellIndex index;
+  if (opt.has_cell_name || opt.from > 0) {
+    index.load (input);
+  }
+
+  db::GDS2Dumper dumper (*file);
+  dumper.short_mode (opt.short_mode);
+  dumper.set_width (opt.width);
+  dumper.set_threads (opt.threads);
+  dumper.set_output (&out);
+  if (opt.has_cell_name) {
+    dumper.select_cell (opt.cell_name);
+  }
+  dumper.set_index (&index);
+  if (opt.has_range) {
+    dumper.set_byte_range (opt.from, opt.to);
+  }
+  if (opt.stats) {
+    dumper.dump_statistics ();
+  } else if (opt.scan) {
+    dumper.scan_structures ();
+  } else if (opt.hierarchy) {
+    dumper.dump_hierarchy ();
+  } else {
+    dumper.dump ();
+  }
+}
+
+/**
+ *  @brief A job processing one file of a batch
+ */
+class DumpJob
+  : public tl::BatchJob
+{
+public:
+  DumpJob (const std::string &input, const Options &opt)
+    : tl::BatchJob (input), m_options (opt)
+  { }
+
+protected:
+  virtual void process (tl::OutputStream &out)
+  {
+    process_file (input (), m_options, out);
+  }
+
+private:
+  Options m_options;
+};
+
 /**
  *  @brief The main function
  */
@@ -53,9 +176,10 @@ int main (int argc, const char *argv[])
 {
   try {
 
-    bool short_mode = false;
-    int width = 8;
-    std::string input;
+    Options opt;
+    std::string output;
+    std::string output_suffix;
+    std::vector<std::string> inputs;
 
     for (int i = 1; i < argc; ++i) {
       std::string a = argv [i];
@@ -64,29 +188,102 @@ int main (int argc, const char *argv[])
         return 1;
       } else if (a == "-n" && i < argc - 1) {
         ++i;
-        tl::from_string (argv [i], width);
-        if (width < 1 || width > 100000) {
+        tl::from_string (argv [i], opt.width);
+        if (opt.width < 1 || opt.width > 100000) {
           throw tl::Exception (tl::translate ("Invalid width specification for -n command line option"));
         }
+      } else if (a == "-j" && i < argc - 1) {
+        ++i;
+        tl::from_string (argv [i], opt.threads);
+        if (opt.threads < 1 || opt.threads > 1024) {
+          throw tl::Exception (tl::translate ("Invalid thread count for -j command line option"));
+        }
+      } else if (a == "-o" && i < argc - 1) {
+        ++i;
+        output = argv [i];
+      } else if (a == "--output-suffix" && i < argc - 1) {
+        ++i;
+        output_suffix = argv [i];
+      } else if (a == "--cell" && i < argc - 1) {
+        ++i;
+        opt.cell_name = argv [i];
+        opt.has_cell_name = true;
+      } else if (a == "--from" && i < argc - 1) {
+        ++i;
+        tl::from_string (argv [i], opt.from);
+        opt.has_range = true;
+      } else if (a == "--to" && i < argc - 1) {
+        ++i;
+        tl::from_string (argv [i], opt.to);
+        opt.has_range = true;
+      } else if (a == "--build-index") {
+        opt.build_index = true;
+      } else if (a == "--stats") {
+        opt.stats = true;
+      } else if (a == "--scan") {
+        opt.scan = true;
+      } else if (a == "--hierarchy") {
+        opt.hierarchy = true;
+      } else if (a == "--check") {
+        opt.check = true;
       } else if (a == "-s") {
-        short_mode = true;
+        opt.short_mode = true;
       } else if (a [0] == '-') {
         throw tl::Exception (tl::translate ("Unknown option ") + a);
       } else {
-        input = a;
+        tl::add_inputs (a, inputs);
       }
     }
 
-    if (input.empty ()) {
+    if (inputs.empty ()) {
       throw tl::Exception (tl::translate ("Input file missing"));
     }
+    if ((opt.stats || opt.scan || opt.hierarchy || opt.check) && opt.has_cell_name) {
+      throw tl::Exception (tl::translate ("--stats, --scan, --hierarchy and --check cannot be used together with --cell"));
+    }
+    if (int (opt.stats) + int (opt.scan) + int (opt.hierarchy) + int (opt.check) > 1) {
+      throw tl::Exception (tl::translate ("Only one of --stats, --scan, --hierarchy and --check can be used"));
+    }
+    if (opt.check && opt.build_index) {
+      throw tl::Exception (tl::translate ("--check cannot be used together with --build-index"));
+    }
+    if (opt.has_range && (opt.has_cell_name || opt.stats || opt.scan || opt.hierarchy || opt.check || opt.build_index)) {
+      throw tl::Exception (tl::translate ("--from and --to cannot be used together with --cell, --stats, --scan, --hierarchy, --check or --build-index"));
+    }
+    if (opt.to <= opt.from) {
+      throw tl::Exception (tl::translate ("--to offset must be larger than --from offset"));
+    }
 
-    tl::InputZLibFile file (input);
+    //  the output is written in large chunks by a separate thread
+    std::unique_ptr<tl::OutputRawFile> out_file (output.empty () ? new tl::OutputRawFile (1, "stdout") : new tl::OutputRawFile (output));
+    tl::OutputBuffer out_buffer (*out_file, 1024 * 1024, true);
+    tl::OutputStream out (out_buffer);
 
-    db::GDS2Dumper dumper (file);
-    dumper.short_mode (short_mode);
-    dumper.set_width (width);
-    dumper.dump ();
+    if (inputs.size () == 1 && output_suffix.empty ()) {
+
+      process_file (inputs.front (), opt, out);
+
+    } else {
+
+      //  the threads are used for processing files in parallel then
+      tl::BatchRunner runner (opt.threads);
+      runner.set_output_suffix (output_suffix);
+
+      Options file_opt = opt;
+      file_opt.threads = 1;
+      for (std::vector<std::string>::const_iterator i = inputs.begin (); i != inputs.end (); ++i) {
+        runner.add (new DumpJob (*i, file_opt));
+      }
+
+      if (! runner.run (out)) {
+        out.flush ();
+        return 2;
+      }
+
+    }
+
+    //  reports write errors
+    out.flush ();
 
   } catch (tl::Exception &ex) {
     std::cerr << "*** ERROR: " << ex.msg () << std::endl;
@@ -95,4 +292,3 @@ int main (int argc, const char *argv[])
 
   return 0;
 }
-
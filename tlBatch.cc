@@ -0,0 +1,188 @@
+/*
+
+  KLayout Layout Viewer
+  Copyright (C) 2013-2018 Matthias Koefferlein
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+
+
+#include "tlBatch.h"
+#include "tlException.h"
+#include "tlString.h"
+
+#include <memory>
+#include <chrono>
+
+namespace tl
+{
+
+// ---------------------------------------------------------------
+//  BatchJob implementation
+
+BatchJob::BatchJob (const std::string &input)
+  : m_input (input), m_seconds (0.0)
+{
+  //  .. nothing yet ..
+}
+
+void
+BatchJob::run ()
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+
+  //  the time is recorded for failing files too
+  try {
+    do_process ();
+  } catch (...) {
+    m_seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+    throw;
+  }
+
+  m_seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+}
+
+void
+BatchJob::do_process ()
+{
+  if (m_output_path.empty ()) {
+
+    tl::OutputStream out (m_output);
+    process (out);
+    out.flush ();
+
+  } else {
+
+    tl::OutputRawFile file (m_output_path);
+    tl::OutputBuffer buffer (file);
+    tl::OutputStream out (buffer);
+    process (out);
+    out.flush ();
+
+  }
+}
+
+// ---------------------------------------------------------------
+//  BatchRunner implementation
+
+BatchRunner::BatchRunner (unsigned int threads)
+  : m_threads (threads)
+{
+  //  .. nothing yet ..
+}
+
+BatchRunner::~BatchRunner ()
+{
+  for (std::vector<BatchJob *>::const_iterator j = m_jobs.begin (); j != m_jobs.end (); ++j) {
+    delete *j;
+  }
+  m_jobs.clear ();
+}
+
+void
+BatchRunner::add (BatchJob *job)
+{
+  if (! m_output_suffix.empty ()) {
+    job->set_output_path (job->input () + m_output_suffix);
+  }
+  m_jobs.push_back (job);
+}
+
+bool
+BatchRunner::run (tl::OutputStream &out)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+
+  tl::ThreadPool pool (m_threads);
+
+  //  the output of the files finished is kept until it is written in order - hence limit the jobs ahead
+  size_t max_pending = 2 * size_t (m_threads);
+
+  std::string summary;
+  size_t failed = 0;
+  double total = 0.0;
+
+  std::vector<BatchJob *> jobs;
+  jobs.swap (m_jobs);
+
+  for (size_t i = 0; i < jobs.size () || pool.pending () > 0; ) {
+
+    if (i < jobs.size () && pool.pending () < max_pending) {
+      pool.submit (jobs [i]);
+      jobs [i] = 0;
+      ++i;
+      continue;
+    }
+
+    std::unique_ptr<BatchJob> job (dynamic_cast<BatchJob *> (pool.wait_next ()));
+    if (! job.get ()) {
+      break;
+    }
+
+    if (m_output_suffix.empty ()) {
+      out.put ("### " + job->input () + "\n");
+      out.put (job->output ());
+      if (job->failed ()) {
+        out.put ("*** ERROR: " + job->error () + "\n");
+      }
+      out.put ("\n");
+    }
+
+    total += job->seconds ();
+    if (job->failed ()) {
+      ++failed;
+      summary += tl::sprintf ("%10.3f  %-5s  %s: %s\n", job->seconds (), "ERROR", job->input (), job->error ());
+    } else {
+      summary += tl::sprintf ("%10.3f  %-5s  %s\n", job->seconds (), "OK", job->input ());
+    }
+
+  }
+
+  double wall = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+
+  out.put ("### summary\n");
+  out.put (tl::sprintf ("%10s  %-5s  %s\n", "seconds", "state", "file"));
+  out.put (summary);
+  out.put (tl::sprintf ("%lu files, %lu failed, %.3f s processing time, %.3f s elapsed\n", jobs.size (), failed, total, wall));
+
+  return failed == 0;
+}
+
+// ---------------------------------------------------------------
+//  Input lists
+
+void
+add_inputs (const std::string &arg, std::vector<std::string> &inputs)
+{
+  if (arg.empty () || arg [0] != '@') {
+    inputs.push_back (arg);
+    return;
+  }
+
+  std::unique_ptr<tl::InputStreamBase> file (tl::open_input_file (std::string (arg, 1)));
+  tl::ASCIIInputStream stream (*file);
+
+  while (! stream.at_end ()) {
+    std::string line = tl::trim (stream.get_line ());
+    if (! line.empty () && line [0] != '#') {
+      inputs.push_back (line);
+    }
+  }
+}
+
+}
+
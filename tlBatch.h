@@ -0,0 +1,177 @@
+/*
+
+  KLayout Layout Viewer
+  Copyright (C) 2013-2018 Matthias Koefferlein
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+
+
+
+#ifndef HDR_tlBatch
+#define HDR_tlBatch
+
+#include "config.h"
+
+#include "tlThreads.h"
+#include "tlStream.h"
+
+#include <string>
+#include <vector>
+
+namespace tl
+{
+
+/**
+ *  @brief A job processing one input file of a batch
+ *
+ *  Reimplement "process" to provide the processing. The output is collected
+ *  in memory, unless an output path is given. The processing time is measured.
+ */
+class KLAYOUT_DLL BatchJob
+  : public tl::Job
+{
+public:
+  /**
+   *  @brief Constructor
+   */
+  BatchJob (const std::string &input);
+
+  /**
+   *  @brief Executes the job
+   */
+  virtual void run ();
+
+  /**
+   *  @brief Gets the input file
+   */
+  const std::string &input () const
+  {
+    return m_input;
+  }
+
+  /**
+   *  @brief Sets the path of a file receiving the output
+   *
+   *  If no path is set, the output is collected in memory (see "output").
+   */
+  void set_output_path (const std::string &path)
+  {
+    m_output_path = path;
+  }
+
+  /**
+   *  @brief Gets the output if it is collected in memory
+   */
+  std::string output ()
+  {
+    return m_output.string ();
+  }
+
+  /**
+   *  @brief Gets the processing time in seconds
+   */
+  double seconds () const
+  {
+    return m_seconds;
+  }
+
+protected:
+  /**
+   *  @brief Processes the input file, writing the results to the given stream
+   */
+  virtual void process (tl::OutputStream &out) = 0;
+
+private:
+  std::string m_input;
+  std::string m_output_path;
+  tl::OutputStringStream m_output;
+  double m_seconds;
+
+  void do_process ();
+};
+
+/**
+ *  @brief Processes many input files on a pool of threads
+ *
+ *  The results are written in the order the jobs have been added. Each result
+ *  forms a section headed by "### <input>". Alternatively, the results go to
+ *  files named after the input with a suffix. Finally, a summary listing the 
+ *  processing time and the status of every file is written.
+ */
+class KLAYOUT_DLL BatchRunner
+{
+public:
+  /**
+   *  @brief Constructor
+   *
+   *  @param threads The number of files processed in parallel
+   */
+  BatchRunner (unsigned int threads);
+
+  /**
+   *  @brief Destructor
+   */
+  ~BatchRunner ();
+
+  /**
+   *  @brief Sets the suffix for the output files
+   *
+   *  If a suffix is set, the output for "<input>" is written to "<input><suffix>".
+   */
+  void set_output_suffix (const std::string &suffix)
+  {
+    m_output_suffix = suffix;
+  }
+
+  /**
+   *  @brief Adds a job
+   *
+   *  The runner takes over ownership of the job.
+   */
+  void add (BatchJob *job);
+
+  /**
+   *  @brief Runs the jobs
+   *
+   *  @return true, if all files have been processed successfully
+   */
+  bool run (tl::OutputStream &out);
+
+private:
+  unsigned int m_threads;
+  std::string m_output_suffix;
+  std::vector<BatchJob *> m_jobs;
+
+  //  No copying
+  BatchRunner (const BatchRunner &);
+  BatchRunner &operator= (const BatchRunner &);
+};
+
+/**
+ *  @brief Expands a command line argument into input files
+ *
+ *  An argument "@<file>" names a file which lists the input files, one per line.
+ *  Empty lines and lines starting with "#" are ignored. Other arguments are 
+ *  input files themselves.
+ */
+KLAYOUT_DLL void add_inputs (const std::string &arg, std::vector<std::string> &inputs);
+
+}
+
+#endif
+
@@ -25,22 +25,130 @@
 #include "tlAssert.h"
 
 #include <algorithm>
+#include <vector>
+#include <string.h>
 
 #include <zlib.h>
 
 namespace tl
 {
 
+// ------------------------------------------------------------------------
+//  BitStream implementation
+
+bool
+BitStream::fetch ()
+{
+  if (m_keep) {
+
+    //  extend the chunk - the bytes are consumed by "consume_to"
+    size_t offset = size_t (mp_ptr - mp_chunk);
+    size_t n = std::max (size_t (65536), size_t (mp_end - mp_chunk) * 2);
+    mp_chunk = (const unsigned char *) mp_input->borrow_raw (n);
+    mp_end = mp_chunk + n;
+    mp_ptr = mp_chunk + std::min (offset, n);
+    return n > offset;
+
+  }
+
+  //  consume the bytes used so far from the input. Whole bytes not used yet are
+  //  dropped from the bit buffer and taken from the new chunk again.
+  unsigned int nb = m_nbits / 8;
+  size_t consumed = size_t (mp_ptr - mp_chunk) - nb;
+
+  if (consumed > 0) {
+    mp_input->get (consumed, true /*bypass_deflate*/);
+    m_consumed += consumed;
+  }
+
+  size_t n = 65536;
+  mp_chunk = (const unsigned char *) mp_input->borrow_raw (n);
+  mp_end = mp_chunk + n;
+
+  if (n <= nb) {
+    //  no new bytes: keep the bit buffer as it is
+    mp_ptr = mp_end;
+    return false;
+  }
+
+  m_nbits -= nb * 8;
+  m_bits &= (uint64_t (1) << m_nbits) - 1;
+  mp_ptr = mp_chunk;
+  return true;
+}
+
+size_t
+BitStream::get_bytes (char *b, size_t n)
+{
+  //  first deliver the whole bytes from the bit buffer
+  size_t nn = 0;
+  while (m_nbits >= 8 && nn < n) {
+    *b++ = char (m_bits & 0xff);
+    consume (8);
+    ++nn;
+  }
+  if (nn > 0) {
+    return nn;
+  }
+
+  if (mp_ptr == mp_end && ! fetch ()) {
+    throw tl::Exception (tl::translate ("Unexpected end of file (DEFLATE implementation)"));
+  }
+
+  nn = std::min (n, size_t (mp_end - mp_ptr));
+  memcpy (b, mp_ptr, nn);
+  mp_ptr += nn;
+  return nn;
+}
+
+void
+BitStream::release ()
+{
+  //  the zero bytes delivered beyond the end of input must not have been used
+  unsigned int nb = m_nbits / 8;
+  if (nb < m_overrun) {
+    throw tl::Exception (tl::translate ("Unexpected end of file (DEFLATE implementation)"));
+  }
+
+  size_t consumed = size_t (mp_ptr - mp_chunk) - (nb - m_overrun);
+  if (consumed > 0) {
+    mp_input->get (consumed, true /*bypass_deflate*/);
+    m_consumed += consumed;
+  }
+
+  mp_chunk = mp_ptr = mp_end = 0;
+  m_bits = 0;
+  m_nbits = 0;
+  m_overrun = 0;
+}
+
+void
+BitStream::consume_to (size_t n)
+{
+  if (n > m_consumed) {
+    size_t k = std::min (n - m_consumed, size_t (mp_ptr - mp_chunk));
+    if (k > 0) {
+      mp_input->get (k, true /*bypass_deflate*/);
+      mp_chunk += k;
+      m_consumed += k;
+    }
+  }
+}
+
 // ------------------------------------------------------------------------
 //  The Huffmann decoder core
 
 /**
  *  @brief The decoder for Huffmann codes
  *
- *  The decoder keeps a Huffmann code tree and decodes a value from a bit stream
- *  using this tree. 
- *  As specified by RFC1951, the code tree is constructed from a list of code lengths
- *  vs. value alone.
+ *  The decoder keeps a lookup table and decodes a value from a bit stream
+ *  using this table. As specified by RFC1951, the codes are constructed from 
+ *  a list of code lengths vs. value alone.
+ *
+ *  The first-level table is indexed with the next "root bits" bits of the stream.
+ *  Longer codes are resolved through second-level tables. An entry either holds
+ *  the symbol and the code length or the location and index width of a second-level
+ *  table. Entries for invalid codes are zero.
  */
 class HuffmannDecoder
 {
@@ -48,126 +156,147 @@ public:
   /**
    *  @brief Constructor
    *  
-   *  Creates an empty code tree.
+   *  Creates an empty decoder.
    */
   HuffmannDecoder ()
+    : m_root_bits (0)
   {
-    mp_codes = 0;
-    mp_bitmasks = 0;
-    m_max_bits = 0;
-    m_num_codes = 0;
-  }
-
-  /**
-   *  @brief Destructor
-   */
-  ~HuffmannDecoder ()
-  {
-    if (mp_codes) {
-      delete [] mp_codes;
-    }
-    mp_codes = 0;
-    if (mp_bitmasks) {
-      delete [] mp_bitmasks;
-    }
-    mp_bitmasks = 0;
+    //  .. nothing yet ..
   }
 
   /**
-   *  @brief Initialize the code tree with the fixed Huffmann code table for literals/lengths
+   *  @brief Gets the decoder for the fixed Huffmann code table for literals/lengths
    *
-   *  This table is used by compression mode 1.
-   *  It is specified in RFC1951.
+   *  This table is used by compression mode 1. It is specified in RFC1951.
+   *  The decoder is built once.
    */
-  void fill_fixed_table_length ()
+  static const HuffmannDecoder &fixed_length_decoder ()
   {
-    reserve (9);
-
-    unsigned short lengths [288];
-    for (unsigned int i = 0; i < 144; ++i) {
-      lengths[i] = 8;
-    }
-    for (unsigned int i = 144; i < 256; ++i) {
-      lengths[i] = 9;
-    }
-    for (unsigned int i = 256; i < 280; ++i) {
-      lengths[i] = 7;
-    }
-    for (unsigned int i = 280; i < 288; ++i) {
-      lengths[i] = 8;
-    }
-
-    init_codes (lengths, lengths + sizeof (lengths) / sizeof (lengths [0]));
+    static HuffmannDecoder decoder (make_fixed_decoder (false));
+    return decoder;
   }
 
   /**
-   *  @brief Initialize the code tree with the fixed Huffmann code table for distances
+   *  @brief Gets the decoder for the fixed Huffmann code table for distances
    *
-   *  This table is used by compression mode 1.
-   *  It is specified in RFC1951.
+   *  This table is used by compression mode 1. It is specified in RFC1951.
+   *  The decoder is built once.
    */
-  void fill_fixed_table_dist ()
+  static const HuffmannDecoder &fixed_dist_decoder ()
   {
-    reserve (5);
-
-    unsigned short lengths [32];
-    for (unsigned int i = 0; i < 32; ++i) {
-      lengths[i] = 5;
-    }
-    init_codes (lengths, lengths + sizeof (lengths) / sizeof (lengths [0]));
+    static HuffmannDecoder decoder (make_fixed_decoder (true));
+    return decoder;
   }
 
   /**
-   *  @brief Initialize the code tree from a list of lengths
+   *  @brief Initialize the decoder from a list of lengths
    *
-   *  This method initializes the code tree from a list of lengths, given 
+   *  This method initializes the decoder from a list of lengths, given 
    *  by the sequence [begin_lengths, end_lengths). The codes are assumed to 
    *  range from 0 to distance(begin_lengths, end_lengths).
    *  See RFC1951 for a description about the procedure.
+   *
+   *  Over-subscribed and incomplete sets of lengths are rejected with an exception.
+   *  If "dist" is true, the set is a distance code which may be empty or consist
+   *  of a single code of length 1 (RFC1951, 3.2.7).
    */
   template <class Iter>
-  void init_codes (Iter begin_lengths, Iter end_lengths)
+  void init_codes (Iter begin_lengths, Iter end_lengths, bool dist = false)
   {
-    const unsigned int MAX_BITS = 16;
-    unsigned short bl_count[MAX_BITS + 1];
-    unsigned short bitmasks[MAX_BITS + 1];
-    unsigned short next_code[MAX_BITS + 1];
-    unsigned int max_bits = 0;
-
-    for (unsigned int bits = 0; bits <= MAX_BITS; bits++) {
-      bl_count[bits] = 0;
+    unsigned short bl_count [max_bits + 1];
+    unsigned int next_code [max_bits + 1];
+    unsigned short codes [max_symbols];
+    unsigned int used_bits = 0;
+
+    for (unsigned int bits = 0; bits <= max_bits; bits++) {
+      bl_count [bits] = 0;
     }
 
     for (Iter l = begin_lengths; l != end_lengths; ++l) {
-      tl_assert (*l < MAX_BITS);
+      tl_assert (*l <= max_bits);
       if (*l > 0) {
         ++bl_count [*l];
+        used_bits = std::max (used_bits, (unsigned int) *l);
       }
     }
 
-    unsigned int code = 0;
-    for (unsigned int bits = 1; bits <= MAX_BITS; bits++) {
-      if (bl_count[bits - 1] > 0) {
-        max_bits = bits - 1;
+    //  check the Kraft sum: "left" is the number of unused codes of the current length
+    int left = 1;
+    for (unsigned int bits = 1; bits <= max_bits; bits++) {
+      left = (left << 1) - int (bl_count [bits]);
+      if (left < 0) {
+        throw tl::Exception (tl::translate ("Over-subscribed Huffmann code lengths (DEFLATE implementation)"));
       }
-      code = (code + bl_count[bits - 1]) << 1;
-      next_code[bits] = code;
+    }
+    if (left > 0 && ! (dist && (used_bits == 0 || (used_bits == 1 && bl_count [1] == 1)))) {
+      throw tl::Exception (tl::translate ("Incomplete Huffmann code lengths (DEFLATE implementation)"));
     }
 
-    for (unsigned int bits = 0; bits <= max_bits; bits++) {
-      bitmasks [bits] = ((1 << bits) - 1) << (max_bits - bits);
+    unsigned int code = 0;
+    for (unsigned int bits = 1; bits <= max_bits; bits++) {
+      code = (code + bl_count [bits - 1]) << 1;
+      next_code [bits] = code;
+    }
+
+    //  assign the codes - bit-reversed, since the bits are read LSB first
+    unsigned int nsymbols = 0;
+    for (Iter l = begin_lengths; l != end_lengths; ++l, ++nsymbols) {
+      tl_assert (nsymbols < max_symbols);
+      codes [nsymbols] = (*l > 0 ? reverse (next_code [*l]++, *l) : 0);
     }
 
-    reserve (max_bits);
+    m_root_bits = std::max (1u, std::min (used_bits, (unsigned int) root_bits));
+    m_table.clear ();
+    m_table.resize (size_t (1) << m_root_bits, 0);
 
-    unsigned short symbol = 0;
+    //  allocate the second-level tables for the codes longer than the root bits
+    unsigned int sub_bits [1 << root_bits];
+    for (unsigned int i = 0; i < (1u << m_root_bits); ++i) {
+      sub_bits [i] = 0;
+    }
+
+    unsigned int symbol = 0;
     for (Iter l = begin_lengths; l != end_lengths; ++l, ++symbol) {
-      if (*l > 0) {
-        unsigned int code = next_code [*l]++;
-        code <<= (max_bits - *l);
-        mp_codes [code] = symbol;
-        mp_bitmasks [code] = bitmasks [*l];
-      } 
+      if (*l > m_root_bits) {
+        unsigned int &sb = sub_bits [codes [symbol] & ((1 << m_root_bits) - 1)];
+        sb = std::max (sb, (unsigned int) *l - m_root_bits);
+      }
+    }
+
+    for (unsigned int i = 0; i < (1u << m_root_bits); ++i) {
+      if (sub_bits [i] > 0) {
+        m_table [i] = (uint32_t (m_table.size ()) << 16) | 0x100 | sub_bits [i];
+        m_table.resize (m_table.size () + (size_t (1) << sub_bits [i]), 0);
+      }
+    }
+
+    //  fill the tables 
+    symbol = 0;
+    for (Iter l = begin_lengths; l != end_lengths; ++l, ++symbol) {
+
+      unsigned int len = *l;
+      if (len == 0) {
+        continue;
+      }
+
+      uint32_t entry = (uint32_t (symbol) << 16) | len;
+      unsigned int c = codes [symbol];
+
+      if (len <= m_root_bits) {
+        for (unsigned int i = c; i < (1u << m_root_bits); i += (1 << len)) {
+          m_table [i] = entry;
+        }
+      } else {
+        uint32_t link = m_table [c & ((1 << m_root_bits) - 1)];
+        if ((link & 0x100) == 0) {
+          throw tl::Exception (tl::translate ("Invalid Huffmann code table (DEFLATE implementation)"));
+        }
+        uint32_t *sub = &m_table [link >> 16];
+        for (unsigned int i = c >> m_root_bits; i < (1u << (link & 0xff)); i += (1 << (len - m_root_bits))) {
+          sub [i] = entry;
+        }
+      }
+
     }
   }
 
@@ -175,43 +304,83 @@ public:
    *  @brief Decode the next value from a bit stream
    *
    *  This method takes the next value from the bit stream decoding the bits with
-   *  the code tree currently loaded.
+   *  the code table currently loaded.
    */
   unsigned short decode (BitStream &s) const
   {
-    tl_assert (mp_codes != 0);
-
-    unsigned int m = m_num_codes / 2;
-    
-    unsigned int c = 0;
-    do {
-      if (s.get_bit ()) {
-        c |= m;
-      }
-      m >>= 1;
-    } while ((mp_bitmasks [c] & m) != 0);
+    unsigned int len = 0;
+    unsigned short c = peek (s, len);
+    s.consume (len);
+    return c;
+  }
+
+  /**
+   *  @brief Decode the next value from a bit stream without consuming it
+   *
+   *  "len" receives the number of bits of the code.
+   */
+  unsigned short peek (BitStream &s, unsigned int &len) const
+  {
+    s.need (max_bits);
+
+    uint32_t e = m_table [s.peek (m_root_bits)];
+    if ((e & 0x100) != 0) {
+      e = m_table [(e >> 16) + (s.peek (m_root_bits + (e & 0xff)) >> m_root_bits)];
+    }
+
+    len = e & 0xff;
+    if (len == 0) {
+      throw tl::Exception (tl::translate ("Invalid Huffmann code (DEFLATE implementation)"));
+    }
 
-    return mp_codes [c];
+    return (unsigned short) (e >> 16);
   }
 
 private:
-  unsigned short *mp_codes, *mp_bitmasks;
-  unsigned int m_num_codes, m_max_bits;
+  static const unsigned int max_bits = 15;
+  static const unsigned int max_symbols = 320;
+  static const unsigned int root_bits = 9;
+
+  std::vector<uint32_t> m_table;
+  unsigned int m_root_bits;
 
-  void reserve (unsigned int max_bits)
+  static HuffmannDecoder make_fixed_decoder (bool dist)
   {
-    m_num_codes = 1 << max_bits;
-    if (max_bits > m_max_bits) {
-      m_max_bits = max_bits;
-      if (mp_codes) {
-        delete [] mp_codes;
+    unsigned short lengths [288];
+    unsigned int n = 0;
+
+    if (dist) {
+      while (n < 32) {
+        lengths[n++] = 5;
       }
-      mp_codes = new unsigned short [m_num_codes];
-      if (mp_bitmasks) {
-        delete [] mp_bitmasks;
+    } else {
+      while (n < 144) {
+        lengths[n++] = 8;
+      }
+      while (n < 256) {
+        lengths[n++] = 9;
+      }
+      while (n < 280) {
+        lengths[n++] = 7;
+      }
+      while (n < 288) {
+        lengths[n++] = 8;
       }
-      mp_bitmasks = new unsigned short [m_num_codes];
     }
+
+    HuffmannDecoder decoder;
+    decoder.init_codes (lengths, lengths + n);
+    return decoder;
+  }
+
+  static unsigned int reverse (unsigned int code, unsigned int len)
+  {
+    unsigned int r = 0;
+    while (len-- > 0) {
+      r = (r << 1) | (code & 1);
+      code >>= 1;
+    }
+    return r;
   }
 };
 
@@ -219,18 +388,45 @@ private:
 // ------------------------------------------------------------------------
 //  InflateFilter implementation
 
-InflateFilter::InflateFilter (tl::InputStream &input)
+static const unsigned int s_length_base [] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const unsigned int s_length_extra [] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const unsigned int s_dist_base [] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+static const unsigned int s_dist_extra [] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+//  the number of bytes produced in one go if possible
+static const unsigned int s_chunk_size = 16384;
+
+//  the longest match
+static const unsigned int s_max_match = 258;
+
+InflateFilter::InflateFilter (tl::InputStream &input, bool exact)
   : m_input (input), 
-    m_b_insert (0), m_b_read (0), m_at_end (false),
-    m_last_block (false), 
-    m_uncompressed_length (0)  //  this forces a new block on "process()"
+    m_b_insert (0), m_b_read (0), m_at_end (false), m_produced (0),
+    m_exact (exact), m_bits_used_index (0),
+    m_last_block (false), m_finished (false),
+    m_uncompressed_length (0),  //  this forces a new block on "process()"
+    mp_lit (0), mp_dist (0)
 {
-  for (size_t i = 0; i < sizeof (m_buffer) / sizeof (m_buffer [0]); ++i) {
-    m_buffer[i] = 0;
-  }
+  m_input.set_keep (exact);
 
   mp_dist_decoder = new HuffmannDecoder ();
   mp_lit_decoder = new HuffmannDecoder ();
+  mp_cl_decoder = new HuffmannDecoder ();
 }
 
 InflateFilter::~InflateFilter ()
@@ -239,15 +435,19 @@ InflateFilter::~InflateFilter ()
   mp_dist_decoder = 0;
   delete mp_lit_decoder;
   mp_lit_decoder = 0;
+  delete mp_cl_decoder;
+  mp_cl_decoder = 0;
 }
 
 const char * 
 InflateFilter::get (size_t n)
 {
-  tl_assert (n < sizeof (m_buffer) / 2);
+  if (n >= sizeof (m_buffer) / 2) {
+    throw tl::Exception (tl::translate ("Requested block of %lu bytes is too large (DEFLATE implementation)"), n);
+  }
 
-  while ((m_b_insert + sizeof (m_buffer) - m_b_read) % sizeof (m_buffer) < n) {
-    if (! process ()) {
+  if ((m_b_insert + sizeof (m_buffer) - m_b_read) % sizeof (m_buffer) < n) {
+    if (! process (n)) {
       throw tl::Exception (tl::translate ("Unexpected end of file (DEFLATE implementation)"));
     }
   }
@@ -263,9 +463,36 @@ InflateFilter::get (size_t n)
 
   const char *r = m_buffer + m_b_read;
   m_b_read = (m_b_read + n) % sizeof (m_buffer);
+
+  if (m_exact) {
+    consume_delivered ();
+  }
+
   return r;
 }
 
+const char *
+InflateFilter::peek (size_t &n)
+{
+  tl_assert (n < sizeof (m_buffer) / 2);
+
+  size_t avail = (m_b_insert + sizeof (m_buffer) - m_b_read) % sizeof (m_buffer);
+  if (avail < n) {
+    process (n);
+    avail = (m_b_insert + sizeof (m_buffer) - m_b_read) % sizeof (m_buffer);
+  }
+
+  //  ensure the requested bytes are accessible as a coherent chunk:
+  if (m_b_read + std::min (n, avail) > sizeof (m_buffer)) {
+    std::rotate (m_buffer, m_buffer + m_b_read, m_buffer + sizeof (m_buffer));
+    m_b_insert = (m_b_insert - m_b_read + sizeof (m_buffer)) % sizeof (m_buffer);
+    m_b_read = 0;
+  }
+
+  n = std::min (avail, sizeof (m_buffer) - m_b_read);
+  return n > 0 ? m_buffer + m_b_read : 0;
+}
+
 void
 InflateFilter::unget (size_t n)
 {
@@ -273,11 +500,98 @@ InflateFilter::unget (size_t n)
   m_b_read -= n;
 }
 
+size_t
+InflateFilter::read (char *b, size_t n)
+{
+  size_t nread = 0;
+
+  while (nread < n && ! at_end ()) {
+
+    size_t avail = (m_b_insert + sizeof (m_buffer) - m_b_read) % sizeof (m_buffer);
+    size_t k = std::min (std::min (avail, n - nread), sizeof (m_buffer) - m_b_read);
+
+    memcpy (b + nread, m_buffer + m_b_read, k);
+    m_b_read = (m_b_read + k) % sizeof (m_buffer);
+    nread += k;
+
+  }
+
+  return nread;
+}
+
+void
+InflateFilter::finish ()
+{
+  m_finished = true;
+
+  //  in exact mode, the input is released when the last byte is delivered
+  if (! m_exact || m_b_read == m_b_insert) {
+    m_input.release ();
+  }
+}
+
+void
+InflateFilter::finish_if_at_end ()
+{
+  //  Detects the end of the data if no more bytes follow, so the end of the 
+  //  data counts for the last byte delivered.
+  if (m_finished || ! m_last_block) {
+    return;
+  }
+
+  if (m_uncompressed_length < 0) {
+    unsigned int len = 0;
+    if (mp_lit->peek (m_input, len) != 256) {
+      return;
+    }
+    m_input.consume (len);
+    m_uncompressed_length = 0;
+  }
+
+  if (m_uncompressed_length == 0) {
+    finish ();
+  }
+}
+
+void
+InflateFilter::consume_delivered ()
+{
+  const unsigned int bmask = sizeof (m_buffer) - 1;
+  size_t delivered = m_produced - ((m_b_insert - m_b_read) & bmask);
+
+  if (delivered == m_produced) {
+    finish_if_at_end ();
+    if (m_finished) {
+      m_input.release ();
+      m_bits_used.clear ();
+      m_bits_used_index = 0;
+      return;
+    }
+  }
+
+  while (m_bits_used_index < m_bits_used.size () && m_bits_used [m_bits_used_index].produced < delivered) {
+    ++m_bits_used_index;
+  }
+  if (m_bits_used_index == m_bits_used.size ()) {
+    return;
+  }
+
+  const BitsUsed &bu = m_bits_used [m_bits_used_index];
+  size_t bits = bu.linear ? bu.bits - (bu.produced - delivered) * 8 : bu.bits;
+  m_input.consume_to ((bits + 7) / 8);
+
+  //  drop the entries no longer needed
+  if (m_bits_used_index > 4096 && m_bits_used_index * 2 > m_bits_used.size ()) {
+    m_bits_used.erase (m_bits_used.begin (), m_bits_used.begin () + m_bits_used_index);
+    m_bits_used_index = 0;
+  }
+}
+
 bool 
 InflateFilter::at_end () 
 {
   if (! m_at_end && m_b_read == m_b_insert) {
-    if (! process ()) {
+    if (! process (1)) {
       m_at_end = true;
     }
   }
@@ -285,199 +599,212 @@ InflateFilter::at_end ()
 }
 
 void 
-InflateFilter::put_byte (char b) 
+InflateFilter::put_bytes_dist (unsigned int d, unsigned int length) 
 {
-  m_buffer [m_b_insert] = b;
-  m_b_insert = (m_b_insert + 1) % sizeof (m_buffer);
-}
+  const unsigned int bmask = sizeof (m_buffer) - 1;
 
-void 
-InflateFilter::put_byte_dist (unsigned int d) 
-{
-  put_byte (m_buffer [(m_b_insert - d) % sizeof (m_buffer)]);
+  if (d > m_produced || d > 32768) {
+    throw tl::Exception (tl::translate ("Invalid distance (DEFLATE implementation)"));
+  }
+
+  unsigned int from = (m_b_insert - d) & bmask;
+
+  if (d >= length && from + length <= sizeof (m_buffer) && m_b_insert + length <= sizeof (m_buffer)) {
+    //  non-overlapping and not wrapping 
+    memcpy (m_buffer + m_b_insert, m_buffer + from, length);
+    m_b_insert += length;
+  } else {
+    for (unsigned int i = 0; i < length; ++i) {
+      m_buffer [m_b_insert] = m_buffer [from];
+      m_b_insert = (m_b_insert + 1) & bmask;
+      from = (from + 1) & bmask;
+    }
+  }
+
+  m_b_insert &= bmask;
+  m_produced += length;
 }
 
 bool 
-InflateFilter::process ()
+InflateFilter::process (size_t n)
 {
+  //  Produces data until at least n bytes are available. If possible, a whole chunk
+  //  is produced. Returns false if less than n bytes are available at the end of the data.
+
+  const unsigned int bmask = sizeof (m_buffer) - 1;
+  size_t target = std::max (n, size_t (s_chunk_size));
+
   while (true) {
 
-    bool new_block = false;
+    unsigned int avail = (m_b_insert - m_b_read) & bmask;
+    unsigned int space = bmask - avail;
+    if (avail >= target || (avail >= n && space < s_max_match)) {
+      return true;
+    }
+
+    if (m_finished) {
+      return avail >= n;
+    }
 
     if (m_uncompressed_length == 0) {
 
-      m_uncompressed_length = -1;
-      new_block = true;
+      if (m_last_block) {
+        //  end of the data: give back the input stream
+        finish ();
+      } else {
+        read_block_header ();
+      }
 
     } else if (m_uncompressed_length > 0) {
 
-      put_byte (m_input.get_byte ());
-      --m_uncompressed_length;
+      //  uncompressed data: copy as much as possible at once
+      size_t k = std::min (size_t (m_uncompressed_length), size_t (space));
+      k = std::min (k, sizeof (m_buffer) - m_b_insert);
+      k = m_input.get_bytes (m_buffer + m_b_insert, k);
+
+      m_b_insert = (m_b_insert + (unsigned int) k) & bmask;
+      m_uncompressed_length -= int (k);
+      m_produced += k;
+      if (m_exact) {
+        add_bits_used (true);
+      }
 
     } else {
 
-      unsigned int l = mp_lit_decoder->decode (m_input);
-      if (l < 256) {
+      while (avail < target && space >= s_max_match) {
 
-        put_byte (char (l));
+        unsigned int l = mp_lit->decode (m_input);
+        if (l < 256) {
 
-      } else if (l == 256) {
+          m_buffer [m_b_insert] = char (l);
+          m_b_insert = (m_b_insert + 1) & bmask;
+          ++m_produced;
+          ++avail;
+          --space;
+          if (m_exact) {
+            add_bits_used (false);
+          }
 
-        new_block = true;
+        } else if (l == 256) {
 
-      } else {
+          //  end of block
+          m_uncompressed_length = 0;
+          break;
 
-        unsigned int length = 0;
-        if (l < 265) {
-          length = l - 254;
-        } else if (l < 269) {
-          length = (l - 265) * 2 + 11 + m_input.get_bits (1);
-        } else if (l < 273) {
-          length = (l - 269) * 4 + 19 + m_input.get_bits (2);
-        } else if (l < 277) {
-          length = (l - 273) * 8 + 35 + m_input.get_bits (3);
-        } else if (l < 281) {
-          length = (l - 277) * 16 + 67 + m_input.get_bits (4);
-        } else if (l < 285) {
-          length = (l - 281) * 32 + 131 + m_input.get_bits (5);
         } else {
-          length = 258;
-        }
 
-        unsigned int d = mp_dist_decoder->decode (m_input);
-        unsigned int dist = 0;
-        if (d < 4) {
-          dist = d + 1;
-        } else if (d < 6) {
-          dist = (d - 4) * 2 + 5 + m_input.get_bits (1);
-        } else if (d < 8) {
-          dist = (d - 6) * 4 + 9 + m_input.get_bits (2);
-        } else if (d < 10) {
-          dist = (d - 8) * 8 + 17 + m_input.get_bits (3);
-        } else if (d < 12) {
-          dist = (d - 10) * 16 + 33 + m_input.get_bits (4);
-        } else if (d < 14) {
-          dist = (d - 12) * 32 + 65 + m_input.get_bits (5);
-        } else if (d < 16) {
-          dist = (d - 14) * 64 + 129 + m_input.get_bits (6);
-        } else if (d < 18) {
-          dist = (d - 16) * 128 + 257 + m_input.get_bits (7);
-        } else if (d < 20) {
-          dist = (d - 18) * 256 + 513 + m_input.get_bits (8);
-        } else if (d < 22) {
-          dist = (d - 20) * 512 + 1025 + m_input.get_bits (9);
-        } else if (d < 24) {
-          dist = (d - 22) * 1024 + 2049 + m_input.get_bits (10);
-        } else if (d < 26) {
-          dist = (d - 24) * 2048 + 4097 + m_input.get_bits (11);
-        } else if (d < 28) {
-          dist = (d - 26) * 4096 + 8193 + m_input.get_bits (12);
-        } else {
-          dist = (d - 28) * 8192 + 16385 + m_input.get_bits (13);
-        }
+          l -= 257;
+          if (l >= sizeof (s_length_base) / sizeof (s_length_base [0])) {
+            throw tl::Exception (tl::translate ("Invalid length code (DEFLATE implementation)"));
+          }
+          unsigned int length = s_length_base [l] + m_input.get_bits (s_length_extra [l]);
+
+          unsigned int d = mp_dist->decode (m_input);
+          if (d >= sizeof (s_dist_base) / sizeof (s_dist_base [0])) {
+            throw tl::Exception (tl::translate ("Invalid distance code (DEFLATE implementation)"));
+          }
+          unsigned int dist = s_dist_base [d] + m_input.get_bits (s_dist_extra [d]);
+
+          put_bytes_dist (dist, length);
+          avail += length;
+          space -= length;
+          if (m_exact) {
+            add_bits_used (false);
+          }
 
-        while (length-- > 0) {
-          put_byte_dist (dist);
         }
 
       }
 
     }
 
-    if (new_block) {
+  }
+}
 
-      if (m_last_block) {
-        return false;
-      }
+void
+InflateFilter::read_block_header ()
+{
+  m_last_block = m_input.get_bit ();
+  unsigned int t = m_input.get_bits (2);
 
-      //  read new block header
-      m_last_block = m_input.get_bit ();
-      unsigned int t = m_input.get_bits (2);
+  if (t == 0) {
 
-      if (t == 0) {
+    //  uncompressed data
+    m_input.skip_to_byte ();
+    m_uncompressed_length = m_input.get_bits (16);
+    m_input.get_bits (16);
 
-        //  uncompressed data
-        m_input.skip_to_byte ();
-        m_uncompressed_length = m_input.get_bits (16);
-        m_input.get_bits (16);
+  } else if (t == 1) {
 
-      } else if (t == 1 || t == 2) {
-        
-        if (t == 1) {
+    mp_lit = &HuffmannDecoder::fixed_length_decoder ();
+    mp_dist = &HuffmannDecoder::fixed_dist_decoder ();
+    m_uncompressed_length = -1;
 
-          //  KLUDGE: should use a different decoder object, so we save time to do this:
-          mp_lit_decoder->fill_fixed_table_length ();
-          mp_dist_decoder->fill_fixed_table_dist ();
+  } else if (t == 2) {
 
-        } else {
+    unsigned int hlit = m_input.get_bits (5) + 257;
+    unsigned int hdist = m_input.get_bits (5) + 1;
+    unsigned int hclen = m_input.get_bits (4) + 4;
 
-          unsigned int hlit = m_input.get_bits (5) + 257;
-          unsigned int hdist = m_input.get_bits (5) + 1;
-          unsigned int hclen = m_input.get_bits (4) + 4;
-
-          unsigned int hclengths [19];
-          for (unsigned int i = 0; i < sizeof (hclengths) / sizeof (hclengths [0]); ++i) {
-            hclengths [i] = 0;
-          }
+    unsigned int hclengths [19];
+    for (unsigned int i = 0; i < sizeof (hclengths) / sizeof (hclengths [0]); ++i) {
+      hclengths [i] = 0;
+    }
 
-          static unsigned int hclen_order [] = {
-            16, 17, 18, 0,   8,  7,  9,  6,  10,  5, 11,  4,  12,  3, 13,  2, 
-            14,  1, 15
-          };
-          for (unsigned int i = 0; i < hclen; ++i) {
-            hclengths [hclen_order [i]] = m_input.get_bits (3);
-          }
+    static unsigned int hclen_order [] = {
+      16, 17, 18, 0,   8,  7,  9,  6,  10,  5, 11,  4,  12,  3, 13,  2, 
+      14,  1, 15
+    };
+    for (unsigned int i = 0; i < hclen; ++i) {
+      hclengths [hclen_order [i]] = m_input.get_bits (3);
+    }
 
-          HuffmannDecoder ldecoder;
-          ldecoder.init_codes (hclengths, hclengths + sizeof (hclengths) / sizeof (hclengths[0]));
-
-          unsigned int lengths [286 + 32];
-          unsigned int nlengths = hlit + hdist;
-
-          for (unsigned int i = 0; i < nlengths; ) {
-
-            unsigned short l = ldecoder.decode (m_input);
-            if (l < 16) {
-              lengths [i++] = l;
-            } else if (l == 16) {
-              unsigned int n = m_input.get_bits (2) + 3;
-              tl_assert (i > 0);
-              l = lengths [i - 1];
-              while (n-- > 0) {
-                tl_assert (i < nlengths);
-                lengths [i++] = l;
-              }
-            } else if (l == 17) {
-              unsigned int n = m_input.get_bits (3) + 3;
-              while (n-- > 0) {
-                tl_assert (i < nlengths);
-                lengths [i++] = 0;
-              }
-            } else if (l == 18) {
-              unsigned int n = m_input.get_bits (7) + 11;
-              while (n-- > 0) {
-                tl_assert (i < nlengths);
-                lengths [i++] = 0;
-              }
-            } else {
-              tl_assert (false);
-            }
+    mp_cl_decoder->init_codes (hclengths, hclengths + sizeof (hclengths) / sizeof (hclengths[0]));
 
-          }
+    unsigned int lengths [286 + 32];
+    unsigned int nlengths = hlit + hdist;
+    tl_assert (nlengths <= sizeof (lengths) / sizeof (lengths [0]));
 
-          mp_lit_decoder->init_codes (lengths, lengths + hlit);
-          mp_dist_decoder->init_codes (lengths + hlit, lengths + nlengths);
+    for (unsigned int i = 0; i < nlengths; ) {
 
+      unsigned short l = mp_cl_decoder->decode (m_input);
+      if (l < 16) {
+        lengths [i++] = l;
+      } else if (l == 16) {
+        unsigned int n = m_input.get_bits (2) + 3;
+        tl_assert (i > 0);
+        l = lengths [i - 1];
+        while (n-- > 0) {
+          tl_assert (i < nlengths);
+          lengths [i++] = l;
+        }
+      } else if (l == 17) {
+        unsigned int n = m_input.get_bits (3) + 3;
+        while (n-- > 0) {
+          tl_assert (i < nlengths);
+          lengths [i++] = 0;
+        }
+      } else if (l == 18) {
+        unsigned int n = m_input.get_bits (7) + 11;
+        while (n-- > 0) {
+          tl_assert (i < nlengths);
+          lengths [i++] = 0;
         }
-
       } else {
-        throw tl::Exception (tl::translate ("Invalid compression type: %d"), t);
+        tl_assert (false);
       }
 
-    } else {
-      return true;
     }
 
+    mp_lit_decoder->init_codes (lengths, lengths + hlit);
+    mp_dist_decoder->init_codes (lengths + hlit, lengths + nlengths, true /*dist*/);
+
+    mp_lit = mp_lit_decoder;
+    mp_dist = mp_dist_decoder;
+    m_uncompressed_length = -1;
+
+  } else {
+    throw tl::Exception (tl::translate ("Invalid compression type: %d"), t);
   }
 }
 
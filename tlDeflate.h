@@ -28,6 +28,9 @@
 #include "tlStream.h"
 #include "tlException.h"
 
+#include <stdint.h>
+#include <vector>
+
 //  forware definition of the zlib stream structure - we can omit the zlib header here
 struct z_stream_s;
 
@@ -42,6 +45,11 @@ class HuffmannDecoder;
  *  This filter reads bytes from a tl::Stream and delivers bits, taken from
  *  these bytes. The bits are delivered in the order specified by the DEFLATE
  *  format specification (least significant bit first).
+ *
+ *  The bits are kept in a 64 bit buffer which is refilled from the raw bytes
+ *  the input stream has available. These bytes are only borrowed and consumed
+ *  from the stream when a new chunk is required or on "release". Hence the
+ *  input stream is positioned right after the last byte used.
  */
 class KLAYOUT_DLL BitStream
 {
@@ -53,60 +61,115 @@ public:
    */
   BitStream (tl::InputStream &input)
     : mp_input (&input),
-      m_mask (0), m_byte (0)
+      m_bits (0), m_nbits (0),
+      mp_chunk (0), mp_ptr (0), mp_end (0),
+      m_overrun (0), m_consumed (0), m_keep (false)
   {
     // ...
   }
 
+  /**
+   *  @brief Make sure at least n bits (n <= 56) are available in the bit buffer
+   *
+   *  Beyond the end of the input, zero bits are delivered. Using them
+   *  will raise an exception in "release".
+   */
+  void need (unsigned int n)
+  {
+    if (m_nbits >= n) {
+      return;
+    }
+
+    if (mp_end - mp_ptr >= 8) {
+
+      //  fast path: take as many bytes as fit into the buffer at once
+      uint64_t w;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+      memcpy (&w, mp_ptr, sizeof (w));
+#else
+      w = 0;
+      for (unsigned int i = 8; i > 0; ) {
+        w = (w << 8) | uint64_t (mp_ptr [--i]);
+      }
+#endif
+      unsigned int nbytes = (63 - m_nbits) / 8;
+      m_bits |= w << m_nbits;
+      m_nbits += nbytes * 8;
+      m_bits &= (uint64_t (1) << m_nbits) - 1;
+      mp_ptr += nbytes;
+
+    } else {
+
+      while (m_nbits < n) {
+        if (mp_ptr == mp_end) {
+          if (m_overrun > 0 || ! fetch ()) {
+            //  end of input: pad with zeros
+            if (++m_overrun > 8) {
+              throw tl::Exception (tl::translate ("Unexpected end of file (DEFLATE implementation)"));
+            }
+            m_nbits += 8;
+            continue;
+          }
+          //  a new chunk may allow the fast path
+          need (n);
+          return;
+        }
+        m_bits |= uint64_t (*mp_ptr++) << m_nbits;
+        m_nbits += 8;
+      }
+
+    }
+  }
+
+  /**
+   *  @brief Look at the next n bits without consuming them
+   *
+   *  "need" must have been called before to make the bits available.
+   */
+  unsigned int peek (unsigned int n) const
+  {
+    return (unsigned int) (m_bits & ((uint64_t (1) << n) - 1));
+  }
+
+  /**
+   *  @brief Consume n bits
+   */
+  void consume (unsigned int n)
+  {
+    m_bits >>= n;
+    m_nbits -= n;
+  }
+
   /**
    *  @brief Get a byte
    *
-   *  This method simply passes the byte.
-   *  The method expects the next byte to be available.
+   *  This method expects the stream to be positioned at a byte boundary.
    */
   unsigned char get_byte ()
   {
-    m_mask = 0;
-    const char *c = mp_input->get (1, true /*bypass_deflate*/);
-    if (c == 0) {
-      throw tl::Exception (tl::translate ("Unexpected end of file (DEFLATE implementation)"));
-    }
-    return *c;
+    return (unsigned char) get_bits (8);
   }
 
   /**
    *  @brief Get a single bit
-   *
-   *  This method gets the next bit available.
-   *  The method expects the next byte to be available, if one needs to be read.
    */
   bool get_bit ()
   {
-    if (m_mask == 0) {
-      m_byte = get_byte ();
-      m_mask = 0x01;
-    } 
-    bool b = ((m_byte & m_mask) != 0);
-    m_mask <<= 1;
-    return b;
+    return get_bits (1) != 0;
   }
 
   /**
    *  @brief Get a sequence of bits
    *
-   *  This method gets the next n bits and delivers them as a single unsigned int,
+   *  This method gets the next n bits (n <= 32) and delivers them as a single unsigned int,
    *  packing the first bit into the least signification bit. This is the specification
    *  for reading multiple bit values except Huffmann codes.
    */
   unsigned int get_bits (unsigned int n)
   {
-    //  KLUDGE: take directly from the byte for performance.
-    unsigned int r = 0;
-    unsigned int m = 1;
-    while (n-- > 0) {
-      r |= get_bit () ? m : 0;
-      m <<= 1;
-    }
+    need (n);
+    unsigned int r = peek (n);
+    consume (n);
     return r;
   }
 
@@ -115,13 +178,63 @@ public:
    */
   void skip_to_byte ()
   {
-    m_mask = 0;
+    consume (m_nbits % 8);
+  }
+
+  /**
+   *  @brief Copy up to n bytes into the given buffer
+   *
+   *  This method expects the stream to be positioned at a byte boundary.
+   *  It returns the number of bytes copied which is at least one.
+   */
+  size_t get_bytes (char *b, size_t n);
+
+  /**
+   *  @brief Releases the input stream
+   *
+   *  Consumes the bytes used so far from the input stream, so the stream
+   *  is positioned after the last byte used.
+   */
+  void release ();
+
+  /**
+   *  @brief Keeps the bytes in the input stream until they are consumed explicitly
+   *
+   *  By default, the bytes used are consumed from the input stream when a new 
+   *  chunk is required. With "keep" set, the chunk is extended instead and the
+   *  bytes are consumed by "consume_to" or "release" only.
+   */
+  void set_keep (bool keep)
+  {
+    m_keep = keep;
   }
 
+  /**
+   *  @brief Gets the number of bits used since the bit stream was attached
+   */
+  size_t bits_used () const
+  {
+    return (m_consumed + size_t (mp_ptr - mp_chunk) + m_overrun) * 8 - m_nbits;
+  }
+
+  /**
+   *  @brief Consumes bytes from the input stream up to the given count 
+   *
+   *  "n" is the number of bytes counted from where the bit stream was attached. 
+   *  Bytes beyond the ones loaded into the bit buffer are not consumed.
+   */
+  void consume_to (size_t n);
+
 private:
   tl::InputStream *mp_input;
-  unsigned char m_mask;
-  unsigned char m_byte;
+  uint64_t m_bits;
+  unsigned int m_nbits;
+  const unsigned char *mp_chunk, *mp_ptr, *mp_end;
+  unsigned int m_overrun;
+  size_t m_consumed;
+  bool m_keep;
+
+  bool fetch ();
 };
 
 
@@ -198,8 +311,15 @@ public:
    *  @brief Constructor
    *
    *  Constructs a filter attached to the given Stream object.
+   *
+   *  If "exact" is true, the filter consumes the compressed bytes from the input
+   *  stream as far as they have been used for the bytes delivered by "get". The 
+   *  position of the input stream then tells which compressed bytes the delivered 
+   *  bytes came from: the bits of a symbol count for the last byte it produces,
+   *  the bits of a block header for the next byte produced and the end of the 
+   *  data for the last byte.
    */
-  InflateFilter (tl::InputStream &input);
+  InflateFilter (tl::InputStream &input, bool exact = false);
 
   /**
    *  @brief Destructor
@@ -214,6 +334,17 @@ public:
    */
   const char *get (size_t n);
 
+  /**
+   *  @brief Look at the next byte(s) without consuming them
+   *
+   *  "n" is the number of bytes requested. It receives the number of bytes
+   *  available as a contiguous block which is less than requested only at the 
+   *  end of the data. Use "get" to consume the bytes.
+   *
+   *  @return 0 if no more bytes are available
+   */
+  const char *peek (size_t &n);
+
   /**
    *  @brief Undo the last "get" operation
    *
@@ -222,6 +353,14 @@ public:
    */
   void unget (size_t n);
   
+  /**
+   *  @brief Reads up to n bytes into the given buffer
+   *
+   *  This method is intended for inflating a block as a whole. 
+   *  It returns the number of bytes delivered which is less than n
+   *  if the end of the compressed block is reached.
+   */
+  size_t read (char *b, size_t n);
 
   /**
    *  @brief Report true, if no more bytes can be delivered
@@ -235,15 +374,42 @@ private:
   unsigned int m_b_insert;
   unsigned int m_b_read;
   bool m_at_end;
+  size_t m_produced;
+
+  //  exact mode: the bits used up to the end of the bytes produced 
+  //  (for "linear" ranges of uncompressed data, 8 bits per byte)
+  struct BitsUsed
+  {
+    size_t produced, bits;
+    bool linear;
+  };
+
+  bool m_exact;
+  std::vector<BitsUsed> m_bits_used;
+  size_t m_bits_used_index;
 
   //  processor state
   bool m_last_block;
+  bool m_finished;
   int m_uncompressed_length;
-  HuffmannDecoder *mp_lit_decoder, *mp_dist_decoder;
+  HuffmannDecoder *mp_lit_decoder, *mp_dist_decoder, *mp_cl_decoder;
+  const HuffmannDecoder *mp_lit, *mp_dist;
+
+  void put_bytes_dist (unsigned int d, unsigned int length);
+  bool process (size_t n);
+  void finish ();
+  void finish_if_at_end ();
+  void consume_delivered ();
 
-  void put_byte (char b);
-  void put_byte_dist (unsigned int d);
-  bool process ();
+  void add_bits_used (bool linear)
+  {
+    BitsUsed bu;
+    bu.produced = m_produced;
+    bu.bits = m_input.bits_used ();
+    bu.linear = linear;
+    m_bits_used.push_back (bu);
+  }
+  void read_block_header ();
 
 };
 
@@ -0,0 +1,162 @@
+/*
+
+  KLayout Layout Viewer
+  Copyright (C) 2013-2018 Matthias Koefferlein
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+
+
+
+#include "tlHexDump.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace tl
+{
+
+// ---------------------------------------------------------------
+//  HexDumpFormatter implementation
+
+namespace
+{
+
+/**
+ *  @brief A table with the "xx " representation of every byte value
+ *
+ *  Each entry is padded to 4 bytes, so a byte can be written with a single 
+ *  4-byte copy. The fourth byte is overwritten by the next entry.
+ */
+struct HexTable
+{
+  HexTable ()
+  {
+    static const char digits[] = "0123456789abcdef";
+    for (unsigned int i = 0; i < 256; ++i) {
+      entries [i][0] = digits [i >> 4];
+      entries [i][1] = digits [i & 15];
+      entries [i][2] = ' ';
+      entries [i][3] = ' ';
+    }
+  }
+
+  char entries [256][4];
+};
+
+static const HexTable s_hex_table;
+
+}
+
+HexDumpFormatter::HexDumpFormatter ()
+  : m_size (0), m_width (8), m_short_mode (false)
+{
+  //  .. nothing yet ..
+}
+
+char *
+HexDumpFormatter::reserve (size_t n)
+{
+  if (m_buffer.size () < m_size + n) {
+    m_buffer.resize (std::max (m_size + n, m_buffer.size () * 2));
+  }
+  return &m_buffer.front () + m_size;
+}
+
+char *
+HexDumpFormatter::put_position (char *cp, size_t pos, char marker)
+{
+  char digits [24];
+  char *d = digits + sizeof (digits);
+  do {
+    *--d = char ('0' + pos % 10);
+    pos /= 10;
+  } while (pos > 0);
+
+  size_t nd = digits + sizeof (digits) - d;
+  for ( ; nd < 9; ++nd) {
+    *cp++ = '0';
+  }
+  memcpy (cp, d, digits + sizeof (digits) - d);
+  cp += digits + sizeof (digits) - d;
+
+  *cp++ = ' ';
+  *cp++ = marker;
+  *cp++ = ' ';
+
+  return cp;
+}
+
+void 
+HexDumpFormatter::format (size_t pos, const char *data, size_t n, const std::string &msg)
+{
+  const unsigned char *r = (const unsigned char *) data;
+  size_t n_first = std::min (n, m_width);
+
+  //  position: up to 20 digits plus marker, bytes in "xx " format plus one spare byte 
+  //  for the 4-byte copies, message and line feed
+  char *cp = reserve (24 + m_width * 3 + 1 + 1 + msg.size () + 1);
+
+  cp = put_position (cp, pos, ' ');
+
+  for (size_t i = 0; i < n_first; ++i) {
+    memcpy (cp, s_hex_table.entries [*r++], 4);
+    cp += 3;
+  }
+  for (size_t i = n_first; i < m_width; ++i) {
+    memcpy (cp, "    ", 4);
+    cp += 3;
+  }
+
+  *cp++ = ' ';
+  memcpy (cp, msg.c_str (), msg.size ());
+  cp += msg.size ();
+  *cp++ = '\n';
+
+  m_size = cp - &m_buffer.front ();
+
+  for (size_t done = m_width; done < n; done += m_width) {
+
+    size_t nl = std::min (n - done, m_width);
+    cp = reserve (24 + nl * 3 + 1 + 4);
+
+    cp = put_position (cp, pos + done, '+');
+
+    if (m_short_mode) {
+
+      memcpy (cp, "...\n", 4);
+      cp += 4;
+      m_size = cp - &m_buffer.front ();
+      break;
+
+    } else {
+
+      for (size_t i = 0; i < nl; ++i) {
+        memcpy (cp, s_hex_table.entries [*r++], 4);
+        cp += 3;
+      }
+      *cp++ = '\n';
+
+      m_size = cp - &m_buffer.front ();
+
+    }
+
+  }
+}
+
+}
+
@@ -0,0 +1,135 @@
+/*
+
+  KLayout Layout Viewer
+  Copyright (C) 2013-2018 Matthias Koefferlein
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+
+
+
+#ifndef HDR_tlHexDump
+#define HDR_tlHexDump
+
+#include "config.h"
+
+#include <string>
+#include <vector>
+
+namespace tl
+{
+
+/**
+ *  @brief A formatter for the hex dump lines of the dumpers
+ *
+ *  The formatter writes the position column, the hex bytes and the message of
+ *  a record into a buffer which is reused for the next records. The first line 
+ *  carries the message, the following lines are continuation lines marked with "+".
+ *  Like "%09d", positions are zero-padded to 9 digits.
+ */
+class KLAYOUT_DLL HexDumpFormatter
+{
+public:
+  /**
+   *  @brief Constructor
+   */
+  HexDumpFormatter ();
+
+  /**
+   *  @brief Sets the number of bytes per line
+   */
+  void set_width (size_t w)
+  {
+    m_width = w;
+  }
+
+  /**
+   *  @brief Gets the number of bytes per line
+   */
+  size_t width () const
+  {
+    return m_width;
+  }
+
+  /**
+   *  @brief Sets short mode
+   *
+   *  In short mode, the continuation lines are abbreviated by a single "..." line.
+   */
+  void set_short_mode (bool s)
+  {
+    m_short_mode = s;
+  }
+
+  /**
+   *  @brief Gets a value indicating whether short mode is enabled
+   */
+  bool short_mode () const
+  {
+    return m_short_mode;
+  }
+
+  /**
+   *  @brief Formats a record and appends the lines to the buffer
+   *
+   *  @param pos The position of the first byte
+   *  @param data The bytes of the record
+   *  @param n The number of bytes
+   *  @param msg The message
+   */
+  void format (size_t pos, const char *data, size_t n, const std::string &msg);
+
+  /**
+   *  @brief Gets the formatted text
+   */
+  const char *data () const
+  {
+    return m_buffer.empty () ? 0 : &m_buffer.front ();
+  }
+
+  /**
+   *  @brief Gets the size of the formatted text
+   */
+  size_t size () const
+  {
+    return m_size;
+  }
+
+  /**
+   *  @brief Clears the buffer
+   *
+   *  The memory is kept for the next records.
+   */
+  void clear ()
+  {
+    m_size = 0;
+  }
+
+private:
+  std::vector<char> m_buffer;
+  size_t m_size;
+  size_t m_width;
+  bool m_short_mode;
+
+  char *reserve (size_t n);
+  char *put_position (char *cp, size_t pos, char marker);
+};
+
+}
+
+#endif
+
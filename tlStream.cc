@@ -25,8 +25,24 @@
 #include <string.h> 
 #include <ctype.h> 
 
+#include <vector>
+#include <algorithm>
+
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#else
+#  include <io.h>
+#  include <fcntl.h>
+#  include <sys/stat.h>
+#endif
+
 #include "tlStream.h"
 #include "tlDeflate.h"
+#include "tlThreads.h"
 #include "tlAssert.h"
 
 #include "tlException.h"
@@ -39,11 +55,20 @@ namespace tl
 //  InputStream implementation
 
 InputStream::InputStream (InputStreamBase &delegate)
-  : m_recording (false), m_pos (0), mp_bptr (0), mp_delegate (&delegate), mp_inflate (0)
+  : mp_rec_span (0), m_rec_span_len (0), m_rec_source (0), m_recording (false), m_pos (0), m_inflated_pos (0), mp_bptr (0), mp_mapped (0), mp_delegate (&delegate), mp_inflate (0), m_inflate_exact (false), m_preinflated (false)
 { 
   m_bcap = 4096; // initial buffer capacity
   m_blen = 0;
-  mp_buffer = new char [m_bcap];
+
+  //  use the delegate's memory block directly if it provides one
+  mp_mapped = delegate.mapped_data ();
+  if (mp_mapped) {
+    mp_buffer = 0;
+    mp_bptr = mp_mapped;
+    m_blen = delegate.mapped_size ();
+  } else {
+    mp_buffer = new char [m_bcap];
+  }
 }
 
 InputStream::~InputStream ()
@@ -58,6 +83,39 @@ InputStream::~InputStream ()
   }
 }
 
+//  identifies the memory blocks recorded spans point into
+enum { rec_buffer = 1, rec_inflated = 2 };
+
+void
+InputStream::fill (size_t n)
+{
+  //  the buffer contents are moved
+  if (m_recording) {
+    flush_recorded_span ();
+  }
+
+  //  to keep move activity low, allocate twice as much as required
+  if (m_bcap < n * 2) {
+
+    while (m_bcap < n * 2) {
+      m_bcap *= 2;
+    }
+
+    char *buffer = new char [m_bcap];
+    if (m_blen > 0) {
+      memcpy (buffer, mp_bptr, m_blen);
+    }
+    delete [] mp_buffer;
+    mp_buffer = buffer;
+
+  } else if (m_blen > 0) {
+    memmove (mp_buffer, mp_bptr, m_blen);
+  }
+
+  m_blen += mp_delegate->read (mp_buffer + m_blen, m_bcap - m_blen); 
+  mp_bptr = mp_buffer;
+}
+
 const char * 
 InputStream::get (size_t n, bool bypass_deflate)
 {
@@ -67,7 +125,10 @@ InputStream::get (size_t n, bool bypass_deflate)
 
       const char *r = mp_inflate->get (n);
       tl_assert (r != 0);  //  since deflate did not report at_end()
-      if (m_recording) {
+      m_inflated_pos += n;
+      if (m_recording && ! m_inflate_exact) {
+        //  the inflate filter reuses its buffer, so the bytes are copied
+        flush_recorded_span ();
         m_recorded.insert (m_recorded.end (), r, r + n);
       }
       return r;
@@ -78,27 +139,33 @@ InputStream::get (size_t n, bool bypass_deflate)
     }
   } 
 
-  if (m_blen < n) {
-
-    //  to keep move activity low, allocate twice as much as required
-    if (m_bcap < n * 2) {
+  //  deliver data from a block which has been inflated already
+  if (m_preinflated && ! bypass_deflate) {
+    if (m_inflated_pos < m_inflated.size ()) {
 
-      while (m_bcap < n) {
-        m_bcap *= 2;
+      if (m_inflated.size () - m_inflated_pos < n) {
+        throw tl::Exception (tl::translate ("Unexpected end of file (DEFLATE implementation)"));
       }
 
-      char *buffer = new char [m_bcap];
-      memcpy (buffer, mp_bptr, m_blen);
-      delete [] mp_buffer;
-      mp_buffer = buffer;
+      const char *r = &m_inflated [m_inflated_pos];
+      m_inflated_pos += n;
+      if (m_recording) {
+        record (r, n, rec_inflated);
+      }
+      return r;
 
     } else {
-      memmove (mp_buffer, mp_bptr, m_blen);
+      if (m_recording) {
+        flush_recorded_span ();
+      }
+      m_inflated.clear ();
+      m_preinflated = false;
     }
+  }
 
-    m_blen += mp_delegate->read (mp_buffer + m_blen, m_bcap - m_blen); 
-    mp_bptr = mp_buffer;
-
+  //  NOTE: mapped data is complete - there is nothing to refill
+  if (m_blen < n && ! mp_mapped) {
+    fill (n);
   }
 
   if (m_blen >= n) {
@@ -106,8 +173,9 @@ InputStream::get (size_t n, bool bypass_deflate)
     mp_bptr += n;
     m_blen -= n;
     m_pos += n;
-    if (m_recording) {
-      m_recorded.insert (m_recorded.end (), r, r + n);
+    //  in exact inflating mode, the compressed bytes are recorded 
+    if (m_recording && (! bypass_deflate || (mp_inflate && m_inflate_exact))) {
+      record (r, n, rec_buffer);
     }
     return r;
   } else {
@@ -116,14 +184,62 @@ InputStream::get (size_t n, bool bypass_deflate)
 
 }
 
+const char *
+InputStream::peek (size_t &n)
+{
+  if (mp_inflate) {
+    if (! mp_inflate->at_end ()) {
+      return mp_inflate->peek (n);
+    } else {
+      delete mp_inflate;
+      mp_inflate = 0;
+    }
+  } 
+
+  if (m_preinflated) {
+    if (m_inflated_pos < m_inflated.size ()) {
+      n = m_inflated.size () - m_inflated_pos;
+      return &m_inflated [m_inflated_pos];
+    } else {
+      if (m_recording) {
+        flush_recorded_span ();
+      }
+      m_inflated.clear ();
+      m_preinflated = false;
+    }
+  }
+
+  return borrow_raw (n);
+}
+
+const char *
+InputStream::borrow_raw (size_t &n)
+{
+  if (m_blen < n && ! mp_mapped) {
+    fill (n);
+  }
+
+  n = m_blen;
+  return m_blen > 0 ? mp_bptr : 0;
+}
+
 void
 InputStream::unget (size_t n)
 {
-  if (m_recording && n >= m_recorded.size ()) {
-    m_recorded.erase (m_recorded.end () - n, m_recorded.end ());
+  //  in exact inflating mode, the compressed bytes recorded stay consumed
+  if (m_recording && ! (mp_inflate && m_inflate_exact) && n <= n_recorded ()) {
+    if (n <= m_rec_span_len) {
+      m_rec_span_len -= n;
+    } else {
+      flush_recorded_span ();
+      m_recorded.erase (m_recorded.end () - n, m_recorded.end ());
+    }
   }
   if (mp_inflate) {
     mp_inflate->unget (n);
+    m_inflated_pos -= n;
+  } else if (m_preinflated) {
+    m_inflated_pos -= n;
   } else {
     mp_bptr -= n;
     m_blen += n;
@@ -132,15 +248,40 @@ InputStream::unget (size_t n)
 }
 
 void
-InputStream::inflate ()
+InputStream::inflate (bool exact)
+{
+  tl_assert (mp_inflate == 0 && ! m_preinflated);
+  mp_inflate = new tl::InflateFilter (*this, exact);
+  m_inflate_exact = exact;
+  m_inflated_pos = 0;
+}
+
+void
+InputStream::inflate (std::vector<char> &data, size_t raw_bytes)
 {
-  tl_assert (mp_inflate == 0);
-  mp_inflate = new tl::InflateFilter (*this);
+  tl_assert (mp_inflate == 0 && ! m_preinflated);
+
+  //  skip the compressed data
+  while (raw_bytes > 0) {
+    size_t n = std::min (raw_bytes, size_t (65536));
+    if (! get (n, true)) {
+      throw tl::Exception (tl::translate ("Unexpected end of file (DEFLATE implementation)"));
+    }
+    raw_bytes -= n;
+  }
+
+  if (m_recording) {
+    flush_recorded_span ();
+  }
+  m_inflated.swap (data);
+  m_preinflated = true;
+  m_inflated_pos = 0;
 }
 
 void 
 InputStream::reset ()
 {
+  reset_recording ();
   mp_delegate->reset ();
   m_pos = 0;
 
@@ -148,14 +289,45 @@ InputStream::reset ()
     delete mp_inflate;
     mp_inflate = 0;
   } 
+  m_inflated.clear ();
+  m_preinflated = false;
   if (mp_buffer) {
     delete[] mp_buffer;
     mp_buffer = 0;
   }
 
-  mp_bptr = 0;
-  m_blen = 0;
-  mp_buffer = new char [m_bcap];
+  if (mp_mapped) {
+    mp_bptr = mp_mapped;
+    m_blen = mp_delegate->mapped_size ();
+  } else {
+    mp_bptr = 0;
+    m_blen = 0;
+    mp_buffer = new char [m_bcap];
+  }
+}
+
+void
+InputStream::seek (size_t pos)
+{
+  tl_assert (mp_mapped != 0);
+
+  reset_recording ();
+
+  if (mp_inflate) {
+    delete mp_inflate;
+    mp_inflate = 0;
+  }
+  m_inflated.clear ();
+  m_preinflated = false;
+
+  size_t size = mp_delegate->mapped_size ();
+  if (pos > size) {
+    pos = size;
+  }
+
+  mp_bptr = mp_mapped + pos;
+  m_blen = size - pos;
+  m_pos = pos;
 }
 
 // ---------------------------------------------------------------
@@ -364,6 +536,115 @@ InputFile::reset ()
   }
 }
 
+// ---------------------------------------------------------------
+//  Memory-mapped input file delegate implementation
+
+#ifndef _WIN32 // not available on Windows
+
+InputMappedFile::InputMappedFile (const std::string &path)
+  : mp_data (0), m_size (0), m_pos (0)
+{
+  m_source = path;
+
+  int fd = open (tl::string_to_system (path).c_str (), O_RDONLY);
+  if (fd < 0) {
+    throw FileOpenErrorException (m_source, errno);
+  }
+
+  struct stat st;
+  if (fstat (fd, &st) != 0) {
+    int en = errno;
+    close (fd);
+    throw FileOpenErrorException (m_source, en);
+  }
+
+  m_size = size_t (st.st_size);
+
+  //  an empty file cannot be mapped - it simply delivers nothing
+  if (m_size > 0) {
+
+    void *d = mmap (0, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (d == MAP_FAILED) {
+      int en = errno;
+      close (fd);
+      throw FileOpenErrorException (m_source, en);
+    }
+
+    madvise (d, m_size, MADV_SEQUENTIAL);
+    mp_data = (const char *) d;
+
+  }
+
+  //  the mapping stays valid after the file is closed
+  close (fd);
+}
+
+InputMappedFile::~InputMappedFile ()
+{
+  if (mp_data) {
+    munmap ((void *) mp_data, m_size);
+    mp_data = 0;
+  }
+}
+
+bool
+InputMappedFile::is_mappable (const std::string &path)
+{
+  struct stat st;
+  if (stat (tl::string_to_system (path).c_str (), &st) != 0 || ! S_ISREG (st.st_mode)) {
+    return false;
+  }
+
+  //  gzip-compressed files need to go through the zlib reader
+  FILE *file = fopen (tl::string_to_system (path).c_str (), "rb");
+  if (file == NULL) {
+    return false;
+  }
+
+  unsigned char magic [2] = { 0, 0 };
+  size_t n = fread (magic, 1, sizeof (magic), file);
+  fclose (file);
+
+  return ! (n == sizeof (magic) && magic [0] == 0x1f && magic [1] == 0x8b);
+}
+
+#else
+
+InputMappedFile::InputMappedFile (const std::string &path)
+  : mp_data (0), m_size (0), m_pos (0)
+{
+  throw tl::Exception (tl::translate ("memory-mapped input files not available on Windows"));
+}
+
+InputMappedFile::~InputMappedFile ()
+{
+}
+
+bool
+InputMappedFile::is_mappable (const std::string &path)
+{
+  return false;
+}
+
+#endif
+
+size_t 
+InputMappedFile::read (char *b, size_t n)
+{
+  if (m_pos + n > m_size) {
+    n = m_size - m_pos;
+  }
+  memcpy (b, mp_data + m_pos, n);
+  m_pos += n;
+  return n;
+}
+
+void 
+InputMappedFile::reset ()
+{
+  m_pos = 0;
+}
+
 // ---------------------------------------------------------------
 //  Output file delegate implementation
 
@@ -408,6 +689,188 @@ OutputFile::write (const char *b, size_t n)
   }
 }
 
+// ---------------------------------------------------------------
+//  OutputRawFile implementation
+
+#if defined(_WIN32)
+#  define tl_open_wo(path) _wopen ((const wchar_t *) tl::to_qstring (path).constData (), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE)
+#  define tl_write _write
+#  define tl_close _close
+#else
+#  define tl_open_wo(path) open (tl::string_to_system (path).c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0666)
+#  define tl_write ::write
+#  define tl_close close
+#endif
+
+OutputRawFile::OutputRawFile (const std::string &path)
+  : m_source (path), m_fd (-1), m_owned (true)
+{
+  m_fd = tl_open_wo (path);
+  if (m_fd < 0) {
+    throw FileOpenErrorException (m_source, errno);
+  }
+}
+
+OutputRawFile::OutputRawFile (int fd, const std::string &source)
+  : m_source (source), m_fd (fd), m_owned (false)
+{
+  //  .. nothing yet ..
+}
+
+OutputRawFile::~OutputRawFile ()
+{
+  if (m_owned && m_fd >= 0) {
+    tl_close (m_fd);
+  }
+  m_fd = -1;
+}
+
+void 
+OutputRawFile::write (const char *b, size_t n)
+{
+  tl_assert (m_fd >= 0);
+
+  while (n > 0) {
+    long ret = tl_write (m_fd, b, (unsigned int) std::min (n, size_t (1 << 30)));
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileWriteErrorException (m_source, errno);
+    }
+    b += ret;
+    n -= size_t (ret);
+  }
+}
+
+// ---------------------------------------------------------------
+//  OutputBuffer implementation
+
+/**
+ *  @brief A job writing one chunk to the target of an OutputBuffer
+ */
+class OutputWriteJob
+  : public tl::Job
+{
+public:
+  OutputWriteJob (OutputStreamBase *target, std::vector<char> &chunk)
+    : mp_target (target)
+  { 
+    m_chunk.swap (chunk);
+  }
+
+  virtual void run ()
+  {
+    if (! m_chunk.empty ()) {
+      mp_target->write (&m_chunk.front (), m_chunk.size ());
+    }
+  }
+
+  std::vector<char> &chunk ()
+  {
+    return m_chunk;
+  }
+
+private:
+  OutputStreamBase *mp_target;
+  std::vector<char> m_chunk;
+};
+
+OutputBuffer::OutputBuffer (OutputStreamBase &target, size_t chunk_size, bool threaded)
+  : mp_target (&target), m_chunk_size (std::max (chunk_size, size_t (1))), mp_pool (0)
+{
+  m_chunk.reserve (m_chunk_size);
+  if (threaded) {
+    mp_pool = new tl::ThreadPool (1);
+  }
+}
+
+OutputBuffer::~OutputBuffer ()
+{
+  try {
+    flush ();
+  } catch (...) {
+    //  no exceptions from the destructor
+  }
+
+  delete mp_pool;
+  mp_pool = 0;
+}
+
+void 
+OutputBuffer::write (const char *b, size_t n)
+{
+  while (n > 0) {
+
+    size_t k = std::min (n, m_chunk_size - m_chunk.size ());
+    m_chunk.insert (m_chunk.end (), b, b + k);
+    b += k;
+    n -= k;
+
+    if (m_chunk.size () == m_chunk_size) {
+      write_chunk ();
+    }
+
+  }
+}
+
+void 
+OutputBuffer::flush ()
+{
+  if (! m_chunk.empty ()) {
+    write_chunk ();
+  }
+  if (mp_pool) {
+    collect ();
+  }
+  mp_target->flush ();
+}
+
+void
+OutputBuffer::write_chunk ()
+{
+  if (! mp_pool) {
+
+    mp_target->write (&m_chunk.front (), m_chunk.size ());
+    m_chunk.clear ();
+
+  } else {
+
+    //  double buffering: wait for the previous chunk before handing over this one
+    collect ();
+
+    mp_pool->submit (new OutputWriteJob (mp_target, m_chunk));
+
+    m_chunk.swap (m_spare);
+    m_chunk.clear ();
+    m_chunk.reserve (m_chunk_size);
+
+  }
+}
+
+void
+OutputBuffer::collect ()
+{
+  while (mp_pool->pending () > 0) {
+
+    OutputWriteJob *job = dynamic_cast<OutputWriteJob *> (mp_pool->wait_next ());
+    tl_assert (job != 0);
+
+    //  recycle the chunk's memory
+    m_spare.swap (job->chunk ());
+    m_spare.clear ();
+
+    bool failed = job->failed ();
+    std::string em = job->error ();
+    delete job;
+
+    if (failed) {
+      throw tl::Exception (em);
+    }
+
+  }
+}
+
 // ---------------------------------------------------------------
 //  InputZLibFile implementation
 
@@ -463,6 +926,139 @@ InputZLibFile::reset ()
   }
 }
 
+// ---------------------------------------------------------------
+//  InputThreadedZLibFile implementation
+
+/**
+ *  @brief A job reading one block from a zlib file
+ *
+ *  The jobs run on a single worker, hence they read the blocks in submission order.
+ */
+class InputZLibReadJob
+  : public tl::Job
+{
+public:
+  InputZLibReadJob (InputZLibFile *file, size_t block_size)
+    : mp_file (file), m_block (block_size), m_size (0)
+  { }
+
+  virtual void run ()
+  {
+    //  gzread may deliver less than requested - fill the block as far as possible
+    while (m_size < m_block.size ()) {
+      size_t n = mp_file->read (&m_block.front () + m_size, m_block.size () - m_size);
+      if (n == 0) {
+        break;
+      }
+      m_size += n;
+    }
+  }
+
+  const char *data () const
+  {
+    return &m_block.front ();
+  }
+
+  size_t size () const
+  {
+    return m_size;
+  }
+
+private:
+  InputZLibFile *mp_file;
+  std::vector<char> m_block;
+  size_t m_size;
+};
+
+InputThreadedZLibFile::InputThreadedZLibFile (const std::string &path, size_t block_size, unsigned int blocks)
+  : m_file (path), m_block_size (std::max (block_size, size_t (1))), m_blocks (std::max (blocks, 1u)), mp_pool (0), mp_current (0), m_current_pos (0), m_at_end (false)
+{
+  start ();
+}
+
+InputThreadedZLibFile::~InputThreadedZLibFile ()
+{
+  stop ();
+}
+
+void
+InputThreadedZLibFile::start ()
+{
+  mp_pool = new tl::ThreadPool (1);
+  for (unsigned int i = 0; i < m_blocks; ++i) {
+    mp_pool->submit (new InputZLibReadJob (&m_file, m_block_size));
+  }
+}
+
+void
+InputThreadedZLibFile::stop ()
+{
+  //  the pool's destructor waits for the running job and discards the others
+  delete mp_pool;
+  mp_pool = 0;
+  delete mp_current;
+  mp_current = 0;
+  m_current_pos = 0;
+  m_at_end = false;
+}
+
+size_t 
+InputThreadedZLibFile::read (char *b, size_t n)
+{
+  size_t nread = 0;
+
+  while (nread < n && ! m_at_end) {
+
+    if (! mp_current) {
+
+      mp_current = dynamic_cast<InputZLibReadJob *> (mp_pool->wait_next ());
+      tl_assert (mp_current != 0);
+      m_current_pos = 0;
+
+      if (mp_current->failed ()) {
+        std::string em = mp_current->error ();
+        delete mp_current;
+        mp_current = 0;
+        m_at_end = true;
+        //  the message already is the one of the original exception
+        throw tl::Exception (em);
+      }
+
+      if (mp_current->size () == 0) {
+        delete mp_current;
+        mp_current = 0;
+        m_at_end = true;
+        break;
+      }
+
+      //  keep the read-ahead queue filled
+      mp_pool->submit (new InputZLibReadJob (&m_file, m_block_size));
+
+    }
+
+    size_t k = std::min (n - nread, mp_current->size () - m_current_pos);
+    memcpy (b + nread, mp_current->data () + m_current_pos, k);
+    m_current_pos += k;
+    nread += k;
+
+    if (m_current_pos == mp_current->size ()) {
+      delete mp_current;
+      mp_current = 0;
+    }
+
+  }
+
+  return nread;
+}
+
+void 
+InputThreadedZLibFile::reset ()
+{
+  stop ();
+  m_file.reset ();
+  start ();
+}
+
 // ---------------------------------------------------------------
 //  OutputZLibFile implementation
 
@@ -655,5 +1251,37 @@ read_file (tl::InputStreamBase &stream_base, std::string &into)
   }
 }
 
+// ---------------------------------------------------------------
+//  open_input_file implementation
+
+InputStreamBase *
+open_input_file (const std::string &path)
+{
+  if (InputMappedFile::is_mappable (path)) {
+    try {
+      return new InputMappedFile (path);
+    } catch (tl::Exception &) {
+      //  mapping may fail for other reasons (i.e. address space) - fall back to reading
+    }
+  }
+
+  return new InputThreadedZLibFile (path);
+}
+
+// ---------------------------------------------------------------
+//  file_stamp implementation
+
+bool
+file_stamp (const std::string &path, uint64_t &size, uint64_t &mtime)
+{
+  struct stat st;
+  if (stat (tl::string_to_system (path).c_str (), &st) != 0) {
+    return false;
+  }
+
+  size = uint64_t (st.st_size);
+  mtime = uint64_t (st.st_mtime);
+  return true;
 }
 
+}
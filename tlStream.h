@@ -40,6 +40,9 @@ namespace tl
 
 class InflateFilter;
 class DeflateFilter;
+class ThreadPool;
+class InputZLibReadJob;
+class OutputWriteJob;
 
 /**
  *  @brief The input stream delegate base class
@@ -78,6 +81,27 @@ public:
    *  Returns an empty string if no file name is available.
    */
   virtual std::string source () = 0;
+
+  /**
+   *  @brief Get the memory block holding the complete data, if there is one
+   *
+   *  Delegates which can provide their whole content as a single block of memory
+   *  (i.e. memory-mapped files) reimplement this method. InputStream will then
+   *  deliver pointers into this block rather than copying the data into its buffer.
+   *  The default implementation returns 0.
+   */
+  virtual const char *mapped_data ()
+  {
+    return 0;
+  }
+
+  /**
+   *  @brief Get the size of the memory block delivered by mapped_data
+   */
+  virtual size_t mapped_size ()
+  {
+    return 0;
+  }
 };
 
 /**
@@ -120,6 +144,17 @@ public:
   {
     return false;
   }
+
+  /**
+   *  @brief Writes out the data which has been buffered
+   *
+   *  Delegates which buffer data reimplement this method.
+   *  The default implementation does nothing.
+   */
+  virtual void flush ()
+  {
+    //  .. the default implementation does nothing ..
+  }
 };
 
 /**
@@ -175,6 +210,20 @@ public:
    */
   void unget (size_t n);
 
+  /**
+   *  @brief Look at the next bytes without consuming them
+   *
+   *  This method delivers a pointer to the bytes the next "get" call would deliver. 
+   *  Like "get", it delivers inflated bytes while inflating. "n" is the number of bytes
+   *  requested and receives the number of contiguous bytes available. This can be
+   *  less than requested at the end of the file or of a compressed block, or more 
+   *  than requested. Use "get" to consume the bytes. The pointer stays valid until
+   *  the next call of get, unget, peek or borrow_raw.
+   *
+   *  @return 0 if no more bytes are available
+   */
+  const char *peek (size_t &n);
+
   /**
    *  @brief Enable uncompression of the following DEFLATE-compressed block
    *
@@ -183,11 +232,84 @@ public:
    *  the uncompressed data rather than the raw data, until the
    *  compressed block is finished.
    *  The stream must not be in inflate state yet.
+   *
+   *  If "exact" is true, the compressed bytes are consumed as far as they are 
+   *  required for the uncompressed bytes delivered. "pos" then gives the position 
+   *  inside the compressed data and while recording, the compressed bytes are 
+   *  recorded. This is slower and intended for tracing the file contents.
+   */
+  void inflate (bool exact = false);
+
+  /**
+   *  @brief Enable delivery of a block which has been inflated already
+   *
+   *  This is an alternative to "inflate" for compressed blocks which have been
+   *  uncompressed elsewhere (i.e. by a worker thread). Subsequent get() calls
+   *  will deliver the bytes from "data" until these are consumed. "raw_bytes" is
+   *  the number of compressed bytes which are skipped in the raw stream.
+   *  The stream takes over the contents of "data" (it is swapped).
+   */
+  void inflate (std::vector<char> &data, size_t raw_bytes);
+
+  /**
+   *  @brief Borrow the raw bytes available without reading them
+   *
+   *  This method delivers a pointer to the raw (not inflated) bytes which are 
+   *  available in the buffer. If there are less than "n" bytes, the buffer is refilled.
+   *  "n" receives the number of bytes available. The bytes are not consumed - 
+   *  use "get (n, true)" to consume them. The pointer stays valid until the next
+   *  call of get, unget or borrow_raw.
+   *
+   *  @return 0 if no more bytes are available
+   */
+  const char *borrow_raw (size_t &n);
+
+  /**
+   *  @brief Returns a value indicating whether the stream supports "seek"
+   *
+   *  Only streams reading from a memory block (see InputStreamBase::mapped_data)
+   *  can be positioned freely.
+   */
+  bool supports_seek () const
+  {
+    return mp_mapped != 0;
+  }
+
+  /**
+   *  @brief Positions the stream at the given raw position
+   *
+   *  Inflating is stopped and the recorded bytes are discarded. Positions beyond
+   *  the end of the data are positioned at the end.
+   */
+  void seek (size_t pos);
+
+  /**
+   *  @brief Returns a value indicating whether the stream delivers inflated data
+   *
+   *  This is true after "inflate" was called until the first byte after the
+   *  compressed block is read.
    */
-  void inflate ();
+  bool inflating () const
+  {
+    return mp_inflate != 0 || m_preinflated;
+  }
+
+  /**
+   *  @brief Obtain the position inside the uncompressed data while inflating
+   *
+   *  This is the number of uncompressed bytes delivered since "inflate" was called.
+   */
+  size_t inflated_pos () const
+  {
+    return m_inflated_pos;
+  }
 
   /**
    *  @brief Obtain the current file position
+   *
+   *  While inflating, the raw position is not well defined as the compressed
+   *  data is read in chunks, unless exact inflating is enabled (see "inflate").
+   *  Use inflated_pos in that case.
    */
   size_t pos () const 
   {
@@ -222,10 +344,20 @@ public:
 
   /**
    *  @brief Start recording 
+   *
+   *  While recording, the bytes delivered by get are collected. When inflating,
+   *  these are the uncompressed bytes. Raw bytes read with "bypass_inflate" are
+   *  not recorded - except in exact inflating mode, where the compressed bytes 
+   *  are recorded instead of the uncompressed ones.
+   *
+   *  As long as possible, the recorded bytes are kept as a span of the memory 
+   *  the bytes are delivered from (the buffer, the mapped file or the inflated block). 
+   *  They are only copied if this memory is about to be overwritten or if the
+   *  bytes come from different memory blocks.
    */
   void start_recording ()
   {
-    m_recorded.clear ();
+    reset_recording ();
     m_recording = true;
   }
 
@@ -234,7 +366,7 @@ public:
    */
   void stop_recording ()
   {
-    m_recorded.clear ();
+    reset_recording ();
     m_recording = false;
   }
 
@@ -244,6 +376,9 @@ public:
   void reset_recording ()
   {
     m_recorded.clear ();
+    mp_rec_span = 0;
+    m_rec_span_len = 0;
+    m_rec_source = 0;
   }
 
   /**
@@ -251,15 +386,22 @@ public:
    */
   size_t n_recorded () const
   {
-    return m_recorded.size ();
+    return m_recorded.size () + m_rec_span_len;
   }
     
   /**
    *  @brief Get the recorded byte array 
+   *
+   *  The pointer is valid until the next call of a non-const method.
    */
-  const char *recorded () const
+  const char *recorded ()
   {
-    return &m_recorded.front ();
+    if (m_recorded.empty ()) {
+      return mp_rec_span;
+    } else {
+      flush_recorded_span ();
+      return &m_recorded.front ();
+    }
   }
     
 protected:
@@ -270,16 +412,57 @@ protected:
 
 private:
   std::vector <char> m_recorded;
+  const char *mp_rec_span;
+  size_t m_rec_span_len;
+  int m_rec_source;
   bool m_recording;
   size_t m_pos;
+  size_t m_inflated_pos;
   char *mp_buffer;
   size_t m_bcap;
   size_t m_blen;
-  char *mp_bptr;
+  const char *mp_bptr;
+  const char *mp_mapped;
   InputStreamBase *mp_delegate;
 
   //  inflate support 
   InflateFilter *mp_inflate;
+  bool m_inflate_exact;
+  std::vector<char> m_inflated;
+  bool m_preinflated;
+
+  void fill (size_t n);
+
+  /**
+   *  @brief Records n bytes delivered from r
+   *
+   *  "source" identifies the memory block: bytes from different blocks are never
+   *  joined into one span, even if they happen to be adjacent.
+   */
+  void record (const char *r, size_t n, int source)
+  {
+    if (source == m_rec_source && r == mp_rec_span + m_rec_span_len) {
+      m_rec_span_len += n;
+    } else {
+      flush_recorded_span ();
+      mp_rec_span = r;
+      m_rec_span_len = n;
+      m_rec_source = source;
+    }
+  }
+
+  /**
+   *  @brief Copies the recorded span, i.e. because its memory is about to be overwritten
+   */
+  void flush_recorded_span ()
+  {
+    if (m_rec_span_len > 0) {
+      m_recorded.insert (m_recorded.end (), mp_rec_span, mp_rec_span + m_rec_span_len);
+    }
+    mp_rec_span = 0;
+    m_rec_span_len = 0;
+    m_rec_source = 0;
+  }
 
   //  No copying currently
   InputStream (const InputStream &);
@@ -486,6 +669,14 @@ public:
   {
     return m_pos;
   }
+
+  /**
+   *  @brief Writes out the data buffered by the delegate
+   */
+  void flush ()
+  {
+    mp_delegate->flush ();
+  }
     
 protected:
   void reset_pos ()
@@ -601,6 +792,22 @@ public:
     return "data";
   }
 
+  /**
+   *  @brief Deliver the memory block directly
+   */
+  virtual const char *mapped_data ()
+  {
+    return mp_data;
+  }
+
+  /**
+   *  @brief Get the size of the memory block
+   */
+  virtual size_t mapped_size ()
+  {
+    return m_length;
+  }
+
 private:
   const char *mp_data;
   size_t m_length, m_pos;
@@ -720,6 +927,75 @@ private:
   gzFile m_zs;
 };
 
+/**
+ *  @brief A zlib input file delegate decompressing in a separate thread
+ *
+ *  The decompression is done by a worker thread which reads ahead a number of
+ *  large blocks. The reader thread only copies the decompressed data. 
+ *  Multi-member gzip files are handled like with InputZLibFile. 
+ */
+class KLAYOUT_DLL InputThreadedZLibFile
+  : public InputStreamBase
+{
+public:
+  /**
+   *  @brief Open a file with the given path
+   *
+   *  Will throw a FileOpenErrorException if an error occurs.
+   *
+   *  @param path The (relative) path of the file to open
+   *  @param block_size The size of the blocks decompressed in the background
+   *  @param blocks The number of blocks to read ahead
+   */
+  InputThreadedZLibFile (const std::string &path, size_t block_size = 1024 * 1024, unsigned int blocks = 4);
+
+  /**
+   *  @brief Close the file
+   *
+   *  The destructor will stop the decompression thread and close the file.
+   */
+  virtual ~InputThreadedZLibFile ();
+
+  /**
+   *  @brief Read from a file 
+   *
+   *  Implements the basic read method. 
+   *  Will throw a ZLibReadErrorException if an error occurs.
+   */
+  virtual size_t read (char *b, size_t n);
+
+  /**
+   *  @brief Reset to the beginning of the file
+   */
+  virtual void reset ();
+
+  /**
+   *  @brief Get the source specification (the file name)
+   *
+   *  Returns an empty string if no file name is available.
+   */
+  virtual std::string source () 
+  {
+    return m_file.source ();
+  }
+
+private:
+  InputZLibFile m_file;
+  size_t m_block_size;
+  unsigned int m_blocks;
+  ThreadPool *mp_pool;
+  InputZLibReadJob *mp_current;
+  size_t m_current_pos;
+  bool m_at_end;
+
+  void start ();
+  void stop ();
+
+  //  No copying
+  InputThreadedZLibFile (const InputThreadedZLibFile &);
+  InputThreadedZLibFile &operator= (const InputThreadedZLibFile &);
+};
+
 /**
  *  @brief A zlib output file delegate
  *
@@ -816,6 +1092,177 @@ private:
   FILE *m_file;
 };
 
+/**
+ *  @brief A memory-mapped input file delegate
+ *
+ *  Implements the reader for ordinary, uncompressed files by mapping the
+ *  whole file into memory. InputStream uses the mapped block directly, so 
+ *  no data is copied. The mapping is advised for sequential access.
+ */
+class KLAYOUT_DLL InputMappedFile
+  : public InputStreamBase
+{
+public:
+  /**
+   *  @brief Open and map a file with the given path
+   *
+   *  Will throw a FileOpenErrorException if the file cannot be opened or mapped.
+   *
+   *  @param path The (relative) path of the file to open
+   */
+  InputMappedFile (const std::string &path);
+
+  /**
+   *  @brief Unmap and close the file
+   */
+  virtual ~InputMappedFile ();
+
+  /**
+   *  @brief Read from the file
+   *
+   *  Implements the basic read method by copying from the mapped block.
+   */
+  virtual size_t read (char *b, size_t n);
+
+  /**
+   *  @brief Reset to the beginning of the file
+   */
+  virtual void reset ();
+
+  /**
+   *  @brief Get the source specification (the file name)
+   *
+   *  Returns an empty string if no file name is available.
+   */
+  virtual std::string source () 
+  {
+    return m_source;
+  }
+
+  /**
+   *  @brief Deliver the mapped block
+   */
+  virtual const char *mapped_data ()
+  {
+    return mp_data;
+  }
+
+  /**
+   *  @brief Get the size of the mapped block
+   */
+  virtual size_t mapped_size ()
+  {
+    return m_size;
+  }
+
+  /**
+   *  @brief Returns a value indicating whether the given file can be mapped
+   *
+   *  Files can be mapped if they are regular files and are not gzip-compressed.
+   */
+  static bool is_mappable (const std::string &path);
+
+private:
+  std::string m_source;
+  const char *mp_data;
+  size_t m_size, m_pos;
+};
+
+/**
+ *  @brief An output delegate writing to a file descriptor
+ *
+ *  This delegate does not buffer - every write is a system call. 
+ *  Use it together with OutputBuffer.
+ */
+class KLAYOUT_DLL OutputRawFile
+  : public OutputStreamBase
+{
+public:
+  /**
+   *  @brief Create or truncate the file with the given path and open it for writing
+   *
+   *  Will throw a FileOpenErrorException if an error occurs.
+   */
+  OutputRawFile (const std::string &path);
+
+  /**
+   *  @brief Use an existing file descriptor (i.e. 1 for stdout)
+   *
+   *  The file descriptor is not closed by the destructor.
+   *
+   *  @param source The name used in error messages
+   */
+  OutputRawFile (int fd, const std::string &source);
+
+  /**
+   *  @brief Close the file
+   */
+  virtual ~OutputRawFile ();
+
+  /**
+   *  @brief Write to the file
+   *
+   *  Will throw a FileWriteErrorException if an error occurs.
+   */
+  virtual void write (const char *b, size_t n);
+
+private:
+  std::string m_source;
+  int m_fd;
+  bool m_owned;
+};
+
+/**
+ *  @brief A buffering output delegate
+ *
+ *  This delegate collects the data in large chunks and writes full chunks to
+ *  the target delegate. Optionally, the chunks are written by a separate thread.
+ *  In that case, one chunk is filled while the other one is written.
+ *  Errors from the writer thread are reported by the next write or flush.
+ *  The destructor writes the remaining data, but ignores errors.
+ */
+class KLAYOUT_DLL OutputBuffer
+  : public OutputStreamBase
+{
+public:
+  /**
+   *  @brief Constructor
+   *
+   *  @param target The delegate to which the chunks are written
+   *  @param chunk_size The size of the chunks
+   *  @param threaded True, if the chunks shall be written by a separate thread
+   */
+  OutputBuffer (OutputStreamBase &target, size_t chunk_size = 1024 * 1024, bool threaded = false);
+
+  /**
+   *  @brief Destructor
+   */
+  virtual ~OutputBuffer ();
+
+  /**
+   *  @brief Write to the buffer
+   */
+  virtual void write (const char *b, size_t n);
+
+  /**
+   *  @brief Write the buffered data to the target and wait until it is written
+   */
+  virtual void flush ();
+
+private:
+  OutputStreamBase *mp_target;
+  std::vector<char> m_chunk, m_spare;
+  size_t m_chunk_size;
+  ThreadPool *mp_pool;
+
+  void write_chunk ();
+  void collect ();
+
+  //  No copying
+  OutputBuffer (const OutputBuffer &);
+  OutputBuffer &operator= (const OutputBuffer &);
+};
+
 /**
  *  @brief A simple output file delegate
  *
@@ -1005,6 +1452,22 @@ private:
  */
 void KLAYOUT_DLL read_file (tl::InputStreamBase &stream_base, std::string &into);
 
+/**
+ *  @brief Utility: open a file for reading with the most efficient delegate
+ *
+ *  Uncompressed regular files are memory-mapped (see InputMappedFile). Everything else,
+ *  specifically gzip-compressed files, is read through InputThreadedZLibFile.
+ *  The caller takes over ownership of the delegate returned.
+ */
+KLAYOUT_DLL InputStreamBase *open_input_file (const std::string &path);
+
+/**
+ *  @brief Utility: get the size and modification time of a file
+ *
+ *  Returns false if the file cannot be accessed.
+ */
+KLAYOUT_DLL bool file_stamp (const std::string &path, uint64_t &size, uint64_t &mtime);
+
 }
 
 #endif
@@ -0,0 +1,173 @@
+/*
+
+  KLayout Layout Viewer
+  Copyright (C) 2013-2018 Matthias Koefferlein
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+
+#include "tlThreads.h"
+#include "tlException.h"
+
+namespace tl
+{
+
+// ---------------------------------------------------------------
+//  ThreadPool implementation
+
+ThreadPool::ThreadPool (unsigned int nworkers, size_t max_pending)
+  : m_max_pending (max_pending), m_closed (false), m_stopped (false)
+{
+  if (nworkers < 1) {
+    nworkers = 1;
+  }
+  for (unsigned int i = 0; i < nworkers; ++i) {
+    m_workers.push_back (std::thread (&ThreadPool::worker, this));
+  }
+}
+
+ThreadPool::~ThreadPool ()
+{
+  stop ();
+
+  for (std::vector<std::thread>::iterator w = m_workers.begin (); w != m_workers.end (); ++w) {
+    w->join ();
+  }
+
+  for (std::deque<Job *>::const_iterator j = m_jobs.begin (); j != m_jobs.end (); ++j) {
+    delete *j;
+  }
+  m_jobs.clear ();
+}
+
+bool
+ThreadPool::submit (Job *job)
+{
+  std::unique_lock<std::mutex> lock (m_lock);
+
+  while (! m_stopped && m_max_pending > 0 && m_jobs.size () >= m_max_pending) {
+    m_space_cond.wait (lock);
+  }
+
+  if (m_stopped) {
+    delete job;
+    return false;
+  }
+
+  m_jobs.push_back (job);
+  m_todo.push_back (job);
+  m_todo_cond.notify_one ();
+
+  return true;
+}
+
+void
+ThreadPool::close ()
+{
+  std::unique_lock<std::mutex> lock (m_lock);
+  m_closed = true;
+  m_done_cond.notify_all ();
+}
+
+void
+ThreadPool::stop ()
+{
+  std::unique_lock<std::mutex> lock (m_lock);
+  m_stopped = true;
+  //  jobs not started yet stay in m_jobs and are deleted by the destructor
+  m_todo.clear ();
+  m_todo_cond.notify_all ();
+  m_done_cond.notify_all ();
+  m_space_cond.notify_all ();
+}
+
+Job *
+ThreadPool::wait_next ()
+{
+  std::unique_lock<std::mutex> lock (m_lock);
+
+  while (true) {
+    if (m_stopped) {
+      return 0;
+    } else if (! m_jobs.empty () && m_jobs.front ()->m_done) {
+      break;
+    } else if (m_jobs.empty () && m_closed) {
+      return 0;
+    }
+    m_done_cond.wait (lock);
+  }
+
+  Job *job = m_jobs.front ();
+  m_jobs.pop_front ();
+  m_space_cond.notify_one ();
+
+  return job;
+}
+
+size_t
+ThreadPool::pending () const
+{
+  std::unique_lock<std::mutex> lock (m_lock);
+  return m_jobs.size ();
+}
+
+void
+ThreadPool::worker ()
+{
+  std::unique_lock<std::mutex> lock (m_lock);
+
+  while (true) {
+
+    while (! m_stopped && m_todo.empty ()) {
+      m_todo_cond.wait (lock);
+    }
+    if (m_stopped) {
+      return;
+    }
+
+    Job *job = m_todo.front ();
+    m_todo.pop_front ();
+
+    lock.unlock ();
+
+    bool failed = false;
+    std::string error;
+    try {
+      job->run ();
+    } catch (tl::Exception &ex) {
+      failed = true;
+      error = ex.msg ();
+    } catch (std::exception &ex) {
+      failed = true;
+      error = ex.what ();
+    } catch (...) {
+      failed = true;
+      error = "Unspecific error";
+    }
+
+    lock.lock ();
+
+    job->m_failed = failed;
+    job->m_error = error;
+    job->m_done = true;
+    m_done_cond.notify_all ();
+
+  }
+}
+
+}
+
@@ -0,0 +1,174 @@
+/*
+
+  KLayout Layout Viewer
+  Copyright (C) 2013-2018 Matthias Koefferlein
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+*/
+
+
+
+#ifndef HDR_tlThreads
+#define HDR_tlThreads
+
+#include "config.h"
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace tl
+{
+
+class ThreadPool;
+
+/**
+ *  @brief A job to be executed by a ThreadPool
+ *
+ *  Reimplement "run" to provide the job's functionality. Exceptions thrown
+ *  by "run" are captured and reported through "failed" and "error".
+ */
+class KLAYOUT_DLL Job
+{
+public:
+  /**
+   *  @brief Constructor
+   */
+  Job ()
+    : m_done (false), m_failed (false)
+  { }
+
+  /**
+   *  @brief Destructor
+   */
+  virtual ~Job () { }
+
+  /**
+   *  @brief Executes the job
+   *
+   *  This method is called from one of the worker threads.
+   */
+  virtual void run () = 0;
+
+  /**
+   *  @brief Returns true, if the job terminated with an exception
+   */
+  bool failed () const
+  {
+    return m_failed;
+  }
+
+  /**
+   *  @brief Gets the error message if the job failed
+   */
+  const std::string &error () const
+  {
+    return m_error;
+  }
+
+private:
+  friend class ThreadPool;
+
+  bool m_done;
+  bool m_failed;
+  std::string m_error;
+};
+
+/**
+ *  @brief A pool of worker threads executing jobs
+ *
+ *  The jobs are executed in parallel, but they are delivered in the order they
+ *  have been submitted (see "wait_next"). Submitting and collecting may happen
+ *  from different threads.
+ */
+class KLAYOUT_DLL ThreadPool
+{
+public:
+  /**
+   *  @brief Constructor
+   *
+   *  @param nworkers The number of worker threads
+   *  @param max_pending If non-zero, "submit" will block while that many jobs are not collected yet
+   */
+  ThreadPool (unsigned int nworkers, size_t max_pending = 0);
+
+  /**
+   *  @brief Destructor
+   *
+   *  Pending jobs are discarded. The destructor waits for running jobs to finish.
+   */
+  ~ThreadPool ();
+
+  /**
+   *  @brief Submits a job
+   *
+   *  The pool takes over ownership of the job.
+   *
+   *  @return false, if the pool has been stopped. In that case, the job is deleted.
+   */
+  bool submit (Job *job);
+
+  /**
+   *  @brief Indicates that no more jobs will be submitted
+   *
+   *  After this, "wait_next" will return 0 once all jobs have been delivered.
+   */
+  void close ();
+
+  /**
+   *  @brief Stops the pool
+   *
+   *  Jobs not started yet are discarded and blocking "submit" and "wait_next" calls return.
+   */
+  void stop ();
+
+  /**
+   *  @brief Waits for the next job in submission order to finish
+   *
+   *  The caller takes over ownership of the job returned.
+   *
+   *  @return 0, if the pool was closed or stopped and no more jobs are available
+   */
+  Job *wait_next ();
+
+  /**
+   *  @brief Gets the number of jobs submitted but not delivered yet
+   */
+  size_t pending () const;
+
+private:
+  std::vector<std::thread> m_workers;
+  std::deque<Job *> m_jobs;
+  std::deque<Job *> m_todo;
+  size_t m_max_pending;
+  bool m_closed, m_stopped;
+  mutable std::mutex m_lock;
+  std::condition_variable m_todo_cond, m_done_cond, m_space_cond;
+
+  void worker ();
+
+  //  No copying
+  ThreadPool (const ThreadPool &);
+  ThreadPool &operator= (const ThreadPool &);
+};
+
+}
+
+#endif
+